@@ -44,10 +44,23 @@ else()
   find_library(ZSTD_LIBRARY zstd)
   find_path(ZSTD_INCLUDE_DIR zstd.h)
 
+  if(ZSTD_INCLUDE_DIR AND EXISTS "${ZSTD_INCLUDE_DIR}/zstd.h")
+    file(STRINGS "${ZSTD_INCLUDE_DIR}/zstd.h" zstd_version_lines
+         REGEX "^#define ZSTD_VERSION_(MAJOR|MINOR|RELEASE) +[0-9]+")
+    foreach(part MAJOR MINOR RELEASE)
+      string(REGEX REPLACE ".*#define ZSTD_VERSION_${part} +([0-9]+).*" "\\1"
+             zstd_version_${part} "${zstd_version_lines}")
+    endforeach()
+    set(zstd_VERSION
+        "${zstd_version_MAJOR}.${zstd_version_MINOR}.${zstd_version_RELEASE}")
+  endif()
+
   include(FindPackageHandleStandardArgs)
   find_package_handle_standard_args(
-    zstd "please install libzstd or use -DZSTD_FROM_INTERNET=ON"
-    ZSTD_INCLUDE_DIR ZSTD_LIBRARY)
+    zstd
+    REQUIRED_VARS ZSTD_LIBRARY ZSTD_INCLUDE_DIR
+    VERSION_VAR zstd_VERSION
+    FAIL_MESSAGE "please install libzstd or use -DZSTD_FROM_INTERNET=ON")
   mark_as_advanced(ZSTD_INCLUDE_DIR ZSTD_LIBRARY)
 
   add_library(ZSTD::ZSTD UNKNOWN IMPORTED)
@@ -57,13 +57,17 @@ namespace {
 
 enum class ConfigItem {
   absolute_paths_in_stderr,
+  adaptive_compression,
   base_dir,
   cache_dir,
   compiler,
   compiler_check,
+  compiler_check_cache,
   compiler_type,
   compression,
   compression_level,
+  compression_threads,
+  compression_type,
   cpp_extension,
   debug,
   debug_dir,
@@ -77,6 +81,7 @@ enum class ConfigItem {
   ignore_headers_in_manifest,
   ignore_options,
   inode_cache,
+  inode_cache_max_size,
   keep_comments_cpp,
   limit_multiple,
   log_file,
@@ -94,6 +99,7 @@ enum class ConfigItem {
   run_second_cpp,
   secondary_storage,
   sloppiness,
+  stat_cache_session,
   stats,
   stats_log,
   temporary_dir,
@@ -102,13 +108,17 @@ enum class ConfigItem {
 
 const std::unordered_map<std::string, ConfigItem> k_config_key_table = {
   {"absolute_paths_in_stderr", ConfigItem::absolute_paths_in_stderr},
+  {"adaptive_compression", ConfigItem::adaptive_compression},
   {"base_dir", ConfigItem::base_dir},
   {"cache_dir", ConfigItem::cache_dir},
   {"compiler", ConfigItem::compiler},
   {"compiler_check", ConfigItem::compiler_check},
+  {"compiler_check_cache", ConfigItem::compiler_check_cache},
   {"compiler_type", ConfigItem::compiler_type},
   {"compression", ConfigItem::compression},
   {"compression_level", ConfigItem::compression_level},
+  {"compression_threads", ConfigItem::compression_threads},
+  {"compression_type", ConfigItem::compression_type},
   {"cpp_extension", ConfigItem::cpp_extension},
   {"debug", ConfigItem::debug},
   {"debug_dir", ConfigItem::debug_dir},
@@ -122,6 +132,7 @@ const std::unordered_map<std::string, ConfigItem> k_config_key_table = {
   {"ignore_headers_in_manifest", ConfigItem::ignore_headers_in_manifest},
   {"ignore_options", ConfigItem::ignore_options},
   {"inode_cache", ConfigItem::inode_cache},
+  {"inode_cache_max_size", ConfigItem::inode_cache_max_size},
   {"keep_comments_cpp", ConfigItem::keep_comments_cpp},
   {"limit_multiple", ConfigItem::limit_multiple},
   {"log_file", ConfigItem::log_file},
@@ -139,6 +150,7 @@ const std::unordered_map<std::string, ConfigItem> k_config_key_table = {
   {"run_second_cpp", ConfigItem::run_second_cpp},
   {"secondary_storage", ConfigItem::secondary_storage},
   {"sloppiness", ConfigItem::sloppiness},
+  {"stat_cache_session", ConfigItem::stat_cache_session},
   {"stats", ConfigItem::stats},
   {"stats_log", ConfigItem::stats_log},
   {"temporary_dir", ConfigItem::temporary_dir},
@@ -147,14 +159,18 @@ const std::unordered_map<std::string, ConfigItem> k_config_key_table = {
 
 const std::unordered_map<std::string, std::string> k_env_variable_table = {
   {"ABSSTDERR", "absolute_paths_in_stderr"},
+  {"ADAPTIVECOMPRESS", "adaptive_compression"},
   {"BASEDIR", "base_dir"},
   {"CC", "compiler"}, // Alias for CCACHE_COMPILER
   {"COMMENTS", "keep_comments_cpp"},
   {"COMPILER", "compiler"},
   {"COMPILERCHECK", "compiler_check"},
+  {"COMPILERCHECK_CACHE", "compiler_check_cache"},
   {"COMPILERTYPE", "compiler_type"},
   {"COMPRESS", "compression"},
   {"COMPRESSLEVEL", "compression_level"},
+  {"COMPRESSTHREADS", "compression_threads"},
+  {"COMPRESSTYPE", "compression_type"},
   {"CPP2", "run_second_cpp"},
   {"DEBUG", "debug"},
   {"DEBUGDIR", "debug_dir"},
@@ -170,6 +186,7 @@ const std::unordered_map<std::string, std::string> k_env_variable_table = {
   {"IGNOREHEADERS", "ignore_headers_in_manifest"},
   {"IGNOREOPTIONS", "ignore_options"},
   {"INODECACHE", "inode_cache"},
+  {"INODECACHE_MAXSIZE", "inode_cache_max_size"},
   {"LIMIT_MULTIPLE", "limit_multiple"},
   {"LOGFILE", "log_file"},
   {"MAXFILES", "max_files"},
@@ -185,6 +202,7 @@ const std::unordered_map<std::string, std::string> k_env_variable_table = {
   {"RESHARE", "reshare"},
   {"SECONDARY_STORAGE", "secondary_storage"},
   {"SLOPPINESS", "sloppiness"},
+  {"STATCACHE_SESSION", "stat_cache_session"},
   {"STATS", "stats"},
   {"STATSLOG", "stats_log"},
   {"TEMPDIR", "temporary_dir"},
@@ -619,6 +637,9 @@ Config::get_string_value(const std::string& key) const
   case ConfigItem::absolute_paths_in_stderr:
     return format_bool(m_absolute_paths_in_stderr);
 
+  case ConfigItem::adaptive_compression:
+    return format_bool(m_adaptive_compression);
+
   case ConfigItem::base_dir:
     return m_base_dir;
 
@@ -631,6 +652,9 @@ Config::get_string_value(const std::string& key) const
   case ConfigItem::compiler_check:
     return m_compiler_check;
 
+  case ConfigItem::compiler_check_cache:
+    return format_bool(m_compiler_check_cache);
+
   case ConfigItem::compiler_type:
     return compiler_type_to_string(m_compiler_type);
 
@@ -640,6 +664,12 @@ Config::get_string_value(const std::string& key) const
   case ConfigItem::compression_level:
     return FMT("{}", m_compression_level);
 
+  case ConfigItem::compression_threads:
+    return FMT("{}", m_compression_threads);
+
+  case ConfigItem::compression_type:
+    return compression::type_to_string(m_compression_type);
+
   case ConfigItem::cpp_extension:
     return m_cpp_extension;
 
@@ -679,6 +709,9 @@ Config::get_string_value(const std::string& key) const
   case ConfigItem::inode_cache:
     return format_bool(m_inode_cache);
 
+  case ConfigItem::inode_cache_max_size:
+    return format_cache_size(m_inode_cache_max_size);
+
   case ConfigItem::keep_comments_cpp:
     return format_bool(m_keep_comments_cpp);
 
@@ -730,6 +763,9 @@ Config::get_string_value(const std::string& key) const
   case ConfigItem::sloppiness:
     return format_sloppiness(m_sloppiness);
 
+  case ConfigItem::stat_cache_session:
+    return m_stat_cache_session;
+
   case ConfigItem::stats:
     return format_bool(m_stats);
 
@@ -830,6 +866,10 @@ Config::set_item(const std::string& key,
     m_absolute_paths_in_stderr = parse_bool(value, env_var_key, negate);
     break;
 
+  case ConfigItem::adaptive_compression:
+    m_adaptive_compression = parse_bool(value, env_var_key, negate);
+    break;
+
   case ConfigItem::base_dir:
     m_base_dir = Util::expand_environment_variables(value);
     if (!m_base_dir.empty()) { // The empty string means "disable"
@@ -850,6 +890,10 @@ Config::set_item(const std::string& key,
     m_compiler_check = value;
     break;
 
+  case ConfigItem::compiler_check_cache:
+    m_compiler_check_cache = parse_bool(value, env_var_key, negate);
+    break;
+
   case ConfigItem::compiler_type:
     m_compiler_type = parse_compiler_type(value);
     break;
@@ -863,6 +907,19 @@ Config::set_item(const std::string& key,
       util::parse_signed(value, INT8_MIN, INT8_MAX, "compression_level"));
     break;
 
+  case ConfigItem::compression_threads:
+    m_compression_threads = util::value_or_throw<core::Error>(
+      util::parse_unsigned(value, 1, 256, "compression_threads"));
+    break;
+
+  case ConfigItem::compression_type:
+    m_compression_type = compression::type_from_string(value);
+    if (!compression::is_supported(m_compression_type)) {
+      throw core::Error(
+        "compression type {} is not supported by this ccache build", value);
+    }
+    break;
+
   case ConfigItem::cpp_extension:
     m_cpp_extension = value;
     break;
@@ -915,6 +972,10 @@ Config::set_item(const std::string& key,
     m_inode_cache = parse_bool(value, env_var_key, negate);
     break;
 
+  case ConfigItem::inode_cache_max_size:
+    m_inode_cache_max_size = Util::parse_size(value);
+    break;
+
   case ConfigItem::keep_comments_cpp:
     m_keep_comments_cpp = parse_bool(value, env_var_key, negate);
     break;
@@ -985,6 +1046,10 @@ Config::set_item(const std::string& key,
     m_sloppiness = parse_sloppiness(value);
     break;
 
+  case ConfigItem::stat_cache_session:
+    m_stat_cache_session = Util::expand_environment_variables(value);
+    break;
+
   case ConfigItem::stats:
     m_stats = parse_bool(value, env_var_key, negate);
     break;
@@ -21,6 +21,7 @@
 #include "NonCopyable.hpp"
 #include "Util.hpp"
 
+#include <compression/types.hpp>
 #include <core/Sloppiness.hpp>
 
 #include "third_party/nonstd/optional.hpp"
@@ -43,13 +44,17 @@ public:
   void read();
 
   bool absolute_paths_in_stderr() const;
+  bool adaptive_compression() const;
   const std::string& base_dir() const;
   const std::string& cache_dir() const;
   const std::string& compiler() const;
   const std::string& compiler_check() const;
+  bool compiler_check_cache() const;
   CompilerType compiler_type() const;
   bool compression() const;
   int8_t compression_level() const;
+  uint32_t compression_threads() const;
+  compression::Type compression_type() const;
   const std::string& cpp_extension() const;
   bool debug() const;
   const std::string& debug_dir() const;
@@ -63,6 +68,7 @@ public:
   const std::string& ignore_headers_in_manifest() const;
   const std::string& ignore_options() const;
   bool inode_cache() const;
+  uint64_t inode_cache_max_size() const;
   bool keep_comments_cpp() const;
   double limit_multiple() const;
   const std::string& log_file() const;
@@ -79,6 +85,7 @@ public:
   bool run_second_cpp() const;
   const std::string& secondary_storage() const;
   core::Sloppiness sloppiness() const;
+  const std::string& stat_cache_session() const;
   bool stats() const;
   const std::string& stats_log() const;
   const std::string& namespace_() const;
@@ -103,9 +110,11 @@ public:
   void set_hard_link(bool value);
   void set_ignore_options(const std::string& value);
   void set_inode_cache(bool value);
+  void set_inode_cache_max_size(uint64_t value);
   void set_max_files(uint64_t value);
   void set_max_size(uint64_t value);
   void set_run_second_cpp(bool value);
+  void set_stat_cache_session(const std::string& value);
 
   // Where to write configuration changes.
   const std::string& primary_config_path() const;
@@ -147,13 +156,17 @@ private:
   std::string m_secondary_config_path;
 
   bool m_absolute_paths_in_stderr = false;
+  bool m_adaptive_compression = false;
   std::string m_base_dir;
   std::string m_cache_dir;
   std::string m_compiler;
   std::string m_compiler_check = "mtime";
+  bool m_compiler_check_cache = false;
   CompilerType m_compiler_type = CompilerType::auto_guess;
   bool m_compression = true;
   int8_t m_compression_level = 0; // Use default level
+  uint32_t m_compression_threads = 1;
+  compression::Type m_compression_type = compression::Type::zstd;
   std::string m_cpp_extension;
   bool m_debug = false;
   std::string m_debug_dir;
@@ -167,6 +180,7 @@ private:
   std::string m_ignore_headers_in_manifest;
   std::string m_ignore_options;
   bool m_inode_cache = false;
+  uint64_t m_inode_cache_max_size = 64ULL * 1000 * 1000;
   bool m_keep_comments_cpp = false;
   double m_limit_multiple = 0.8;
   std::string m_log_file;
@@ -183,6 +197,7 @@ private:
   bool m_run_second_cpp = true;
   std::string m_secondary_storage;
   core::Sloppiness m_sloppiness;
+  std::string m_stat_cache_session;
   bool m_stats = true;
   std::string m_stats_log;
   std::string m_namespace;
@@ -208,6 +223,12 @@ Config::absolute_paths_in_stderr() const
   return m_absolute_paths_in_stderr;
 }
 
+inline bool
+Config::adaptive_compression() const
+{
+  return m_adaptive_compression;
+}
+
 inline const std::string&
 Config::base_dir() const
 {
@@ -232,6 +253,12 @@ Config::compiler_check() const
   return m_compiler_check;
 }
 
+inline bool
+Config::compiler_check_cache() const
+{
+  return m_compiler_check_cache;
+}
+
 inline CompilerType
 Config::compiler_type() const
 {
@@ -264,6 +291,18 @@ Config::compression_level() const
   return m_compression_level;
 }
 
+inline uint32_t
+Config::compression_threads() const
+{
+  return m_compression_threads;
+}
+
+inline compression::Type
+Config::compression_type() const
+{
+  return m_compression_type;
+}
+
 inline const std::string&
 Config::cpp_extension() const
 {
@@ -342,6 +381,12 @@ Config::inode_cache() const
   return m_inode_cache;
 }
 
+inline uint64_t
+Config::inode_cache_max_size() const
+{
+  return m_inode_cache_max_size;
+}
+
 inline bool
 Config::keep_comments_cpp() const
 {
@@ -438,6 +483,12 @@ Config::sloppiness() const
   return m_sloppiness;
 }
 
+inline const std::string&
+Config::stat_cache_session() const
+{
+  return m_stat_cache_session;
+}
+
 inline bool
 Config::stats() const
 {
@@ -543,6 +594,12 @@ Config::set_inode_cache(bool value)
   m_inode_cache = value;
 }
 
+inline void
+Config::set_inode_cache_max_size(uint64_t value)
+{
+  m_inode_cache_max_size = value;
+}
+
 inline void
 Config::set_max_files(uint64_t value)
 {
@@ -560,3 +617,9 @@ Config::set_run_second_cpp(bool value)
 {
   m_run_second_cpp = value;
 }
+
+inline void
+Config::set_stat_cache_session(const std::string& value)
+{
+  m_stat_cache_session = value;
+}
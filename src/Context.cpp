@@ -23,6 +23,7 @@
 #include "Util.hpp"
 #include "hashutil.hpp"
 
+#include <compression/types.hpp>
 #include <core/wincompat.hpp>
 #include <util/path.hpp>
 
@@ -42,7 +43,8 @@ Context::Context()
     storage(config)
 #ifdef INODE_CACHE_SUPPORTED
     ,
-    inode_cache(config)
+    inode_cache(config),
+    stat_cache(config, actual_cwd)
 #endif
 {
 }
@@ -52,6 +54,7 @@ Context::initialize()
 {
   config.read();
   Logging::init(config);
+  compression::init(config);
 
   ignore_header_paths =
     util::split_path_list(config.ignore_headers_in_manifest());
@@ -28,8 +28,10 @@
 
 #ifdef INODE_CACHE_SUPPORTED
 #  include "InodeCache.hpp"
+#  include "StatCache.hpp"
 #endif
 
+#include <core/Manifest.hpp>
 #include <storage/Storage.hpp>
 
 #include "third_party/nonstd/optional.hpp"
@@ -71,6 +73,10 @@ public:
   // Files included by the preprocessor and their hashes.
   std::unordered_map<std::string, Digest> included_files;
 
+  // Manifest in which the direct mode lookup didn't find a result, if the
+  // manifest file could be read. A new result is added relative to it.
+  nonstd::optional<core::Manifest> manifest;
+
   // Uses absolute path for some include files.
   bool has_absolute_include_headers = false;
 
@@ -92,6 +98,10 @@ public:
 #ifdef INODE_CACHE_SUPPORTED
   // InodeCache that caches source file hashes when enabled.
   mutable InodeCache inode_cache;
+
+  // StatCache that caches stat and realpath results during a build session when
+  // enabled.
+  mutable StatCache stat_cache;
 #endif
 
   // PID of currently executing compiler that we have started, if any. 0 means
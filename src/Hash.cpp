@@ -32,10 +32,55 @@
 #  include <unistd.h>
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <system_error>
+#include <thread>
+
 using nonstd::string_view;
 
 const string_view HASH_DELIMITER("\000cCaChE\000", 8);
 
+namespace {
+
+// Files at least this large are hashed on several threads, this much at a
+// time.
+const size_t k_parallel_hash_size = 8 * 1024 * 1024;
+
+const unsigned k_max_hash_threads = 8;
+
+// Hashes the two halves of a BLAKE3 subtree, the right one on a new thread if
+// the number of available threads pointed to by `context` allows it.
+void
+join_subtree_tasks(void* context,
+                   blake3_subtree_task* left,
+                   blake3_subtree_task* right)
+{
+  auto& available_threads = *static_cast<std::atomic<int>*>(context);
+  if (available_threads.fetch_sub(1) > 0) {
+    std::thread thread;
+    try {
+      thread = std::thread([&] {
+        blake3_subtree_task_run(right);
+        ++available_threads;
+      });
+    } catch (const std::system_error&) {
+      // Fall back to hashing both halves on this thread.
+    }
+    if (thread.joinable()) {
+      blake3_subtree_task_run(left);
+      thread.join();
+      return;
+    }
+  }
+  ++available_threads;
+  blake3_subtree_task_run(left);
+  blake3_subtree_task_run(right);
+}
+
+} // namespace
+
 Hash::Hash()
 {
   blake3_hasher_init(&m_hasher);
@@ -115,6 +160,12 @@ Hash::hash(int64_t x)
 bool
 Hash::hash_fd(int fd)
 {
+  struct stat st;
+  const off_t offset = lseek(fd, 0, SEEK_CUR);
+  if (offset >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+      && st.st_size - offset >= off_t(k_parallel_hash_size)) {
+    return hash_large_file(fd);
+  }
   return Util::read_fd(
     fd, [this](const void* data, size_t size) { hash(data, size); });
 }
@@ -132,10 +183,53 @@ Hash::hash_file(const std::string& path)
   return ret;
 }
 
+bool
+Hash::hash_large_file(int fd)
+{
+  // The file is read instead of mapped into memory since reading a mapped file
+  // that is truncated concurrently raises SIGBUS.
+  std::unique_ptr<char[]> buffer(new char[k_parallel_hash_size]);
+  size_t size;
+  do {
+    size = 0;
+    while (size < k_parallel_hash_size) {
+      const auto n =
+        read(fd, buffer.get() + size, k_parallel_hash_size - size);
+      if (n == 0) {
+        break;
+      }
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      size += n;
+    }
+    const string_view data(buffer.get(), size);
+    hash_buffer(data, true);
+    add_debug_text(data);
+  } while (size == k_parallel_hash_size);
+  add_debug_text("\n");
+  return true;
+}
+
 void
-Hash::hash_buffer(string_view buffer)
+Hash::hash_buffer(string_view buffer, bool parallel)
 {
-  blake3_hasher_update(&m_hasher, buffer.data(), buffer.size());
+  if (parallel) {
+    std::atomic<int> available_threads(
+      std::min(std::max(std::thread::hardware_concurrency(), 1U),
+               k_max_hash_threads)
+      - 1);
+    blake3_hasher_update_parallel(&m_hasher,
+                                  buffer.data(),
+                                  buffer.size(),
+                                  join_subtree_tasks,
+                                  &available_threads);
+  } else {
+    blake3_hasher_update(&m_hasher, buffer.data(), buffer.size());
+  }
   if (!buffer.empty() && m_debug_binary) {
     (void)fwrite(buffer.data(), 1, buffer.size(), m_debug_binary);
   }
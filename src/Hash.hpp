@@ -82,6 +82,9 @@ public:
 
   // Add contents read from an open file descriptor to the hash.
   //
+  // Large regular files are hashed on several threads, which gives the same
+  // digest as hashing them sequentially.
+  //
   // If hash debugging is enabled, the data is written verbatim to the text
   // input file.
   //
@@ -101,6 +104,7 @@ private:
   FILE* m_debug_binary = nullptr;
   FILE* m_debug_text = nullptr;
 
-  void hash_buffer(nonstd::string_view buffer);
+  bool hash_large_file(int fd);
+  void hash_buffer(nonstd::string_view buffer, bool parallel = false);
   void add_debug_text(nonstd::string_view text);
 };
@@ -20,21 +20,22 @@
 
 #include "Config.hpp"
 #include "Digest.hpp"
-#include "Fd.hpp"
-#include "Finalizer.hpp"
 #include "Hash.hpp"
 #include "Logging.hpp"
+#include "SharedMemoryFile.hpp"
 #include "Stat.hpp"
-#include "TemporaryFile.hpp"
 #include "Util.hpp"
 #include "fmtmacros.hpp"
 
-#include <fcntl.h>
 #include <libgen.h>
-#include <sys/mman.h>
+#include <signal.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <limits>
+#include <thread>
 #include <type_traits>
 
 // The inode cache resides on a file that is mapped into shared memory by
@@ -43,11 +44,18 @@
 // that are sorted in LRU order. Entries map from keys representing files to
 // cached hash results.
 //
-// Concurrent access is guarded by a mutex in each bucket.
+// Concurrent access is guarded by a sequence lock in each bucket. Writers
+// acquire the lock by atomically making the sequence number odd and release it
+// by making it even again. Readers don't take the lock at all: they copy the
+// entries and retry if the sequence number was odd or changed meanwhile. A
+// writer that finds a bucket locked by a process that no longer exists breaks
+// the lock and wipes the bucket.
 //
-// Current cache size is fixed and the given constants are considered large
-// enough for most projects. The size could be made configurable if there is a
-// demand for it.
+// The cache starts small and grows online: when entries have been evicted from
+// the average bucket, a process creates a new file with twice as many buckets
+// (up to inode_cache_max_size), copies the entries over and renames it into
+// place. The old region is then flagged as superseded so that other processes
+// map the new file on their next access.
 
 namespace {
 
@@ -57,13 +65,23 @@ namespace {
 // Note: The key is hashed using the main hash algorithm, so the version number
 // does not need to be incremented if said algorithm is changed (except if the
 // digest size changes since that affects the entry format).
-const uint32_t k_version = 1;
+const uint32_t k_version = 3;
 
 // Note: Increment the version number if constants affecting storage size are
 // changed.
-const uint32_t k_num_buckets = 32 * 1024;
 const uint32_t k_num_entries = 4;
 
+// Number of buckets in a newly created cache.
+const uint32_t k_initial_num_buckets = 1024;
+
+// Number of optimistic reads to try before locking the bucket instead.
+const uint32_t k_max_read_attempts = 64;
+
+// Minimum time that a bucket must have been locked by a process that doesn't
+// exist before the lock is broken. The PID check alone is not enough since
+// processes in another PID namespace may share the cache file.
+const auto k_stale_lock_timeout = std::chrono::seconds(1);
+
 static_assert(Digest::size() == 20,
               "Increment version number if size of digest is changed.");
 static_assert(std::is_trivially_copyable<Digest>::value,
@@ -82,6 +100,38 @@ static_assert(
   static_cast<int>(InodeCache::ContentType::precompiled_header) == 3,
   "Numeric value is part of key, increment version number if changed.");
 
+// A bucket lock word holds the sequence number in the upper 32 bits and the PID
+// of the process holding the lock in the lower 32 bits.
+uint64_t
+make_lock_word(const uint32_t sequence, const uint32_t pid)
+{
+  return (uint64_t{sequence} << 32) | pid;
+}
+
+uint32_t
+lock_sequence(const uint64_t lock_word)
+{
+  return static_cast<uint32_t>(lock_word >> 32);
+}
+
+pid_t
+lock_owner(const uint64_t lock_word)
+{
+  return static_cast<pid_t>(lock_word & 0xffffffff);
+}
+
+bool
+is_locked(const uint64_t lock_word)
+{
+  return lock_sequence(lock_word) % 2 != 0;
+}
+
+bool
+process_exists(const pid_t pid)
+{
+  return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
 } // namespace
 
 struct InodeCache::Key
@@ -106,69 +156,81 @@ struct InodeCache::Key
 
 struct InodeCache::Entry
 {
-  Digest key_digest;  // Hashed key
+  Digest key_digest;  // Hashed key, all zeros for an unused entry
   Digest file_digest; // Cached file hash
   int return_value;   // Cached return value
+
+  bool is_used() const;
 };
 
 struct InodeCache::Bucket
 {
-  pthread_mutex_t mt;
+  std::atomic<uint64_t> lock; // Sequence number and PID, see make_lock_word
   Entry entries[k_num_entries];
 };
 
+// Header of the mapped file, followed by `num_buckets` buckets.
 struct InodeCache::SharedRegion
 {
   uint32_t version;
+  uint32_t num_buckets;
+  // Set when the region has been replaced by a larger one in a new file.
+  std::atomic<uint32_t> superseded;
+  // Set while a process creates a larger region to replace this one.
+  std::atomic<uint32_t> growing;
   std::atomic<int64_t> hits;
   std::atomic<int64_t> misses;
   std::atomic<int64_t> errors;
-  Bucket buckets[k_num_buckets];
+  std::atomic<int64_t> collisions;
+  std::atomic<int64_t> evictions;
+  // Evictions since this region was created, used to decide when to grow.
+  std::atomic<int64_t> region_evictions;
+
+  static size_t size(uint32_t num_buckets);
+  Bucket* buckets();
 };
 
 bool
-InodeCache::mmap_file(const std::string& inode_cache_file)
+InodeCache::Entry::is_used() const
+{
+  const auto bytes = key_digest.bytes();
+  return std::any_of(
+    bytes, bytes + Digest::size(), [](uint8_t b) { return b != 0; });
+}
+
+size_t
+InodeCache::SharedRegion::size(const uint32_t num_buckets)
+{
+  return sizeof(SharedRegion) + size_t{num_buckets} * sizeof(Bucket);
+}
+
+InodeCache::Bucket*
+InodeCache::SharedRegion::buckets()
+{
+  static_assert(sizeof(SharedRegion) % alignof(Bucket) == 0,
+                "Buckets following the header must be aligned.");
+  return reinterpret_cast<Bucket*>(this + 1);
+}
+
+void
+InodeCache::unmap()
 {
   if (m_sr) {
-    munmap(m_sr, sizeof(SharedRegion));
+    SharedMemoryFile::unmap(m_sr, m_sr_size);
     m_sr = nullptr;
+    m_sr_size = 0;
   }
-  Fd fd(open(inode_cache_file.c_str(), O_RDWR));
-  if (!fd) {
-    LOG("Failed to open inode cache {}: {}", inode_cache_file, strerror(errno));
-    return false;
-  }
-  bool is_nfs;
-  if (Util::is_nfs_fd(*fd, &is_nfs) == 0 && is_nfs) {
-    LOG(
-      "Inode cache not supported because the cache file is located on nfs: {}",
-      inode_cache_file);
-    return false;
-  }
-  SharedRegion* sr = reinterpret_cast<SharedRegion*>(mmap(
-    nullptr, sizeof(SharedRegion), PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0));
-  fd.close();
-  if (sr == reinterpret_cast<void*>(-1)) {
-    LOG("Failed to mmap {}: {}", inode_cache_file, strerror(errno));
-    return false;
-  }
-  // Drop the file from disk if the found version is not matching. This will
-  // allow a new file to be generated.
+}
+
+bool
+InodeCache::is_valid_region(const void* data, const size_t size)
+{
+  const auto sr = static_cast<const SharedRegion*>(data);
   if (sr->version != k_version) {
-    LOG(
-      "Dropping inode cache because found version {} does not match expected"
-      " version {}",
-      sr->version,
-      k_version);
-    munmap(sr, sizeof(SharedRegion));
-    unlink(inode_cache_file.c_str());
+    LOG("Found inode cache version {} instead of {}", sr->version, k_version);
     return false;
   }
-  m_sr = sr;
-  if (m_config.debug()) {
-    LOG("inode cache file loaded: {}", inode_cache_file);
-  }
-  return true;
+  return sr->num_buckets != 0 && SharedRegion::size(sr->num_buckets) == size;
 }
 
 bool
@@ -206,113 +268,194 @@ InodeCache::hash_inode(const std::string& path,
   return true;
 }
 
-bool
-InodeCache::with_bucket(const Digest& key_digest,
-                        const BucketHandler& bucket_handler)
+uint32_t
+InodeCache::bucket_index(const Digest& key_digest) const
 {
   uint32_t hash;
   Util::big_endian_to_int(key_digest.bytes(), hash);
-  const uint32_t index = hash % k_num_buckets;
-  Bucket* bucket = &m_sr->buckets[index];
-  int err = pthread_mutex_lock(&bucket->mt);
-#ifdef HAVE_PTHREAD_MUTEX_ROBUST
-  if (err == EOWNERDEAD) {
-    if (m_config.debug()) {
-      ++m_sr->errors;
+  return hash % m_sr->num_buckets;
+}
+
+bool
+InodeCache::read_bucket(const Digest& key_digest, Entry* entries)
+{
+  const uint32_t index = bucket_index(key_digest);
+  const Bucket* bucket = &m_sr->buckets()[index];
+  for (uint32_t i = 0; i < k_max_read_attempts; ++i) {
+    const uint64_t before = bucket->lock.load(std::memory_order_acquire);
+    if (is_locked(before)) {
+      std::this_thread::yield();
+      continue;
     }
-    err = pthread_mutex_consistent(&bucket->mt);
-    if (err) {
-      LOG(
-        "Can't consolidate stale mutex at index {}: {}", index, strerror(err));
-      LOG_RAW("Consider removing the inode cache file if the problem persists");
-      return false;
+    memcpy(entries, bucket->entries, sizeof(Bucket::entries));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t after = bucket->lock.load(std::memory_order_relaxed);
+    if (lock_sequence(after) == lock_sequence(before)) {
+      return true;
     }
-    LOG("Wiping bucket at index {} because of stale mutex", index);
-    memset(bucket->entries, 0, sizeof(Bucket::entries));
-  } else {
-#endif
-    if (err != 0) {
-      LOG("Failed to lock mutex at index {}: {}", index, strerror(err));
-      LOG_RAW("Consider removing the inode cache file if problem persists");
-      ++m_sr->errors;
-      return false;
+  }
+
+  // Writers keep getting in the way (or one has died while holding the lock),
+  // so wait for the lock instead.
+  return with_bucket_at(index, [&](const Bucket* locked_bucket) {
+    memcpy(entries, locked_bucket->entries, sizeof(Bucket::entries));
+  });
+}
+
+bool
+InodeCache::with_bucket(const Digest& key_digest,
+                        const BucketHandler& bucket_handler)
+{
+  return with_bucket_at(bucket_index(key_digest), bucket_handler);
+}
+
+bool
+InodeCache::with_bucket_at(const uint32_t index,
+                           const BucketHandler& bucket_handler)
+{
+  Bucket* bucket = &m_sr->buckets()[index];
+  const auto pid = static_cast<uint32_t>(getpid());
+
+  uint64_t lock_word = bucket->lock.load(std::memory_order_relaxed);
+  uint64_t waited_for_lock_word = 0;
+  auto waiting_since = std::chrono::steady_clock::now();
+  while (true) {
+    if (!is_locked(lock_word)) {
+      if (bucket->lock.compare_exchange_weak(
+            lock_word,
+            make_lock_word(lock_sequence(lock_word) + 1, pid),
+            std::memory_order_acquire,
+            std::memory_order_relaxed)) {
+        break;
+      }
+      continue;
     }
-#ifdef HAVE_PTHREAD_MUTEX_ROBUST
+
+    const auto now = std::chrono::steady_clock::now();
+    if (lock_word != waited_for_lock_word) {
+      waited_for_lock_word = lock_word;
+      waiting_since = now;
+    } else if (now - waiting_since > k_stale_lock_timeout
+               && !process_exists(lock_owner(lock_word))) {
+      // Take over the lock by skipping to the next odd sequence number.
+      if (bucket->lock.compare_exchange_strong(
+            lock_word,
+            make_lock_word(lock_sequence(lock_word) + 2, pid),
+            std::memory_order_acquire,
+            std::memory_order_relaxed)) {
+        ++m_sr->errors;
+        LOG("Wiping bucket at index {} because of stale lock", index);
+        memset(bucket->entries, 0, sizeof(Bucket::entries));
+        break;
+      }
+      continue;
+    }
+    std::this_thread::yield();
+    lock_word = bucket->lock.load(std::memory_order_relaxed);
   }
-#endif
+
+  // Make sure that readers see the locked sequence number before any of the
+  // modified entries.
+  std::atomic_thread_fence(std::memory_order_release);
+  const auto unlock = [&] {
+    const uint32_t sequence =
+      lock_sequence(bucket->lock.load(std::memory_order_relaxed));
+    bucket->lock.store(make_lock_word(sequence + 1, 0),
+                       std::memory_order_release);
+  };
 
   try {
     bucket_handler(bucket);
   } catch (...) {
-    pthread_mutex_unlock(&bucket->mt);
+    unlock();
     throw;
   }
-  pthread_mutex_unlock(&bucket->mt);
+  unlock();
   return true;
 }
 
-bool
-InodeCache::create_new_file(const std::string& filename)
+void
+InodeCache::initialize_region(void* data, const uint32_t num_buckets)
 {
-  LOG_RAW("Creating a new inode cache");
-
-  // Create the new file to a temporary name to prevent other processes from
-  // mapping it before it is fully initialized.
-  TemporaryFile tmp_file(filename);
+  LOG("Creating a new inode cache with {} buckets", num_buckets);
 
-  Finalizer temp_file_remover([&] { unlink(tmp_file.path.c_str()); });
+  auto sr = static_cast<SharedRegion*>(data);
+  sr->version = k_version;
+  sr->num_buckets = num_buckets;
+  // Bucket locks start out unlocked since the file is zero-filled.
 
-  bool is_nfs;
-  if (Util::is_nfs_fd(*tmp_file.fd, &is_nfs) == 0 && is_nfs) {
-    LOG(
-      "Inode cache not supported because the cache file would be located on"
-      " nfs: {}",
-      filename);
-    return false;
-  }
-  int err = Util::fallocate(*tmp_file.fd, sizeof(SharedRegion));
-  if (err) {
-    LOG("Failed to allocate file space for inode cache: {}", strerror(err));
-    return false;
-  }
-  SharedRegion* sr =
-    reinterpret_cast<SharedRegion*>(mmap(nullptr,
-                                         sizeof(SharedRegion),
-                                         PROT_READ | PROT_WRITE,
-                                         MAP_SHARED,
-                                         *tmp_file.fd,
-                                         0));
-  if (sr == reinterpret_cast<void*>(-1)) {
-    LOG("Failed to mmap new inode cache: {}", strerror(errno));
-    return false;
+  if (m_sr) {
+    // Carry over counters and entries from the region being replaced. Entries
+    // are inserted from least to most recently used to keep the LRU order.
+    sr->hits = m_sr->hits.load();
+    sr->misses = m_sr->misses.load();
+    sr->errors = m_sr->errors.load();
+    sr->collisions = m_sr->collisions.load();
+    sr->evictions = m_sr->evictions.load();
+    for (uint32_t i = 0; i < m_sr->num_buckets; ++i) {
+      with_bucket_at(i, [&](const Bucket* old_bucket) {
+        for (uint32_t j = k_num_entries; j > 0; --j) {
+          const Entry& entry = old_bucket->entries[j - 1];
+          if (!entry.is_used()) {
+            continue;
+          }
+          uint32_t hash;
+          Util::big_endian_to_int(entry.key_digest.bytes(), hash);
+          Bucket& bucket = sr->buckets()[hash % num_buckets];
+          memmove(&bucket.entries[1],
+                  &bucket.entries[0],
+                  sizeof(Entry) * (k_num_entries - 1));
+          bucket.entries[0] = entry;
+        }
+      });
+    }
   }
+}
 
-  // Initialize new shared region.
-  sr->version = k_version;
-  pthread_mutexattr_t mattr;
-  pthread_mutexattr_init(&mattr);
-  pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
-#ifdef HAVE_PTHREAD_MUTEX_ROBUST
-  pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
-#endif
-  for (auto& bucket : sr->buckets) {
-    pthread_mutex_init(&bucket.mt, &mattr);
-  }
+uint32_t
+InodeCache::max_num_buckets() const
+{
+  const uint64_t max_size = m_config.inode_cache_max_size();
+  const uint64_t num_buckets =
+    max_size > sizeof(SharedRegion)
+      ? (max_size - sizeof(SharedRegion)) / sizeof(Bucket)
+      : 0;
+  return std::max<uint64_t>(
+    1,
+    std::min<uint64_t>(num_buckets, std::numeric_limits<uint32_t>::max()));
+}
 
-  munmap(sr, sizeof(SharedRegion));
-  tmp_file.fd.close();
+void
+InodeCache::maybe_grow()
+{
+  const uint32_t num_buckets = m_sr->num_buckets;
+  const uint32_t max_buckets = max_num_buckets();
+  if (num_buckets >= max_buckets
+      || m_sr->region_evictions.load() <= num_buckets) {
+    return;
+  }
 
-  // link() will fail silently if a file with the same name already exists.
-  // This will be the case if two processes try to create a new file
-  // simultaneously. Thus close the current file handle and reopen a new one,
-  // which will make us use the first created file even if we didn't win the
-  // race.
-  if (link(tmp_file.path.c_str(), filename.c_str()) != 0) {
-    LOG("Failed to link new inode cache: {}", strerror(errno));
-    return false;
+  // Only one process grows the cache. If it dies before finishing, the region
+  // won't grow until the cache file is removed, which is harmless.
+  uint32_t expected = 0;
+  if (!m_sr->growing.compare_exchange_strong(expected, 1)) {
+    return;
   }
 
-  return true;
+  const uint32_t new_num_buckets =
+    std::min<uint64_t>(uint64_t{num_buckets} * 2, max_buckets);
+  if (!SharedMemoryFile::create(
+        get_file(),
+        "inode cache",
+        SharedRegion::size(new_num_buckets),
+        [&](void* data) { initialize_region(data, new_num_buckets); },
+        true)) {
+    m_sr->growing = 0;
+    return;
+  }
+  m_sr->superseded = 1;
+  LOG("Grew inode cache from {} to {} buckets", num_buckets, new_num_buckets);
+  initialize();
 }
 
 bool
@@ -322,28 +465,35 @@ InodeCache::initialize()
     return false;
   }
 
-  if (m_sr) {
+  if (m_sr && !m_sr->superseded.load()) {
     return true;
   }
 
-  std::string filename = get_file();
-  if (m_sr || mmap_file(filename)) {
-    return true;
+  unmap();
+  const std::string filename = get_file();
+  const uint32_t num_buckets =
+    std::min(k_initial_num_buckets, max_num_buckets());
+  struct stat st;
+  void* data = SharedMemoryFile::map_or_create(
+    filename,
+    "inode cache",
+    sizeof(SharedRegion),
+    is_valid_region,
+    SharedRegion::size(num_buckets),
+    [&](void* new_data) { initialize_region(new_data, num_buckets); },
+    st);
+  if (!data) {
+    m_failed = true;
+    return false;
   }
-
-  // Try to create a new cache if we failed to map an existing file.
-  create_new_file(filename);
-
-  // Concurrent processes could try to create new files simultaneously and the
-  // file that actually landed on disk will be from the process that won the
-  // race. Thus we try to open the file from disk instead of reusing the file
-  // handle to the file we just created.
-  if (mmap_file(filename)) {
-    return true;
+  m_sr = static_cast<SharedRegion*>(data);
+  m_sr_size = st.st_size;
+  if (m_config.debug()) {
+    LOG("inode cache file loaded: {} ({} buckets)",
+        filename,
+        m_sr->num_buckets);
   }
-
-  m_failed = true;
-  return false;
+  return true;
 }
 
 InodeCache::InodeCache(const Config& config) : m_config(config)
@@ -352,9 +502,7 @@ InodeCache::InodeCache(const Config& config) : m_config(config)
 
 InodeCache::~InodeCache()
 {
-  if (m_sr) {
-    munmap(m_sr, sizeof(SharedRegion));
-  }
+  unmap();
 }
 
 bool
@@ -372,41 +520,54 @@ InodeCache::get(const std::string& path,
     return false;
   }
 
-  bool found = false;
-  const bool success = with_bucket(key_digest, [&](const auto bucket) {
-    for (uint32_t i = 0; i < k_num_entries; ++i) {
-      if (bucket->entries[i].key_digest == key_digest) {
-        if (i > 0) {
+  Entry entries[k_num_entries];
+  if (!read_bucket(key_digest, entries)) {
+    return false;
+  }
+
+  uint32_t index = 0;
+  while (index < k_num_entries && entries[index].key_digest != key_digest) {
+    ++index;
+  }
+  const bool found = index < k_num_entries;
+  if (found) {
+    file_digest = entries[index].file_digest;
+    if (return_value) {
+      *return_value = entries[index].return_value;
+    }
+  }
+
+  // Moving the entry first to keep the LRU order requires the lock, so only do
+  // it when the entry isn't first already.
+  if (found && index > 0) {
+    with_bucket(key_digest, [&](const auto bucket) {
+      for (uint32_t i = 1; i < k_num_entries; ++i) {
+        if (bucket->entries[i].key_digest == key_digest) {
           Entry tmp = bucket->entries[i];
           memmove(&bucket->entries[1], &bucket->entries[0], sizeof(Entry) * i);
           bucket->entries[0] = tmp;
+          break;
         }
-
-        file_digest = bucket->entries[0].file_digest;
-        if (return_value) {
-          *return_value = bucket->entries[0].return_value;
-        }
-        found = true;
-        break;
       }
-    }
-  });
-  if (!success) {
-    return false;
+    });
   }
 
   LOG("inode cache {}: {}", found ? "hit" : "miss", path);
 
+  if (found) {
+    ++m_sr->hits;
+  } else {
+    ++m_sr->misses;
+  }
   if (m_config.debug()) {
-    if (found) {
-      ++m_sr->hits;
-    } else {
-      ++m_sr->misses;
-    }
-    LOG("Accumulated stats for inode cache: hits={}, misses={}, errors={}",
-        m_sr->hits.load(),
-        m_sr->misses.load(),
-        m_sr->errors.load());
+    LOG(
+      "Accumulated stats for inode cache: hits={}, misses={}, errors={},"
+      " collisions={}, evictions={}",
+      m_sr->hits.load(),
+      m_sr->misses.load(),
+      m_sr->errors.load(),
+      m_sr->collisions.load(),
+      m_sr->evictions.load());
   }
   return found;
 }
@@ -426,10 +587,25 @@ InodeCache::put(const std::string& path,
     return false;
   }
 
+  bool collision = false;
+  bool eviction = false;
   const bool success = with_bucket(key_digest, [&](const auto bucket) {
-    memmove(&bucket->entries[1],
-            &bucket->entries[0],
-            sizeof(Entry) * (k_num_entries - 1));
+    // Replace an existing entry for the key, otherwise the least recently used
+    // entry.
+    uint32_t i = 0;
+    while (i < k_num_entries - 1
+           && bucket->entries[i].key_digest != key_digest) {
+      ++i;
+    }
+    for (uint32_t j = 0; j < k_num_entries; ++j) {
+      collision = collision
+                  || (bucket->entries[j].is_used()
+                      && bucket->entries[j].key_digest != key_digest);
+    }
+    eviction = bucket->entries[i].is_used()
+               && bucket->entries[i].key_digest != key_digest;
+
+    memmove(&bucket->entries[1], &bucket->entries[0], sizeof(Entry) * i);
 
     bucket->entries[0].key_digest = key_digest;
     bucket->entries[0].file_digest = file_digest;
@@ -442,6 +618,15 @@ InodeCache::put(const std::string& path,
 
   LOG("inode cache insert: {}", path);
 
+  if (collision) {
+    ++m_sr->collisions;
+  }
+  if (eviction) {
+    ++m_sr->evictions;
+    ++m_sr->region_evictions;
+    maybe_grow();
+  }
+
   return true;
 }
 
@@ -452,10 +637,7 @@ InodeCache::drop()
   if (unlink(file.c_str()) != 0) {
     return false;
   }
-  if (m_sr) {
-    munmap(m_sr, sizeof(SharedRegion));
-    m_sr = nullptr;
-  }
+  unmap();
   return true;
 }
 
@@ -482,3 +664,21 @@ InodeCache::get_errors()
 {
   return initialize() ? m_sr->errors.load() : -1;
 }
+
+int64_t
+InodeCache::get_collisions()
+{
+  return initialize() ? m_sr->collisions.load() : -1;
+}
+
+int64_t
+InodeCache::get_evictions()
+{
+  return initialize() ? m_sr->evictions.load() : -1;
+}
+
+int64_t
+InodeCache::get_capacity()
+{
+  return initialize() ? int64_t{m_sr->num_buckets} * k_num_entries : -1;
+}
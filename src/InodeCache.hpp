@@ -70,23 +70,27 @@ public:
   std::string get_file();
 
   // Returns total number of cache hits.
-  //
-  // Counters are incremented in debug mode only.
   int64_t get_hits();
 
   // Returns total number of cache misses.
-  //
-  // Counters are incremented in debug mode only.
   int64_t get_misses();
 
   // Returns total number of errors.
   //
-  // Currently only lock errors will be counted, since the counter is not
-  // accessible before the file has been successfully mapped into memory.
-  //
-  // Counters are incremented in debug mode only.
+  // Currently only broken stale bucket locks will be counted, since the counter
+  // is not accessible before the file has been successfully mapped into memory.
   int64_t get_errors();
 
+  // Returns total number of insertions into a bucket that already held entries
+  // for other files.
+  int64_t get_collisions();
+
+  // Returns total number of entries evicted to make room for new entries.
+  int64_t get_evictions();
+
+  // Returns the number of entries that the cache currently can hold.
+  int64_t get_capacity();
+
 private:
   struct Bucket;
   struct Entry;
@@ -94,15 +98,22 @@ private:
   struct SharedRegion;
   using BucketHandler = std::function<void(Bucket* bucket)>;
 
-  bool mmap_file(const std::string& inode_cache_file);
+  static bool is_valid_region(const void* data, size_t size);
+  void initialize_region(void* data, uint32_t num_buckets);
+  void unmap();
   static bool
   hash_inode(const std::string& path, ContentType type, Digest& digest);
+  uint32_t bucket_index(const Digest& key_digest) const;
+  bool read_bucket(const Digest& key_digest, Entry* entries);
   bool with_bucket(const Digest& key_digest,
                    const BucketHandler& bucket_handler);
-  static bool create_new_file(const std::string& filename);
+  bool with_bucket_at(uint32_t index, const BucketHandler& bucket_handler);
+  void maybe_grow();
+  uint32_t max_num_buckets() const;
   bool initialize();
 
   const Config& m_config;
   struct SharedRegion* m_sr = nullptr;
+  size_t m_sr_size = 0;
   bool m_failed = false;
 };
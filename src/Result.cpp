@@ -34,6 +34,7 @@
 #include <core/FileReader.hpp>
 #include <core/FileWriter.hpp>
 #include <core/Statistic.hpp>
+#include <core/StringWriter.hpp>
 #include <core/exceptions.hpp>
 #include <core/wincompat.hpp>
 #include <util/path.hpp>
@@ -53,21 +54,28 @@
 //
 // Integers are big-endian.
 //
-// <payload>              ::= <format_ver> <n_entries> <entry>*
+// <payload>              ::= <format_ver> <n_entries> <entry_header>*
+//                            <entry_data>*
 // <format_ver>           ::= uint8_t
 // <n_entries>            ::= uint8_t
-// <entry>                ::= <embedded_file_entry> | <raw_file_entry>
-// <embedded_file_entry>  ::= <embedded_file_marker> <suffix_len> <suffix>
-//                            <data_len> <data>
+// <entry_header>         ::= <embedded_file_header> | <raw_file_header>
+// <embedded_file_header> ::= <embedded_file_marker> <embedded_file_type>
+//                            <data_len>
 // <embedded_file_marker> ::= 0 (uint8_t)
 // <embedded_file_type>   ::= uint8_t
 // <data_len>             ::= uint64_t
-// <data>                 ::= data_len bytes
-// <raw_file_entry>       ::= <raw_file_marker> <suffix_len> <suffix> <file_len>
+// <raw_file_header>      ::= <raw_file_marker> <embedded_file_type> <file_len>
 // <raw_file_marker>      ::= 1 (uint8_t)
 // <file_len>             ::= uint64_t
-// <epilogue>             ::= <checksum>
-// <checksum>             ::= uint64_t ; XXH3 of content bytes
+// <entry_data>           ::= data_len bytes ; for each embedded file, in order
+//
+// The entry headers form a directory of the result so that a reader can skip
+// data of entries it's not interested in. The directory and the data of each
+// embedded file are written as separate cache entry frames (see
+// core/CacheEntryHeader.hpp) so that skipping doesn't require decompression.
+//
+// In result format version 0, each entry header was directly followed by its
+// data.
 
 using nonstd::nullopt;
 using nonstd::optional;
@@ -75,7 +83,7 @@ using nonstd::string_view;
 
 namespace {
 
-const uint8_t k_result_format_version = 0;
+const uint8_t k_result_format_version = 1;
 
 // File data stored inside the result file.
 const uint8_t k_embedded_file_marker = 0;
@@ -91,30 +99,145 @@ get_raw_file_path(string_view result_path, uint32_t entry_number)
   return FMT("{}{}W", prefix, entry_number);
 }
 
+// Minimum size of non-object files to store as raw files. Smaller files are
+// cheaper to embed than to spend an i-node on.
+const uint64_t k_min_raw_file_size = 64 * 1024;
+
 bool
-should_store_raw_file(const Config& config, Result::FileType type)
+should_store_raw_file(const Config& config,
+                      const Result::FileType type,
+                      const uint64_t file_size)
 {
   if (!config.file_clone() && !config.hard_link()) {
     return false;
   }
 
-  // Only store object files as raw files since there are several problems with
-  // storing other file types:
-  //
-  // 1. The compiler unlinks object files before writing to them but it doesn't
-  //    unlink .d files, so just it's possible to corrupt .d files just by
-  //    running the compiler (see ccache issue 599).
-  // 2. .d files cause trouble for automake if hard-linked (see ccache issue
-  //    378).
-  // 3. It's unknown how the compiler treats other file types, so better safe
-  //    than sorry.
-  //
-  // It would be possible to store all files in raw form for the file_clone case
-  // and only hard link object files. However, most likely it's only object
-  // files that become large enough that it's of interest to clone or hard link
-  // them, so we keep things simple for now. This will also save i-nodes in the
-  // cache.
-  return type == Result::FileType::object;
+  switch (type) {
+  case Result::FileType::object:
+    return true;
+
+  case Result::FileType::dwarf_object:
+    // Like object files, .dwo files are unlinked before running the compiler,
+    // so it's safe to hard link them.
+    return file_size >= k_min_raw_file_size;
+
+  case Result::FileType::coverage_unmangled:
+  case Result::FileType::coverage_mangled:
+  case Result::FileType::stackusage:
+  case Result::FileType::diagnostic:
+    // It's unknown whether the compiler unlinks these files before writing to
+    // them, so only store them as raw files if they can't end up hard-linked.
+    return config.file_clone() && !config.hard_link()
+           && file_size >= k_min_raw_file_size;
+
+  case Result::FileType::dependency:
+    // 1. The compiler unlinks object files before writing to them but it
+    //    doesn't unlink .d files, so it's possible to corrupt .d files just
+    //    by running the compiler (see ccache issue 599).
+    // 2. .d files cause trouble for automake if hard-linked (see ccache issue
+    //    378).
+    // 3. The dependency target may be rewritten when retrieving the file.
+  case Result::FileType::stdout_output:
+  case Result::FileType::stderr_output:
+    return false;
+  }
+
+  return false;
+}
+
+void
+write_embedded_file_entry(core::CacheEntryWriter& writer,
+                          const std::string& path,
+                          const uint64_t file_size)
+{
+  Fd file(open(path.c_str(), O_RDONLY | O_BINARY));
+  if (!file) {
+    throw core::Error("Failed to open {} for reading", path);
+  }
+
+  uint64_t remain = file_size;
+  while (remain > 0) {
+    uint8_t buf[CCACHE_READ_BUFFER_SIZE];
+    size_t n = std::min(remain, static_cast<uint64_t>(sizeof(buf)));
+    auto bytes_read = read(*file, buf, n);
+    if (bytes_read == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw core::Error("Error reading from {}: {}", path, strerror(errno));
+    }
+    if (bytes_read == 0) {
+      throw core::Error("Error reading from {}: end of file", path);
+    }
+    writer.write(buf, bytes_read);
+    remain -= bytes_read;
+  }
+}
+
+// Collects the entries of a result so that they can be written again, e.g.
+// with raw files converted to embedded files.
+class EntryCollector : public Result::Reader::Consumer
+{
+public:
+  struct Entry
+  {
+    Result::FileType file_type;
+    uint64_t file_len;
+    optional<std::string> raw_file;
+    std::string data;
+  };
+
+  void on_entry_start(uint32_t entry_number,
+                      Result::FileType file_type,
+                      uint64_t file_len,
+                      optional<std::string> raw_file) override;
+  void on_entry_data(const uint8_t* data, size_t size) override;
+  void on_entry_end() override;
+
+  const std::vector<Entry>& entries() const;
+  bool has_raw_files() const;
+
+private:
+  std::vector<Entry> m_entries;
+  bool m_has_raw_files = false;
+};
+
+void
+EntryCollector::on_entry_start(uint32_t /*entry_number*/,
+                               const Result::FileType file_type,
+                               const uint64_t file_len,
+                               optional<std::string> raw_file)
+{
+  if (raw_file) {
+    m_has_raw_files = true;
+  }
+  m_entries.push_back(Entry{file_type, file_len, std::move(raw_file), {}});
+  if (!m_entries.back().raw_file) {
+    m_entries.back().data.reserve(file_len);
+  }
+}
+
+void
+EntryCollector::on_entry_data(const uint8_t* const data, const size_t size)
+{
+  m_entries.back().data.append(reinterpret_cast<const char*>(data), size);
+}
+
+void
+EntryCollector::on_entry_end()
+{
+}
+
+const std::vector<EntryCollector::Entry>&
+EntryCollector::entries() const
+{
+  return m_entries;
+}
+
+bool
+EntryCollector::has_raw_files() const
+{
+  return m_has_raw_files;
 }
 
 } // namespace
@@ -180,6 +303,64 @@ gcno_file_in_unmangled_form(const Context& ctx)
   return Util::change_extension(ctx.args_info.output_obj, ".gcno");
 }
 
+std::string
+serialize_with_embedded_files(const std::string& result_path)
+{
+  File file(result_path, "rb");
+  if (!file) {
+    throw core::Error(
+      "Failed to open {} for reading: {}", result_path, strerror(errno));
+  }
+  core::FileReader file_reader(*file);
+  core::CacheEntryReader cache_entry_reader(file_reader);
+  Reader result_reader(cache_entry_reader, result_path);
+  EntryCollector collector;
+  result_reader.read(collector);
+
+  auto header = cache_entry_reader.header();
+  if (!collector.has_raw_files() && header.compression_dictionary_id == 0) {
+    return Util::read_file(result_path);
+  }
+
+  uint64_t payload_size = 0;
+  payload_size += 1; // format_ver
+  payload_size += 1; // n_entries
+  for (const auto& entry : collector.entries()) {
+    payload_size += 1;              // embedded_file_marker
+    payload_size += 1;              // embedded_file_type
+    payload_size += 8;              // file_len
+    payload_size += entry.file_len; // data
+  }
+  header.entry_format_version = core::k_entry_format_version;
+  header.set_entry_size_from_payload_size(payload_size);
+
+  std::string result;
+  core::StringWriter string_writer(result);
+  core::CacheEntryWriter writer(string_writer, header, false);
+
+  writer.write_int(k_result_format_version);
+  writer.write_int<uint8_t>(collector.entries().size());
+
+  for (const auto& entry : collector.entries()) {
+    writer.write_int<uint8_t>(k_embedded_file_marker);
+    writer.write_int(UnderlyingFileTypeInt(entry.file_type));
+    writer.write_int(entry.file_len);
+  }
+  writer.end_frame();
+
+  for (const auto& entry : collector.entries()) {
+    if (entry.raw_file) {
+      write_embedded_file_entry(writer, *entry.raw_file, entry.file_len);
+    } else {
+      writer.write(entry.data.data(), entry.data.size());
+    }
+    writer.end_frame();
+  }
+
+  writer.finalize();
+  return result;
+}
+
 FileSizeAndCountDiff&
 FileSizeAndCountDiff::operator+=(const FileSizeAndCountDiff& other)
 {
@@ -195,6 +376,25 @@ Result::Reader::Reader(core::CacheEntryReader& cache_entry_reader,
 {
 }
 
+bool
+Reader::Consumer::wants_entry_data() const
+{
+  return true;
+}
+
+bool
+Reader::Consumer::wants_entry_reader() const
+{
+  return false;
+}
+
+void
+Reader::Consumer::on_entry_reader(std::unique_ptr<core::Reader> /*reader*/)
+{
+  // Consumers that override wants_entry_reader must override this as well.
+  ASSERT(false);
+}
+
 void
 Reader::read(Consumer& consumer)
 {
@@ -203,28 +403,34 @@ Reader::read(Consumer& consumer)
                       to_string(m_reader.header().entry_type));
   }
 
-  const auto result_format_version = m_reader.read_int<uint8_t>();
-  if (result_format_version != k_result_format_version) {
+  m_result_format_version = m_reader.read_int<uint8_t>();
+  if (m_result_format_version > k_result_format_version) {
     throw core::Error("Unknown result format version: {}",
-                      result_format_version);
+                      m_result_format_version);
   }
 
   const auto n_entries = m_reader.read_int<uint8_t>();
 
-  uint32_t i;
-  for (i = 0; i < n_entries; ++i) {
-    read_entry(i, consumer);
-  }
-
-  if (i != n_entries) {
-    throw core::Error("Too few entries (read {}, expected {})", i, n_entries);
+  if (m_result_format_version == 0) {
+    for (uint32_t i = 0; i < n_entries; ++i) {
+      read_entry(i, read_entry_header(), consumer);
+    }
+  } else {
+    std::vector<EntryHeader> entry_headers;
+    entry_headers.reserve(n_entries);
+    for (uint32_t i = 0; i < n_entries; ++i) {
+      entry_headers.push_back(read_entry_header());
+    }
+    for (uint32_t i = 0; i < n_entries; ++i) {
+      read_entry(i, entry_headers[i], consumer);
+    }
   }
 
   m_reader.finalize();
 }
 
-void
-Reader::read_entry(uint32_t entry_number, Reader::Consumer& consumer)
+Reader::EntryHeader
+Reader::read_entry_header()
 {
   const auto marker = m_reader.read_int<uint8_t>();
 
@@ -238,22 +444,41 @@ Reader::read_entry(uint32_t entry_number, Reader::Consumer& consumer)
   }
 
   const auto type = m_reader.read_int<UnderlyingFileTypeInt>();
-  const auto file_type = FileType(type);
   const auto file_len = m_reader.read_int<uint64_t>();
+  return EntryHeader{marker, FileType(type), file_len};
+}
+
+void
+Reader::read_entry(uint32_t entry_number,
+                   const EntryHeader& entry_header,
+                   Reader::Consumer& consumer)
+{
+  const auto file_type = entry_header.file_type;
+  const auto file_len = entry_header.file_len;
 
-  if (marker == k_embedded_file_marker) {
+  if (entry_header.marker == k_embedded_file_marker) {
     consumer.on_entry_start(entry_number, file_type, file_len, nullopt);
 
-    uint8_t buf[CCACHE_READ_BUFFER_SIZE];
-    size_t remain = file_len;
-    while (remain > 0) {
-      size_t n = std::min(remain, sizeof(buf));
-      m_reader.read(buf, n);
-      consumer.on_entry_data(buf, n);
-      remain -= n;
+    // From result format version 1, the data of each embedded file is stored
+    // in frames of its own and can therefore be detached from the result.
+    std::unique_ptr<core::Reader> entry_reader;
+    if (!consumer.wants_entry_data()) {
+      m_reader.skip(file_len);
+    } else if (m_result_format_version >= 1 && consumer.wants_entry_reader()
+               && (entry_reader = m_reader.detach_payload(file_len))) {
+      consumer.on_entry_reader(std::move(entry_reader));
+    } else {
+      uint8_t buf[CCACHE_READ_BUFFER_SIZE];
+      size_t remain = file_len;
+      while (remain > 0) {
+        size_t n = std::min(remain, sizeof(buf));
+        m_reader.read(buf, n);
+        consumer.on_entry_data(buf, n);
+        remain -= n;
+      }
     }
   } else {
-    ASSERT(marker == k_raw_file_marker);
+    ASSERT(entry_header.marker == k_raw_file_marker);
 
     std::string raw_path;
     if (m_result_path != "-") {
@@ -283,13 +508,22 @@ Writer::Writer(Context& ctx, const std::string& result_path)
 void
 Writer::write_data(const FileType file_type, const std::string& data)
 {
-  m_entries_to_write.push_back(Entry{file_type, ValueType::data, data});
+  m_entries_to_write.push_back(Entry{file_type, ValueType::data, data, {}});
 }
 
 void
 Writer::write_file(const FileType file_type, const std::string& path)
 {
-  m_entries_to_write.push_back(Entry{file_type, ValueType::path, path});
+  m_entries_to_write.push_back(Entry{file_type, ValueType::path, path, {}});
+}
+
+void
+Writer::write_tmp_file(const FileType file_type,
+                       const std::string& tmp_path,
+                       const std::string& dest_path)
+{
+  m_entries_to_write.push_back(
+    Entry{file_type, ValueType::tmp_path, tmp_path, dest_path});
 }
 
 nonstd::expected<FileSizeAndCountDiff, std::string>
@@ -306,26 +540,38 @@ FileSizeAndCountDiff
 Writer::do_finalize()
 {
   FileSizeAndCountDiff file_size_and_count_diff{0, 0};
+  std::vector<uint64_t> entry_sizes;
+  std::vector<bool> store_raw_entries;
   uint64_t payload_size = 0;
   payload_size += 1; // format_ver
   payload_size += 1; // n_entries
   for (const auto& entry : m_entries_to_write) {
-    payload_size += 1; // embedded_file_marker
-    payload_size += 1; // embedded_file_type
-    payload_size += 8; // data_len
-    payload_size +=    // data
+    const uint64_t entry_size =
       entry.value_type == ValueType::data
         ? entry.value.size()
         : Stat::stat(entry.value, Stat::OnError::throw_error).size();
+    const bool store_raw =
+      entry.value_type != ValueType::data
+      && should_store_raw_file(m_ctx.config, entry.file_type, entry_size);
+    entry_sizes.push_back(entry_size);
+    store_raw_entries.push_back(store_raw);
+
+    payload_size += 1; // embedded_file_marker/raw_file_marker
+    payload_size += 1; // embedded_file_type
+    payload_size += 8; // data_len/file_len
+    if (!store_raw) {
+      payload_size += entry_size; // data
+    }
   }
 
   AtomicFile atomic_result_file(m_result_path, AtomicFile::Mode::binary);
-  core::CacheEntryHeader header(core::CacheEntryType::result,
-                                compression::type_from_config(m_ctx.config),
-                                compression::level_from_config(m_ctx.config),
-                                time(nullptr),
-                                CCACHE_VERSION,
-                                m_ctx.config.namespace_());
+  core::CacheEntryHeader header(
+    core::CacheEntryType::result,
+    compression::type_from_config(m_ctx.config),
+    compression::level_for_entry(m_ctx.config, payload_size),
+    time(nullptr),
+    CCACHE_VERSION,
+    m_ctx.config.namespace_());
   header.set_entry_size_from_payload_size(payload_size);
 
   core::FileWriter file_writer(atomic_result_file.stream());
@@ -336,13 +582,8 @@ Writer::do_finalize()
 
   uint32_t entry_number = 0;
   for (const auto& entry : m_entries_to_write) {
-    const bool store_raw =
-      entry.value_type == ValueType::path
-      && should_store_raw_file(m_ctx.config, entry.file_type);
-    const uint64_t entry_size =
-      entry.value_type == ValueType::data
-        ? entry.value.size()
-        : Stat::stat(entry.value, Stat::OnError::throw_error).size();
+    const bool store_raw = store_raw_entries[entry_number];
+    const uint64_t entry_size = entry_sizes[entry_number];
 
     LOG("Storing {} entry #{} {} ({} bytes){}",
         store_raw ? "raw" : "embedded",
@@ -358,16 +599,26 @@ Writer::do_finalize()
     writer.write_int(entry_size);
 
     if (store_raw) {
-      file_size_and_count_diff +=
-        write_raw_file_entry(entry.value, entry_number);
-    } else if (entry.value_type == ValueType::data) {
-      writer.write(entry.value.data(), entry.value.size());
-    } else {
-      write_embedded_file_entry(writer, entry.value, entry_size);
+      file_size_and_count_diff += write_raw_file_entry(entry, entry_number);
     }
 
     ++entry_number;
   }
+  writer.end_frame();
+
+  entry_number = 0;
+  for (const auto& entry : m_entries_to_write) {
+    if (!store_raw_entries[entry_number]) {
+      if (entry.value_type == ValueType::data) {
+        writer.write(entry.value.data(), entry.value.size());
+      } else {
+        write_embedded_file_entry(
+          writer, entry.value, entry_sizes[entry_number]);
+      }
+      writer.end_frame();
+    }
+    ++entry_number;
+  }
 
   writer.finalize();
   atomic_result_file.commit();
@@ -375,43 +626,31 @@ Writer::do_finalize()
   return file_size_and_count_diff;
 }
 
-void
-Result::Writer::write_embedded_file_entry(core::CacheEntryWriter& writer,
-                                          const std::string& path,
-                                          const uint64_t file_size)
-{
-  Fd file(open(path.c_str(), O_RDONLY | O_BINARY));
-  if (!file) {
-    throw core::Error("Failed to open {} for reading", path);
-  }
-
-  uint64_t remain = file_size;
-  while (remain > 0) {
-    uint8_t buf[CCACHE_READ_BUFFER_SIZE];
-    size_t n = std::min(remain, static_cast<uint64_t>(sizeof(buf)));
-    auto bytes_read = read(*file, buf, n);
-    if (bytes_read == -1) {
-      if (errno == EINTR) {
-        continue;
-      }
-      throw core::Error("Error reading from {}: {}", path, strerror(errno));
-    }
-    if (bytes_read == 0) {
-      throw core::Error("Error reading from {}: end of file", path);
-    }
-    writer.write(buf, bytes_read);
-    remain -= bytes_read;
-  }
-}
-
 FileSizeAndCountDiff
-Result::Writer::write_raw_file_entry(const std::string& path,
+Result::Writer::write_raw_file_entry(const Entry& entry,
                                      uint32_t entry_number)
 {
+  const auto& path = entry.value;
   const auto raw_file = get_raw_file_path(m_result_path, entry_number);
   const auto old_stat = Stat::stat(raw_file);
   try {
-    Util::clone_hard_link_or_copy_file(m_ctx, path, raw_file, true);
+    bool moved = false;
+    if (entry.value_type == ValueType::tmp_path) {
+      try {
+        LOG("Moving {} to {}", path, raw_file);
+        Util::rename(path, raw_file);
+        moved = true;
+      } catch (const core::Error& e) {
+        // Most likely the temporary directory is on another file system.
+        LOG("Failed to move: {}", e.what());
+      }
+    }
+    if (moved) {
+      Util::clone_hard_link_or_copy_file(
+        m_ctx, raw_file, entry.dest_path, false);
+    } else {
+      Util::clone_hard_link_or_copy_file(m_ctx, path, raw_file, true);
+    }
   } catch (core::Error& e) {
     throw core::Error(
       "Failed to store {} as raw file {}: {}", path, raw_file, e.what());
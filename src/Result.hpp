@@ -25,6 +25,7 @@
 
 #include <cstdint>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -89,6 +90,13 @@ const char* file_type_to_string(FileType type);
 std::string gcno_file_in_mangled_form(const Context& ctx);
 std::string gcno_file_in_unmangled_form(const Context& ctx);
 
+// Return the content of the result entry `result_path` in a self-contained
+// form, i.e. with raw file entries converted into embedded file entries and not
+// compressed with a compression dictionary. Raw files and dictionaries only
+// exist in primary storage, so this is the form that must be used when sending
+// the entry to secondary storage. Throws core::Error on error.
+std::string serialize_with_embedded_files(const std::string& result_path);
+
 struct FileSizeAndCountDiff
 {
   int64_t size_kibibyte;
@@ -115,16 +123,41 @@ public:
                                 nonstd::optional<std::string> raw_file) = 0;
     virtual void on_entry_data(const uint8_t* data, size_t size) = 0;
     virtual void on_entry_end() = 0;
+
+    // Called after `on_entry_start` for embedded file entries. Return false to
+    // skip the data of the entry, i.e. to not get any `on_entry_data` calls.
+    virtual bool wants_entry_data() const;
+
+    // Called after `wants_entry_data` for embedded file entries whose data can
+    // be read independently of the rest of the result. Return true to get the
+    // data via `on_entry_reader` instead of `on_entry_data` calls.
+    virtual bool wants_entry_reader() const;
+
+    // Called if `wants_entry_reader` returned true. `reader` provides the
+    // `file_len` bytes of entry data and may be used on another thread, also
+    // after `on_entry_end` has been called.
+    virtual void on_entry_reader(std::unique_ptr<core::Reader> reader);
   };
 
   // Throws core::Error on error.
   void read(Consumer& consumer);
 
 private:
+  struct EntryHeader
+  {
+    uint8_t marker;
+    FileType file_type;
+    uint64_t file_len;
+  };
+
   core::CacheEntryReader& m_reader;
   const std::string m_result_path;
+  uint8_t m_result_format_version = 0;
 
-  void read_entry(uint32_t entry_number, Reader::Consumer& consumer);
+  EntryHeader read_entry_header();
+  void read_entry(uint32_t entry_number,
+                  const EntryHeader& entry_header,
+                  Reader::Consumer& consumer);
 };
 
 // This class knows how to write a result cache entry.
@@ -140,16 +173,25 @@ public:
   // not throw.
   void write_file(FileType file_type, const std::string& path);
 
+  // Register a temporary file whose content should be included in the result
+  // and which should end up at `dest_path`. If the file is stored as a raw
+  // file, it's moved into the cache and `dest_path` is created from the raw
+  // file, otherwise the file is left as is. Does not throw.
+  void write_tmp_file(FileType file_type,
+                      const std::string& tmp_path,
+                      const std::string& dest_path);
+
   // Write registered entries to the result. Returns an error message on error.
   nonstd::expected<FileSizeAndCountDiff, std::string> finalize();
 
 private:
-  enum class ValueType { data, path };
+  enum class ValueType { data, path, tmp_path };
   struct Entry
   {
     FileType file_type;
     ValueType value_type;
     std::string value;
+    std::string dest_path; // Only used for ValueType::tmp_path.
   };
 
   Context& m_ctx;
@@ -157,10 +199,7 @@ private:
   std::vector<Entry> m_entries_to_write;
 
   FileSizeAndCountDiff do_finalize();
-  static void write_embedded_file_entry(core::CacheEntryWriter& writer,
-                                        const std::string& path,
-                                        uint64_t file_size);
-  FileSizeAndCountDiff write_raw_file_entry(const std::string& path,
+  FileSizeAndCountDiff write_raw_file_entry(const Entry& entry,
                                             uint32_t entry_number);
 };
 
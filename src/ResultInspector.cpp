@@ -51,3 +51,9 @@ void
 ResultInspector::on_entry_end()
 {
 }
+
+bool
+ResultInspector::wants_entry_data() const
+{
+  return false;
+}
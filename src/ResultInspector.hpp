@@ -35,6 +35,7 @@ public:
                       nonstd::optional<std::string> raw_file) override;
   void on_entry_data(const uint8_t* data, size_t size) override;
   void on_entry_end() override;
+  bool wants_entry_data() const override;
 
 private:
   FILE* m_stream;
@@ -21,7 +21,9 @@
 #include "Context.hpp"
 #include "Depfile.hpp"
 #include "Logging.hpp"
+#include "fmtmacros.hpp"
 
+#include <core/Reader.hpp>
 #include <core/exceptions.hpp>
 #include <core/wincompat.hpp>
 
@@ -33,8 +35,23 @@
 #  include <unistd.h>
 #endif
 
+#include <algorithm>
+#include <thread>
+
 using Result::FileType;
 
+namespace {
+
+// Minimum size of files to decompress and write in the background. Smaller
+// files are restored faster than a task is handed over to another thread.
+const uint64_t k_min_background_file_size = 1024 * 1024;
+
+// Maximum number of threads for writing files in the background. A result has
+// at most a few large files, e.g. an object file and a .dwo file.
+const unsigned k_max_background_threads = 4;
+
+} // namespace
+
 ResultRetriever::ResultRetriever(Context& ctx, bool rewrite_dependency_target)
   : m_ctx(ctx),
     m_rewrite_dependency_target(rewrite_dependency_target)
@@ -55,6 +72,7 @@ ResultRetriever::on_entry_start(uint32_t entry_number,
 
   std::string dest_path;
   m_dest_file_type = file_type;
+  m_dest_file_len = file_len;
 
   switch (file_type) {
   case FileType::object:
@@ -120,7 +138,7 @@ ResultRetriever::on_entry_start(uint32_t entry_number,
     Util::clone_hard_link_or_copy_file(m_ctx, *raw_file, dest_path, false);
 
     // Update modification timestamp to save the file from LRU cleanup (and, if
-    // hard-linked, to make the object file newer than the source file).
+    // hard-linked, to make the output file newer than the source file).
     Util::update_mtime(*raw_file);
   } else {
     LOG("Writing to {}", dest_path);
@@ -174,6 +192,72 @@ ResultRetriever::on_entry_end()
   m_dest_data.clear();
 }
 
+bool
+ResultRetriever::wants_entry_data() const
+{
+  // Data of entries without destination would just be thrown away.
+  return m_dest_fd || m_dest_file_type == FileType::stdout_output
+         || m_dest_file_type == FileType::stderr_output;
+}
+
+bool
+ResultRetriever::wants_entry_reader() const
+{
+  // The dependency file is written in on_entry_end.
+  return m_dest_fd && m_dest_file_type != FileType::dependency
+         && m_dest_file_len >= k_min_background_file_size;
+}
+
+void
+ResultRetriever::on_entry_reader(std::unique_ptr<core::Reader> reader)
+{
+  if (!m_thread_pool) {
+    m_thread_pool = std::make_unique<ThreadPool>(
+      std::min(std::max(std::thread::hardware_concurrency(), 1U),
+               k_max_background_threads));
+  }
+
+  LOG("Writing {} in the background", m_dest_path);
+
+  // std::function requires a copyable callable.
+  std::shared_ptr<core::Reader> shared_reader = std::move(reader);
+  auto dest_fd = std::make_shared<Fd>(std::move(m_dest_fd));
+  m_thread_pool->enqueue([this,
+                          shared_reader,
+                          dest_fd,
+                          dest_path = m_dest_path,
+                          file_len = m_dest_file_len] {
+    try {
+      uint8_t buf[CCACHE_READ_BUFFER_SIZE];
+      uint64_t remain = file_len;
+      while (remain > 0) {
+        const size_t n = shared_reader->read(
+          buf, std::min(remain, static_cast<uint64_t>(sizeof(buf))));
+        Util::write_fd(**dest_fd, buf, n);
+        remain -= n;
+      }
+      dest_fd->close();
+    } catch (core::Error& e) {
+      std::lock_guard<std::mutex> lock(m_background_error_mutex);
+      if (m_background_error.empty()) {
+        m_background_error =
+          FMT("Failed to write to {}: {}", dest_path, e.what());
+      }
+    }
+  });
+}
+
+void
+ResultRetriever::finalize()
+{
+  if (m_thread_pool) {
+    m_thread_pool->shut_down();
+  }
+  if (!m_background_error.empty()) {
+    throw core::Error(m_background_error);
+  }
+}
+
 void
 ResultRetriever::write_dependency_file()
 {
@@ -20,6 +20,10 @@
 
 #include "Fd.hpp"
 #include "Result.hpp"
+#include "ThreadPool.hpp"
+
+#include <memory>
+#include <mutex>
 
 class Context;
 
@@ -35,10 +39,18 @@ public:
                       nonstd::optional<std::string> raw_file) override;
   void on_entry_data(const uint8_t* data, size_t size) override;
   void on_entry_end() override;
+  bool wants_entry_data() const override;
+  bool wants_entry_reader() const override;
+  void on_entry_reader(std::unique_ptr<core::Reader> reader) override;
+
+  // Wait for files that are being written in the background. Throws
+  // core::Error if writing any of them failed.
+  void finalize();
 
 private:
   Context& m_ctx;
   Result::FileType m_dest_file_type{};
+  uint64_t m_dest_file_len = 0;
   Fd m_dest_fd;
   std::string m_dest_path;
 
@@ -52,5 +64,13 @@ private:
   // destination object file.
   const bool m_rewrite_dependency_target;
 
+  // First error from writing a file in the background.
+  std::mutex m_background_error_mutex;
+  std::string m_background_error;
+
+  // Threads that decompress and write large files concurrently. Declared last
+  // so that the threads are joined before other members are destroyed.
+  std::unique_ptr<ThreadPool> m_thread_pool;
+
   void write_dependency_file();
 };
@@ -0,0 +1,166 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "SharedMemoryFile.hpp"
+
+#include "Fd.hpp"
+#include "Finalizer.hpp"
+#include "Logging.hpp"
+#include "TemporaryFile.hpp"
+#include "Util.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace SharedMemoryFile {
+
+void*
+map(const std::string& path,
+    nonstd::string_view description,
+    const size_t min_size,
+    const Validator& is_valid,
+    struct stat& st)
+{
+  Fd fd(open(path.c_str(), O_RDWR));
+  if (!fd) {
+    LOG("Failed to open {} {}: {}", description, path, strerror(errno));
+    return nullptr;
+  }
+  bool is_nfs;
+  if (Util::is_nfs_fd(*fd, &is_nfs) == 0 && is_nfs) {
+    LOG("{} not supported because the file is located on nfs: {}",
+        description,
+        path);
+    return nullptr;
+  }
+  if (fstat(*fd, &st) != 0) {
+    LOG("Failed to stat {}: {}", path, strerror(errno));
+    return nullptr;
+  }
+  const size_t file_size = st.st_size;
+  if (file_size < min_size) {
+    LOG("Dropping {} {} because it is truncated", description, path);
+    unlink(path.c_str());
+    return nullptr;
+  }
+  void* data =
+    mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+  fd.close();
+  if (data == MAP_FAILED) {
+    LOG("Failed to mmap {}: {}", path, strerror(errno));
+    return nullptr;
+  }
+  if (!is_valid(data, file_size)) {
+    LOG("Dropping {} {} because its format is unexpected", description, path);
+    munmap(data, file_size);
+    unlink(path.c_str());
+    return nullptr;
+  }
+  return data;
+}
+
+bool
+create(const std::string& path,
+       nonstd::string_view description,
+       const size_t size,
+       const Initializer& initialize,
+       const bool replace_existing)
+{
+  // Create the new file to a temporary name to prevent other processes from
+  // mapping it before it is fully initialized.
+  TemporaryFile tmp_file(path);
+
+  Finalizer temp_file_remover([&] { unlink(tmp_file.path.c_str()); });
+
+  bool is_nfs;
+  if (Util::is_nfs_fd(*tmp_file.fd, &is_nfs) == 0 && is_nfs) {
+    LOG("{} not supported because the file would be located on nfs: {}",
+        description,
+        path);
+    return false;
+  }
+  int err = Util::fallocate(*tmp_file.fd, size);
+  if (err) {
+    LOG("Failed to allocate file space for {}: {}", description, strerror(err));
+    return false;
+  }
+  void* data =
+    mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, *tmp_file.fd, 0);
+  if (data == MAP_FAILED) {
+    LOG("Failed to mmap new {}: {}", description, strerror(errno));
+    return false;
+  }
+
+  initialize(data);
+
+  munmap(data, size);
+  tmp_file.fd.close();
+
+  if (replace_existing) {
+    if (rename(tmp_file.path.c_str(), path.c_str()) != 0) {
+      LOG("Failed to rename new {}: {}", description, strerror(errno));
+      return false;
+    }
+    return true;
+  }
+
+  // link() will fail silently if a file with the same name already exists.
+  // This will be the case if two processes try to create a new file
+  // simultaneously. Thus close the current file handle and reopen a new one,
+  // which will make us use the first created file even if we didn't win the
+  // race.
+  if (link(tmp_file.path.c_str(), path.c_str()) != 0) {
+    LOG("Failed to link new {}: {}", description, strerror(errno));
+    return false;
+  }
+
+  return true;
+}
+
+void*
+map_or_create(const std::string& path,
+              nonstd::string_view description,
+              const size_t min_size,
+              const Validator& is_valid,
+              const size_t size,
+              const Initializer& initialize,
+              struct stat& st)
+{
+  void* data = map(path, description, min_size, is_valid, st);
+  if (data) {
+    return data;
+  }
+
+  // Try to create a new file if we failed to map an existing file.
+  create(path, description, size, initialize, false);
+
+  // Concurrent processes could try to create new files simultaneously and the
+  // file that actually landed on disk will be from the process that won the
+  // race. Thus we try to open the file from disk instead of reusing the file
+  // handle to the file we just created.
+  return map(path, description, min_size, is_valid, st);
+}
+
+void
+unmap(void* data, const size_t size)
+{
+  munmap(data, size);
+}
+
+} // namespace SharedMemoryFile
@@ -0,0 +1,76 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#pragma once
+
+#include "third_party/nonstd/string_view.hpp"
+
+#include <sys/stat.h>
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// Files that are mapped into memory shared by concurrently running processes,
+// like the inode cache and the stat cache. `description` names the file in log
+// messages.
+namespace SharedMemoryFile {
+
+// Returns true if the mapped `data` of `size` bytes has the expected format.
+using Validator = std::function<bool(const void* data, size_t size)>;
+
+// Fills in the zero-filled `data` of a newly created file.
+using Initializer = std::function<void(void* data)>;
+
+// Maps the file at `path` read-write. A file smaller than `min_size` or
+// rejected by `is_valid` is removed so that a new one can be created. Files on
+// NFS are not supported.
+//
+// Returns the mapped data of `st.st_size` bytes on success, where `st` is set
+// to the status of the file, otherwise nullptr.
+void* map(const std::string& path,
+          nonstd::string_view description,
+          size_t min_size,
+          const Validator& is_valid,
+          struct stat& st);
+
+// Creates a file of `size` bytes under a temporary name, initializes it with
+// `initialize` and then moves it to `path`. If `replace_existing` is false, an
+// already existing file at `path` is kept.
+//
+// Returns true on success, otherwise false.
+bool create(const std::string& path,
+            nonstd::string_view description,
+            size_t size,
+            const Initializer& initialize,
+            bool replace_existing);
+
+// Like `map`, but if the file can't be mapped, first creates a new file of
+// `size` bytes like `create` without replacing an existing file.
+void* map_or_create(const std::string& path,
+                    nonstd::string_view description,
+                    size_t min_size,
+                    const Validator& is_valid,
+                    size_t size,
+                    const Initializer& initialize,
+                    struct stat& st);
+
+// Unmaps `size` bytes of `data` returned by `map`.
+void unmap(void* data, size_t size);
+
+} // namespace SharedMemoryFile
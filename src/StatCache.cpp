@@ -0,0 +1,402 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "StatCache.hpp"
+
+#include "Config.hpp"
+#include "Digest.hpp"
+#include "Hash.hpp"
+#include "Logging.hpp"
+#include "SharedMemoryFile.hpp"
+#include "Util.hpp"
+#include "fmtmacros.hpp"
+
+#include <core/exceptions.hpp>
+#include <util/path.hpp>
+#include <util/string.hpp>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <type_traits>
+
+// The stat cache resides on a file that is mapped into shared memory by running
+// processes, one file per build session. It is a hash table of entries keyed by
+// the hashed absolute path. Colliding paths are placed in one of the following
+// few entries; if all of them are taken the first one is replaced.
+//
+// Each entry has a sequence number that is odd while the entry is being
+// written. Readers copy the entry and discard the copy if the sequence number
+// was odd or changed meanwhile. Writers skip updating an entry if another
+// process is writing it. Nobody ever waits, so a process dying while writing
+// an entry just leaves that entry unusable for the rest of the session.
+
+namespace {
+
+// The version number corresponds to the format of the cache entries.
+const uint32_t k_version = 1;
+
+// Note: Increment the version number if constants affecting storage size are
+// changed.
+const uint32_t k_num_entries = 16384;
+const uint32_t k_max_real_path_length = 256;
+
+// Number of entries to consider for a path.
+const uint32_t k_max_probes = 4;
+
+// A session whose file has not been used for this many seconds has ended, so
+// the file is removed when another session starts. Processes update the mtime
+// of the file at most every k_session_mark_interval seconds to show that the
+// session is ongoing.
+const time_t k_max_session_idle_time = 60 * 60;
+const time_t k_session_mark_interval = 5 * 60;
+
+static_assert(std::is_trivially_copyable<Digest>::value,
+              "Digest is expected to be trivially copyable.");
+static_assert(std::is_trivially_copyable<Stat>::value,
+              "Stat is expected to be trivially copyable.");
+
+bool
+is_used(const Digest& key_digest)
+{
+  const auto bytes = key_digest.bytes();
+  return std::any_of(
+    bytes, bytes + Digest::size(), [](uint8_t b) { return b != 0; });
+}
+
+} // namespace
+
+struct StatCache::EntryData
+{
+  Digest key_digest; // Hashed path, all zeros for an unused entry
+  Stat stat;         // Cached stat result
+  char real_path[k_max_real_path_length]; // Cached real path, empty if unknown
+};
+
+struct StatCache::Entry
+{
+  std::atomic<uint32_t> sequence; // Odd while the entry is being written
+  EntryData data;
+
+  bool try_lock();
+  void unlock();
+};
+
+// Header of the mapped file, followed by `num_entries` entries.
+struct StatCache::SharedRegion
+{
+  uint32_t version;
+  uint32_t num_entries;
+  // Files modified at or after this time are not cached.
+  int64_t session_start;
+
+  static size_t size(uint32_t num_entries);
+  Entry* entries();
+};
+
+bool
+StatCache::Entry::try_lock()
+{
+  uint32_t expected = sequence.load(std::memory_order_relaxed);
+  if (expected % 2 != 0
+      || !sequence.compare_exchange_strong(expected,
+                                           expected + 1,
+                                           std::memory_order_acquire,
+                                           std::memory_order_relaxed)) {
+    return false;
+  }
+  // Make sure that readers see the odd sequence number before any of the
+  // modified data.
+  std::atomic_thread_fence(std::memory_order_release);
+  return true;
+}
+
+void
+StatCache::Entry::unlock()
+{
+  sequence.store(sequence.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_release);
+}
+
+size_t
+StatCache::SharedRegion::size(const uint32_t num_entries)
+{
+  return sizeof(SharedRegion) + size_t{num_entries} * sizeof(Entry);
+}
+
+StatCache::Entry*
+StatCache::SharedRegion::entries()
+{
+  static_assert(sizeof(SharedRegion) % alignof(Entry) == 0,
+                "Entries following the header must be aligned.");
+  return reinterpret_cast<Entry*>(this + 1);
+}
+
+void
+StatCache::unmap()
+{
+  if (m_sr) {
+    SharedMemoryFile::unmap(m_sr, SharedRegion::size(m_sr->num_entries));
+    m_sr = nullptr;
+  }
+}
+
+bool
+StatCache::is_valid_region(const void* data, const size_t size)
+{
+  const auto sr = static_cast<const SharedRegion*>(data);
+  return sr->version == k_version && sr->num_entries != 0
+         && SharedRegion::size(sr->num_entries) == size;
+}
+
+void
+StatCache::initialize_region(void* data)
+{
+  LOG("Creating a new stat cache for session {}",
+      m_config.stat_cache_session());
+
+  // Entries start out unused and unlocked since the file is zero-filled.
+  auto sr = static_cast<SharedRegion*>(data);
+  sr->version = k_version;
+  sr->num_entries = k_num_entries;
+  sr->session_start = time(nullptr);
+
+  remove_ended_sessions();
+}
+
+void
+StatCache::remove_ended_sessions()
+{
+  // Each build session normally has its own file, so files of ended sessions
+  // would otherwise pile up in temporary_dir, which typically resides in RAM.
+  const std::string own_file = get_file();
+  const time_t now = time(nullptr);
+  try {
+    Util::traverse(
+      m_config.temporary_dir(), [&](const std::string& path, bool is_dir) {
+        if (is_dir || path == own_file
+            || !util::starts_with(Util::base_name(path), "stat-cache-")) {
+          return;
+        }
+        const auto st = Stat::lstat(path);
+        if (st && st.mtime() + k_max_session_idle_time < now) {
+          LOG("Removing stat cache {} of ended session", path);
+          Util::unlink_tmp(path);
+        }
+      });
+  } catch (const core::Error& e) {
+    LOG("Failed to remove stat caches of ended sessions: {}", e.what());
+  }
+}
+
+Digest
+StatCache::hash_path(const std::string& path) const
+{
+  Hash hash;
+  if (!util::is_absolute_path(path)) {
+    hash.hash(m_cwd);
+    hash.hash_delimiter("cwd");
+  }
+  hash.hash(path);
+  return hash.digest();
+}
+
+bool
+StatCache::look_up(const Digest& key_digest, EntryData& data, uint32_t& index)
+{
+  uint32_t hash;
+  Util::big_endian_to_int(key_digest.bytes(), hash);
+  for (uint32_t i = 0; i < k_max_probes; ++i) {
+    index = (hash + i) % m_sr->num_entries;
+    const Entry& entry = m_sr->entries()[index];
+    const uint32_t before = entry.sequence.load(std::memory_order_acquire);
+    if (before % 2 != 0) {
+      continue;
+    }
+    memcpy(&data, &entry.data, sizeof(EntryData));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint32_t after = entry.sequence.load(std::memory_order_relaxed);
+    if (after == before && data.key_digest == key_digest) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+StatCache::insert_stat(const Digest& key_digest, const Stat& stat)
+{
+  uint32_t hash;
+  Util::big_endian_to_int(key_digest.bytes(), hash);
+
+  // Prefer an unused entry, otherwise replace the first one. The unlocked read
+  // of the key is only a hint.
+  uint32_t index = hash % m_sr->num_entries;
+  for (uint32_t i = 0; i < k_max_probes; ++i) {
+    const uint32_t candidate = (hash + i) % m_sr->num_entries;
+    if (!is_used(m_sr->entries()[candidate].data.key_digest)) {
+      index = candidate;
+      break;
+    }
+  }
+
+  Entry& entry = m_sr->entries()[index];
+  if (!entry.try_lock()) {
+    return;
+  }
+  entry.data.key_digest = key_digest;
+  entry.data.stat = stat;
+  entry.data.real_path[0] = '\0';
+  entry.unlock();
+}
+
+void
+StatCache::insert_real_path(const uint32_t index,
+                            const Digest& key_digest,
+                            const std::string& real_path)
+{
+  if (real_path.length() >= k_max_real_path_length) {
+    return;
+  }
+  Entry& entry = m_sr->entries()[index];
+  if (!entry.try_lock()) {
+    return;
+  }
+  if (entry.data.key_digest == key_digest) {
+    memcpy(entry.data.real_path, real_path.c_str(), real_path.length() + 1);
+  }
+  entry.unlock();
+}
+
+bool
+StatCache::initialize()
+{
+  if (m_failed || !enabled()) {
+    return false;
+  }
+
+  if (m_sr) {
+    return true;
+  }
+
+  const std::string filename = get_file();
+  struct stat st;
+  void* data = SharedMemoryFile::map_or_create(
+    filename,
+    "stat cache",
+    sizeof(SharedRegion),
+    is_valid_region,
+    SharedRegion::size(k_num_entries),
+    [&](void* new_data) { initialize_region(new_data); },
+    st);
+  if (!data) {
+    m_failed = true;
+    return false;
+  }
+  m_sr = static_cast<SharedRegion*>(data);
+
+  // Mark the session as ongoing.
+  if (st.st_mtime + k_session_mark_interval < time(nullptr)) {
+    Util::update_mtime(filename);
+  }
+  return true;
+}
+
+StatCache::StatCache(const Config& config, const std::string& cwd)
+  : m_config(config),
+    m_cwd(cwd)
+{
+}
+
+StatCache::~StatCache()
+{
+  unmap();
+}
+
+bool
+StatCache::enabled() const
+{
+  return !m_config.stat_cache_session().empty();
+}
+
+Stat
+StatCache::stat(const std::string& path, Stat::OnError on_error)
+{
+  if (!initialize()) {
+    return Stat::stat(path, on_error);
+  }
+
+  const Digest key_digest = hash_path(path);
+  EntryData data;
+  uint32_t index;
+  if (look_up(key_digest, data, index)) {
+    return data.stat;
+  }
+
+  auto result = Stat::stat(path, on_error);
+  if (result
+      && std::max(result.mtime(), result.ctime()) < m_sr->session_start) {
+    insert_stat(key_digest, result);
+  }
+  return result;
+}
+
+std::string
+StatCache::real_path(const std::string& path)
+{
+  if (!initialize()) {
+    return Util::real_path(path);
+  }
+
+  const Digest key_digest = hash_path(path);
+  EntryData data;
+  uint32_t index;
+  const bool found = look_up(key_digest, data, index);
+  if (found && data.real_path[0] != '\0') {
+    return data.real_path;
+  }
+
+  auto result = Util::real_path(path);
+  if (found) {
+    // Only paths with a cached stat result are known to be old enough.
+    insert_real_path(index, key_digest, result);
+  }
+  return result;
+}
+
+bool
+StatCache::drop()
+{
+  std::string file = get_file();
+  if (unlink(file.c_str()) != 0) {
+    return false;
+  }
+  unmap();
+  return true;
+}
+
+std::string
+StatCache::get_file()
+{
+  return FMT("{}/stat-cache-{}.v{}",
+             m_config.temporary_dir(),
+             Hash().hash(m_config.stat_cache_session()).digest().to_string(),
+             k_version);
+}
@@ -0,0 +1,81 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#pragma once
+
+#include "Stat.hpp"
+
+#include <cstdint>
+#include <string>
+
+class Config;
+class Digest;
+
+// Cache of stat and realpath results shared by all processes in a build
+// session, identified by the stat_cache_session configuration option.
+//
+// Only results for files that have not been modified since the session started
+// are cached, so files generated by the build are still checked each time.
+// Cached results are never revalidated though, so a file that existed when the
+// session started must not be modified until the session ends.
+class StatCache
+{
+public:
+  StatCache(const Config& config, const std::string& cwd);
+  ~StatCache();
+
+  // Returns true if a build session has been configured.
+  bool enabled() const;
+
+  // Like Stat::stat but returns a cached result if there is one.
+  Stat stat(const std::string& path,
+            Stat::OnError on_error = Stat::OnError::ignore);
+
+  // Like Util::real_path but returns a cached result if there is one.
+  std::string real_path(const std::string& path);
+
+  // Unmaps the current cache and removes the mapped file from disk.
+  //
+  // Returns true on success, false otherwise.
+  bool drop();
+
+  // Returns name of the persistent file.
+  std::string get_file();
+
+private:
+  struct Entry;
+  struct EntryData;
+  struct SharedRegion;
+
+  static bool is_valid_region(const void* data, size_t size);
+  void initialize_region(void* data);
+  void remove_ended_sessions();
+  void unmap();
+  Digest hash_path(const std::string& path) const;
+  bool look_up(const Digest& key_digest, EntryData& data, uint32_t& index);
+  void insert_stat(const Digest& key_digest, const Stat& stat);
+  void insert_real_path(uint32_t index,
+                        const Digest& key_digest,
+                        const std::string& real_path);
+  bool initialize();
+
+  const Config& m_config;
+  const std::string& m_cwd;
+  SharedRegion* m_sr = nullptr;
+  bool m_failed = false;
+};
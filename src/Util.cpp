@@ -207,6 +207,79 @@ rewrite_stderr_to_absolute_paths(string_view text)
   return result;
 }
 
+using StatFunction = std::function<Stat(const std::string& path)>;
+using RealPathFunction = std::function<std::string(const std::string& path)>;
+
+std::string
+do_make_relative_path(const std::string& base_dir,
+                      const std::string& actual_cwd,
+                      const std::string& apparent_cwd,
+                      nonstd::string_view path,
+                      const StatFunction& stat,
+                      const RealPathFunction& real_path_of)
+{
+  if (base_dir.empty() || !util::starts_with(path, base_dir)) {
+    return std::string(path);
+  }
+
+#ifdef _WIN32
+  std::string winpath;
+  if (path.length() >= 3 && path[0] == '/') {
+    if (isalpha(path[1]) && path[2] == '/') {
+      // Transform /c/path... to c:/path...
+      winpath = FMT("{}:/{}", path[1], path.substr(3));
+      path = winpath;
+    } else if (path[2] == ':') {
+      // Transform /c:/path to c:/path
+      winpath = std::string(path.substr(1));
+      path = winpath;
+    }
+  }
+#endif
+
+  // The algorithm for computing relative paths below only works for existing
+  // paths. If the path doesn't exist, find the first ancestor directory that
+  // does exist and assemble the path again afterwards.
+
+  std::vector<std::string> relpath_candidates;
+  const auto original_path = path;
+  Stat path_stat;
+  while (!(path_stat = stat(std::string(path)))) {
+    path = Util::dir_name(path);
+  }
+  const auto path_suffix = std::string(original_path.substr(path.length()));
+  const auto real_path = real_path_of(std::string(path));
+
+  const auto add_relpath_candidates = [&](auto path) {
+    const std::string normalized_path = Util::normalize_absolute_path(path);
+    relpath_candidates.push_back(
+      Util::get_relative_path(actual_cwd, normalized_path));
+    if (apparent_cwd != actual_cwd) {
+      relpath_candidates.emplace_back(
+        Util::get_relative_path(apparent_cwd, normalized_path));
+    }
+  };
+  add_relpath_candidates(path);
+  if (real_path != path) {
+    add_relpath_candidates(real_path);
+  }
+
+  // Find best (i.e. shortest existing) match:
+  std::sort(relpath_candidates.begin(),
+            relpath_candidates.end(),
+            [](const auto& path1, const auto& path2) {
+              return path1.length() < path2.length();
+            });
+  for (const auto& relpath : relpath_candidates) {
+    if (stat(relpath).same_inode_as(path_stat)) {
+      return relpath + path_suffix;
+    }
+  }
+
+  // No match so nothing else to do than to return the unmodified path.
+  return std::string(original_path);
+}
+
 } // namespace
 
 namespace Util {
@@ -805,71 +878,29 @@ make_relative_path(const std::string& base_dir,
                    const std::string& apparent_cwd,
                    nonstd::string_view path)
 {
-  if (base_dir.empty() || !util::starts_with(path, base_dir)) {
-    return std::string(path);
-  }
-
-#ifdef _WIN32
-  std::string winpath;
-  if (path.length() >= 3 && path[0] == '/') {
-    if (isalpha(path[1]) && path[2] == '/') {
-      // Transform /c/path... to c:/path...
-      winpath = FMT("{}:/{}", path[1], path.substr(3));
-      path = winpath;
-    } else if (path[2] == ':') {
-      // Transform /c:/path to c:/path
-      winpath = std::string(path.substr(1));
-      path = winpath;
-    }
-  }
-#endif
-
-  // The algorithm for computing relative paths below only works for existing
-  // paths. If the path doesn't exist, find the first ancestor directory that
-  // does exist and assemble the path again afterwards.
-
-  std::vector<std::string> relpath_candidates;
-  const auto original_path = path;
-  Stat path_stat;
-  while (!(path_stat = Stat::stat(std::string(path)))) {
-    path = Util::dir_name(path);
-  }
-  const auto path_suffix = std::string(original_path.substr(path.length()));
-  const auto real_path = Util::real_path(std::string(path));
-
-  const auto add_relpath_candidates = [&](auto path) {
-    const std::string normalized_path = Util::normalize_absolute_path(path);
-    relpath_candidates.push_back(
-      Util::get_relative_path(actual_cwd, normalized_path));
-    if (apparent_cwd != actual_cwd) {
-      relpath_candidates.emplace_back(
-        Util::get_relative_path(apparent_cwd, normalized_path));
-    }
-  };
-  add_relpath_candidates(path);
-  if (real_path != path) {
-    add_relpath_candidates(real_path);
-  }
-
-  // Find best (i.e. shortest existing) match:
-  std::sort(relpath_candidates.begin(),
-            relpath_candidates.end(),
-            [](const auto& path1, const auto& path2) {
-              return path1.length() < path2.length();
-            });
-  for (const auto& relpath : relpath_candidates) {
-    if (Stat::stat(relpath).same_inode_as(path_stat)) {
-      return relpath + path_suffix;
-    }
-  }
-
-  // No match so nothing else to do than to return the unmodified path.
-  return std::string(original_path);
+  return do_make_relative_path(
+    base_dir,
+    actual_cwd,
+    apparent_cwd,
+    path,
+    [](const std::string& p) { return Stat::stat(p); },
+    [](const std::string& p) { return Util::real_path(p); });
 }
 
 std::string
 make_relative_path(const Context& ctx, string_view path)
 {
+#ifdef INODE_CACHE_SUPPORTED
+  if (ctx.stat_cache.enabled()) {
+    return do_make_relative_path(
+      ctx.config.base_dir(),
+      ctx.actual_cwd,
+      ctx.apparent_cwd,
+      path,
+      [&](const std::string& p) { return ctx.stat_cache.stat(p); },
+      [&](const std::string& p) { return ctx.stat_cache.real_path(p); });
+  }
+#endif
   return make_relative_path(
     ctx.config.base_dir(), ctx.actual_cwd, ctx.apparent_cwd, path);
 }
@@ -1223,6 +1254,24 @@ set_cloexec_flag(int fd)
 #endif
 }
 
+void
+set_timestamps(const std::string& path, const time_t mtime, const time_t atime)
+{
+#ifdef HAVE_UTIMES
+  timeval tv[2];
+  tv[0].tv_sec = atime;
+  tv[0].tv_usec = 0;
+  tv[1].tv_sec = mtime;
+  tv[1].tv_usec = 0;
+  utimes(path.c_str(), tv);
+#else
+  utimbuf buf;
+  buf.actime = atime;
+  buf.modtime = mtime;
+  utime(path.c_str(), &buf);
+#endif
+}
+
 void
 setenv(const std::string& name, const std::string& value)
 {
@@ -327,6 +327,9 @@ void send_to_fd(const Context& ctx, const std::string& text, int fd);
 // Set the FD_CLOEXEC on file descriptor `fd`. This is a NOP on Windows.
 void set_cloexec_flag(int fd);
 
+// Set atime and mtime of `path`.
+void set_timestamps(const std::string& path, time_t mtime, time_t atime);
+
 // Set environment variable `name` to `value`.
 void setenv(const std::string& name, const std::string& value);
 
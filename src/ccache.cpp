@@ -35,6 +35,7 @@
 #include "ResultRetriever.hpp"
 #include "SignalHandler.hpp"
 #include "TemporaryFile.hpp"
+#include "ThreadPool.hpp"
 #include "UmaskScope.hpp"
 #include "Util.hpp"
 #include "Win32Util.hpp"
@@ -75,8 +76,12 @@
 
 #include <algorithm>
 #include <cmath>
+#include <deque>
+#include <functional>
 #include <limits>
 #include <memory>
+#include <thread>
+#include <unordered_set>
 
 #ifndef MYNAME
 #  define MYNAME "ccache"
@@ -95,6 +100,10 @@ using nonstd::string_view;
 // stored in the cache changes in a backwards-incompatible way.
 const char HASH_PREFIX[] = "4";
 
+// Maximum size of a manifest delta file before it's merged into the manifest
+// file.
+const uint64_t k_max_manifest_delta_size = 256 * 1024;
+
 namespace {
 
 // Return nonstd::make_unexpected<Failure> if ccache did not succeed in getting
@@ -269,15 +278,144 @@ include_file_too_new(const Context& ctx,
   return false;
 }
 
+namespace {
+
+// Hashes the content of include files found in the preprocessor output in a
+// thread pool while the scanning of the output continues. The include files
+// are stored in ctx.included_files in the order they were found when calling
+// finish, so the result is the same as when hashing them one by one.
+//
+// Nothing is logged from the worker threads since logging is not thread-safe.
+// Files for which the worker thread fails or finds temporal macros are instead
+// hashed again (and logged) by finish.
+class IncludeFileHasher
+{
+public:
+  explicit IncludeFileHasher(Context& ctx);
+
+  // Returns true if `path` has been added but not yet stored.
+  bool is_pending(const std::string& path) const;
+
+  void add(const std::string& path, const Stat& path_stat);
+
+  // Adds an include file that has already been hashed, to keep the order.
+  void add_hashed(const std::string& path, const Digest& digest);
+
+  // Waits for the worker threads and stores the results. Returns false if an
+  // include file could not be hashed or contains __TIME__, otherwise true.
+  bool finish();
+
+private:
+  struct IncludeFile
+  {
+    std::string path;
+    optional<Digest> digest;
+  };
+
+  Context& m_ctx;
+  // Pointers to elements in a deque stay valid when adding more elements.
+  std::deque<IncludeFile> m_include_files;
+  std::unordered_set<std::string> m_pending_paths;
+  std::unique_ptr<ThreadPool> m_thread_pool;
+};
+
+const unsigned k_max_include_file_hash_threads = 4;
+
+IncludeFileHasher::IncludeFileHasher(Context& ctx) : m_ctx(ctx)
+{
+}
+
+bool
+IncludeFileHasher::is_pending(const std::string& path) const
+{
+  return m_pending_paths.find(path) != m_pending_paths.end();
+}
+
+void
+IncludeFileHasher::add(const std::string& path, const Stat& path_stat)
+{
+  if (!m_thread_pool) {
+    m_thread_pool = std::make_unique<ThreadPool>(
+      std::min(std::max(std::thread::hardware_concurrency(), 1U),
+               k_max_include_file_hash_threads));
+  }
+
+  m_include_files.push_back({path, nullopt});
+  m_pending_paths.insert(path);
+
+  const bool check_temporal_macros =
+    !m_ctx.config.sloppiness().is_enabled(core::Sloppy::time_macros);
+  IncludeFile* include_file = &m_include_files.back();
+  m_thread_pool->enqueue(
+    [include_file, check_temporal_macros, size_hint = path_stat.size()] {
+      std::string data;
+      try {
+        data = Util::read_file(include_file->path, size_hint);
+      } catch (core::Error&) {
+        return;
+      }
+      if (check_temporal_macros
+          && check_for_temporal_macros(data) != HASH_SOURCE_CODE_OK) {
+        return;
+      }
+      // Same as hash_source_code_string when no temporal macros are found.
+      Hash hash;
+      hash.hash(data);
+      include_file->digest = hash.digest();
+    });
+}
+
+void
+IncludeFileHasher::add_hashed(const std::string& path, const Digest& digest)
+{
+  m_include_files.push_back({path, digest});
+  m_pending_paths.insert(path);
+}
+
+bool
+IncludeFileHasher::finish()
+{
+  if (m_thread_pool) {
+    m_thread_pool->shut_down();
+    m_thread_pool.reset();
+  }
+
+  bool success = true;
+  for (auto& include_file : m_include_files) {
+    if (!include_file.digest) {
+      Hash hash;
+      const int result = hash_source_code_file(m_ctx, hash, include_file.path);
+      if (result & HASH_SOURCE_CODE_ERROR
+          || result & HASH_SOURCE_CODE_FOUND_TIME) {
+        // Later include files would not have been hashed at all when hashing
+        // them one by one, so leave them out as well.
+        success = false;
+        break;
+      }
+      include_file.digest = hash.digest();
+    }
+    m_ctx.included_files.emplace(include_file.path, *include_file.digest);
+  }
+
+  m_include_files.clear();
+  m_pending_paths.clear();
+  return success;
+}
+
+} // namespace
+
 // Returns false if the include file was "too new" and therefore should disable
 // the direct mode (or, in the case of a preprocessed header, fall back to just
-// running the real compiler), otherwise true.
+// running the real compiler), otherwise true. If `hasher` is given, the
+// content of non-PCH include files is hashed by it and ctx.included_files is
+// updated when calling its finish method.
 static bool
 do_remember_include_file(Context& ctx,
                          std::string path,
                          Hash& cpp_hash,
                          bool system,
-                         Hash* depend_mode_hash)
+                         Hash* depend_mode_hash,
+                         IncludeFileHasher* hasher)
 {
   if (path.length() >= 2 && path[0] == '<' && path[path.length() - 1] == '>') {
     // Typically <built-in> or <command-line>.
@@ -300,7 +438,8 @@ do_remember_include_file(Context& ctx,
     path.erase(0, 2);
   }
 
-  if (ctx.included_files.find(path) != ctx.included_files.end()) {
+  if (ctx.included_files.find(path) != ctx.included_files.end()
+      || (hasher && hasher->is_pending(path))) {
     // Already known include file.
     return true;
   }
@@ -316,7 +455,11 @@ do_remember_include_file(Context& ctx,
   }
 #endif
 
+#ifdef INODE_CACHE_SUPPORTED
+  auto st = ctx.stat_cache.stat(path, Stat::OnError::log);
+#else
   auto st = Stat::stat(path, Stat::OnError::log);
+#endif
   if (!st) {
     return false;
   }
@@ -381,8 +524,18 @@ do_remember_include_file(Context& ctx,
   }
 
   if (ctx.config.direct_mode()) {
+    if (hasher) {
+      DEBUG_ASSERT(!depend_mode_hash);
+      if (is_pch) {
+        hasher->add_hashed(path, fhash.digest());
+      } else {
+        hasher->add(path, st);
+      }
+      return true;
+    }
+
     if (!is_pch) { // else: the file has already been hashed.
-      int result = hash_source_code_file(ctx, fhash, path);
+      int result = hash_source_code_file(ctx, fhash, path, st.size());
       if (result & HASH_SOURCE_CODE_ERROR
           || result & HASH_SOURCE_CODE_FOUND_TIME) {
         return false;
@@ -410,10 +563,11 @@ remember_include_file(Context& ctx,
                       const std::string& path,
                       Hash& cpp_hash,
                       bool system,
-                      Hash* depend_mode_hash)
+                      Hash* depend_mode_hash,
+                      IncludeFileHasher* hasher = nullptr)
 {
   if (!do_remember_include_file(
-        ctx, path, cpp_hash, system, depend_mode_hash)) {
+        ctx, path, cpp_hash, system, depend_mode_hash, hasher)) {
     if (Util::is_precompiled_header(path)) {
       return RememberIncludeFileResult::cannot_use_pch;
     } else if (ctx.config.direct_mode()) {
@@ -433,30 +587,63 @@ print_included_files(const Context& ctx, FILE* fp)
   }
 }
 
-// This function reads and hashes a file. While doing this, it also does these
-// things:
+// Returns true if the include file path of a potential linemarker starting at
+// `q` is followed by a newline before `end`, i.e. if the part of the output
+// that process_preprocessed_output looks at is complete.
+static bool
+is_complete_linemarker(const char* q, const char* end)
+{
+  while (q < end && *q != '"' && *q != '\n') {
+    q++;
+  }
+  if (q < end && *q == '\n') {
+    return true;
+  }
+  q++;
+  while (q < end && *q != '"') {
+    q++;
+  }
+  return std::find(q, end, '\n') != end;
+}
+
+// This function hashes preprocessed output. While doing this, it also does
+// these things:
 //
 // - Makes include file paths for which the base directory is a prefix relative
 //   when computing the hash sum.
-// - Stores the paths and hashes of included files in ctx.included_files.
-static nonstd::expected<void, Failure>
-process_preprocessed_file(Context& ctx, Hash& hash, const std::string& path)
+// - Passes included files to remember_include_file.
+//
+// If `at_end` is false, more output will follow and only complete lines are
+// processed. Returns the number of bytes that have been processed; the rest
+// should be passed again together with the following output.
+static nonstd::expected<size_t, Failure>
+process_preprocessed_output(Context& ctx,
+                            Hash& hash,
+                            std::string& data,
+                            bool at_end,
+                            IncludeFileHasher* hasher)
 {
-  std::string data;
-  try {
-    data = Util::read_file(path);
-  } catch (core::Error&) {
-    return nonstd::make_unexpected(Statistic::internal_error);
-  }
-
   // Bytes between p and q are pending to be hashed.
   const char* p = &data[0];
   char* q = &data[0];
   const char* end = p + data.length();
 
   // There must be at least 7 characters (# 1 "x") left to potentially find an
-  // include file path.
-  while (q < end - 7) {
+  // include file path. If more output will follow, only lines ending before
+  // that are looked at so that they are handled just like when processing all
+  // output at once.
+  string_view scan_data = data;
+  if (!at_end) {
+    const size_t newline = data.length() >= 8
+                             ? data.rfind('\n', data.length() - 8)
+                             : std::string::npos;
+    scan_data =
+      scan_data.substr(0, newline == std::string::npos ? 0 : newline + 1);
+  }
+  const char* scan_end =
+    at_end ? end - std::min<size_t>(data.length(), 7) : scan_data.end();
+
+  while (q < scan_end) {
     static const string_view pragma_gcc_pch_preprocess =
       "pragma GCC pch_preprocess ";
     static const string_view hash_31_command_line_newline =
@@ -497,6 +684,11 @@ process_preprocessed_file(Context& ctx, Hash& hash, const std::string& path)
             || (q[1] == 'l' && q[2] == 'i' && q[3] == 'n' && q[4] == 'e'
                 && q[5] == ' '))
         && (q == data.data() || q[-1] == '\n')) {
+      if (!at_end && !is_complete_linemarker(q, end)) {
+        // Wait for the rest of the include file path.
+        break;
+      }
+
       // Workarounds for preprocessor linemarker bugs in GCC version 6.
       if (q[2] == '3') {
         if (util::starts_with(q, hash_31_command_line_newline)) {
@@ -573,7 +765,7 @@ process_preprocessed_file(Context& ctx, Hash& hash, const std::string& path)
         hash.hash(inc_path);
       }
 
-      if (remember_include_file(ctx, inc_path, hash, system, nullptr)
+      if (remember_include_file(ctx, inc_path, hash, system, nullptr, hasher)
           == RememberIncludeFileResult::cannot_use_pch) {
         return nonstd::make_unexpected(
           Statistic::could_not_use_precompiled_header);
@@ -604,11 +796,30 @@ process_preprocessed_file(Context& ctx, Hash& hash, const std::string& path)
       p = q;
       continue;
     } else {
-      q++;
+      // Skip ahead to the next position that may need a closer look.
+      q = &data[0]
+          + find_preprocessed_directive(scan_data, q - data.data() + 1);
     }
   }
 
+  if (!at_end) {
+    hash.hash(p, q - p);
+    return q - data.data();
+  }
+
   hash.hash(p, (end - p));
+  return data.length();
+}
+
+// Finishes processing preprocessed output after process_preprocessed_output
+// has processed all of it.
+static void
+finish_preprocessed_output(Context& ctx, Hash& hash, IncludeFileHasher* hasher)
+{
+  if (hasher && !hasher->finish() && ctx.config.direct_mode()) {
+    LOG_RAW("Disabling direct mode");
+    ctx.config.set_direct_mode(false);
+  }
 
   // Explicitly check the .gch/.pch/.pth file as Clang does not include any
   // mention of it in the preprocessed output.
@@ -623,7 +834,38 @@ process_preprocessed_file(Context& ctx, Hash& hash, const std::string& path)
   if (debug_included) {
     print_included_files(ctx, stdout);
   }
+}
+
+// Include files are hashed concurrently with the parsing of the preprocessed
+// output, except when the inode cache is used since it isn't thread-safe and
+// makes hashing cheap anyway.
+static optional<IncludeFileHasher>
+make_include_file_hasher(Context& ctx)
+{
+  optional<IncludeFileHasher> hasher;
+  if (!ctx.config.inode_cache()) {
+    hasher.emplace(ctx);
+  }
+  return hasher;
+}
 
+// This function reads and hashes a file containing preprocessed output, see
+// process_preprocessed_output. Paths and hashes of included files are stored in
+// ctx.included_files.
+static nonstd::expected<void, Failure>
+process_preprocessed_file(Context& ctx, Hash& hash, const std::string& path)
+{
+  std::string data;
+  try {
+    data = Util::read_file(path);
+  } catch (core::Error&) {
+    return nonstd::make_unexpected(Statistic::internal_error);
+  }
+
+  auto hasher = make_include_file_hasher(ctx);
+  TRY(process_preprocessed_output(
+    ctx, hash, data, true, hasher ? &*hasher : nullptr));
+  finish_preprocessed_output(ctx, hash, hasher ? &*hasher : nullptr);
   return {};
 }
 
@@ -668,6 +910,7 @@ result_key_from_depfile(Context& ctx, Hash& hash)
 
   return hash.digest();
 }
+#ifdef _WIN32
 // Execute the compiler/preprocessor, with logic to retry without requesting
 // colored diagnostics messages if that fails.
 static nonstd::expected<int, Failure>
@@ -690,14 +933,7 @@ do_execute(Context& ctx,
       && ctx.config.compiler_type() == CompilerType::gcc) {
     auto errors = Util::read_file(tmp_stderr.path);
     if (errors.find("fdiagnostics-color") != std::string::npos) {
-      // GCC versions older than 4.9 don't understand -fdiagnostics-color, and
-      // non-GCC compilers misclassified as CompilerType::gcc might not do it
-      // either. We assume that if the error message contains
-      // "fdiagnostics-color" then the compilation failed due to
-      // -fdiagnostics-color being unsupported and we then retry without the
-      // flag. (Note that there intentionally is no leading dash in
-      // "fdiagnostics-color" since some compilers don't include the dash in the
-      // error message.)
+      // See the do_execute variant below.
       LOG_RAW("-fdiagnostics-color is unsupported; trying again without it");
 
       tmp_stdout.fd = Fd(open(
@@ -721,22 +957,207 @@ do_execute(Context& ctx,
   }
   return status;
 }
+#endif
 
-static core::Manifest
+// Execute the compiler, capturing its standard output and standard error into
+// `stdout_data` and `stderr_data`. Like do_execute, retry without requesting
+// colored diagnostics messages if that fails.
+static nonstd::expected<int, Failure>
+do_execute(Context& ctx,
+           Args& args,
+           std::string& stdout_data,
+           std::string& stderr_data)
+{
+#ifndef _WIN32
+  UmaskScope umask_scope(ctx.original_umask);
+
+  if (ctx.diagnostics_color_failed) {
+    DEBUG_ASSERT(ctx.config.compiler_type() == CompilerType::gcc);
+    args.erase_last("-fdiagnostics-color");
+  }
+  const int status =
+    execute(ctx, args.to_argv().data(), stdout_data, stderr_data);
+  if (status != 0 && !ctx.diagnostics_color_failed
+      && ctx.config.compiler_type() == CompilerType::gcc
+      && stderr_data.find("fdiagnostics-color") != std::string::npos) {
+    // GCC versions older than 4.9 don't understand -fdiagnostics-color, and
+    // non-GCC compilers misclassified as CompilerType::gcc might not do it
+    // either. We assume that if the error message contains
+    // "fdiagnostics-color" then the compilation failed due to
+    // -fdiagnostics-color being unsupported and we then retry without the flag.
+    // (Note that there intentionally is no leading dash in "fdiagnostics-color"
+    // since some compilers don't include the dash in the error message.)
+    LOG_RAW("-fdiagnostics-color is unsupported; trying again without it");
+
+    stdout_data.clear();
+    stderr_data.clear();
+    ctx.diagnostics_color_failed = true;
+    return do_execute(ctx, args, stdout_data, stderr_data);
+  }
+  return status;
+#else
+  TemporaryFile tmp_stdout(FMT("{}/tmp.stdout", ctx.config.temporary_dir()));
+  ctx.register_pending_tmp_file(tmp_stdout.path);
+  TemporaryFile tmp_stderr(FMT("{}/tmp.stderr", ctx.config.temporary_dir()));
+  ctx.register_pending_tmp_file(tmp_stderr.path);
+
+  const auto status =
+    do_execute(ctx, args, std::move(tmp_stdout), std::move(tmp_stderr));
+  if (!status) {
+    return status;
+  }
+  try {
+    stdout_data = Util::read_file(tmp_stdout.path);
+    stderr_data = Util::read_file(tmp_stderr.path);
+  } catch (core::Error&) {
+    // The stdout or stderr file was removed - cleanup in progress? Better bail
+    // out.
+    return nonstd::make_unexpected(Statistic::missing_cache_file);
+  }
+  return status;
+#endif
+}
+
+#ifndef _WIN32
+// Execute the preprocessor with standard output connected to a pipe and process
+// the preprocessed output while it's being produced, see
+// process_preprocessed_output. If `i_path` is not empty, the preprocessed
+// output is also written to it. Like do_execute, retry without requesting
+// colored diagnostics messages if that fails.
+static nonstd::expected<int, Failure>
+do_execute_preprocessor(Context& ctx,
+                        Args& args,
+                        Hash& hash,
+                        const std::string& i_path,
+                        TemporaryFile&& tmp_stderr)
+{
+  UmaskScope umask_scope(ctx.original_umask);
+
+  if (ctx.diagnostics_color_failed) {
+    DEBUG_ASSERT(ctx.config.compiler_type() == CompilerType::gcc);
+    args.erase_last("-fdiagnostics-color");
+  }
+
+  Fd i_fd;
+  if (!i_path.empty()) {
+    i_fd = Fd(open(i_path.c_str(), O_WRONLY | O_TRUNC | O_BINARY));
+    if (!i_fd) {
+      LOG("Failed to open {}: {}", i_path, strerror(errno));
+      return nonstd::make_unexpected(Statistic::internal_error);
+    }
+  }
+
+  // State to restore if the preprocessor needs to be executed again.
+  const Hash original_hash = hash;
+  const auto original_included_files = ctx.included_files;
+  const bool original_direct_mode = ctx.config.direct_mode();
+  const bool original_has_absolute_include_headers =
+    ctx.has_absolute_include_headers;
+
+  auto hasher = make_include_file_hasher(ctx);
+  IncludeFileHasher* hasher_ptr = hasher ? &*hasher : nullptr;
+  std::string pending_data;
+  optional<Failure> failure;
+  const int status = execute(
+    ctx,
+    args.to_argv().data(),
+    [&](const void* data, size_t size) {
+      if (failure) {
+        // Just let the preprocessor finish.
+        return;
+      }
+      if (i_fd) {
+        try {
+          Util::write_fd(*i_fd, data, size);
+        } catch (const core::Error& e) {
+          LOG("Failed to write to {}: {}", i_path, e.what());
+          failure = Failure(Statistic::internal_error);
+          return;
+        }
+      }
+      pending_data.append(static_cast<const char*>(data), size);
+      const auto processed = process_preprocessed_output(
+        ctx, hash, pending_data, false, hasher_ptr);
+      if (processed) {
+        pending_data.erase(0, *processed);
+      } else {
+        failure = processed.error();
+      }
+    },
+    std::move(tmp_stderr.fd));
+
+  if (status != 0 && !ctx.diagnostics_color_failed
+      && ctx.config.compiler_type() == CompilerType::gcc) {
+    auto errors = Util::read_file(tmp_stderr.path);
+    if (errors.find("fdiagnostics-color") != std::string::npos) {
+      // See do_execute.
+      LOG_RAW("-fdiagnostics-color is unsupported; trying again without it");
+
+      hasher.reset();
+      hash = original_hash;
+      ctx.included_files = original_included_files;
+      ctx.config.set_direct_mode(original_direct_mode);
+      ctx.has_absolute_include_headers = original_has_absolute_include_headers;
+
+      tmp_stderr.fd = Fd(open(
+        tmp_stderr.path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0600));
+      if (!tmp_stderr.fd) {
+        LOG("Failed to truncate {}: {}", tmp_stderr.path, strerror(errno));
+        return nonstd::make_unexpected(Statistic::internal_error);
+      }
+
+      ctx.diagnostics_color_failed = true;
+      return do_execute_preprocessor(
+        ctx, args, hash, i_path, std::move(tmp_stderr));
+    }
+  }
+  if (status != 0) {
+    return status;
+  }
+  if (failure) {
+    return nonstd::make_unexpected(*failure);
+  }
+
+  TRY(process_preprocessed_output(ctx, hash, pending_data, true, hasher_ptr));
+  finish_preprocessed_output(ctx, hash, hasher_ptr);
+  return status;
+}
+#endif
+
+// Read a manifest file and, for primary storage, its delta file. Returns
+// nullopt if the manifest file can't be read.
+static nonstd::optional<core::Manifest>
 read_manifest(const std::string& path)
 {
-  core::Manifest manifest;
   File file(path, "rb");
-  if (file) {
-    try {
-      core::FileReader file_reader(*file);
-      core::CacheEntryReader reader(file_reader);
-      manifest.read(reader);
-      reader.finalize();
-    } catch (const core::Error& e) {
-      LOG("Error reading {}: {}", path, e.what());
+  if (!file) {
+    return nonstd::nullopt;
+  }
+  core::Manifest manifest;
+  try {
+    core::FileReader file_reader(*file);
+    core::CacheEntryReader reader(file_reader);
+    manifest.read(reader, reader.header().payload_size());
+    reader.finalize();
+  } catch (const core::Error& e) {
+    LOG("Error reading {}: {}", path, e.what());
+    return nonstd::nullopt;
+  }
+
+  // Only manifest files in primary storage have delta files.
+  if (util::ends_with(path, "M")) {
+    const auto delta_path =
+      storage::primary::PrimaryStorage::get_manifest_delta_path(path);
+    if (Stat::stat(delta_path)) {
+      try {
+        const auto records = manifest.merge_delta(Util::read_file(delta_path));
+        LOG("Merged {} record(s) from {}", records, delta_path);
+      } catch (const core::Error& e) {
+        LOG("Error reading {}: {}", delta_path, e.what());
+      }
     }
   }
+
   return manifest;
 }
 
@@ -747,12 +1168,13 @@ save_manifest(const Config& config,
 {
   AtomicFile atomic_manifest_file(path, AtomicFile::Mode::binary);
   core::FileWriter file_writer(atomic_manifest_file.stream());
-  core::CacheEntryHeader header(core::CacheEntryType::manifest,
-                                compression::type_from_config(config),
-                                compression::level_from_config(config),
-                                time(nullptr),
-                                CCACHE_VERSION,
-                                config.namespace_());
+  core::CacheEntryHeader header(
+    core::CacheEntryType::manifest,
+    compression::type_from_config(config),
+    compression::level_for_entry(config, manifest.serialized_size()),
+    time(nullptr),
+    CCACHE_VERSION,
+    config.namespace_());
   header.set_entry_size_from_payload_size(manifest.serialized_size());
 
   core::CacheEntryWriter writer(file_writer, header);
@@ -781,24 +1203,98 @@ update_manifest_file(Context& ctx,
     (ctx.config.sloppiness().is_enabled(core::Sloppy::file_stat_matches))
     || ctx.args_info.output_is_precompiled_header;
 
+  // Secondary storage needs the complete manifest, but otherwise the result is
+  // appended to the manifest delta file, relative to the manifest read during
+  // the lookup, so that concurrent ccache invocations don't have to rewrite the
+  // manifest file. The delta file is merged into the manifest file when it
+  // grows too large.
+  const auto manifest_path =
+    ctx.storage.has_secondary_storage() || !ctx.manifest
+      ? nullopt
+      : ctx.storage.primary.get(manifest_key, core::CacheEntryType::manifest);
+  if (manifest_path) {
+    std::string record;
+    try {
+      record =
+        ctx.manifest->delta_record(result_key,
+                                   ctx.included_files,
+                                   ctx.time_of_compilation,
+                                   save_timestamp,
+                                   compression::type_from_config(ctx.config),
+                                   compression::level_from_config(ctx.config));
+    } catch (const core::Error& e) {
+      LOG("Failed to add result key to {}: {}", *manifest_path, e.what());
+      return;
+    }
+    const auto delta_size =
+      ctx.storage.primary.append_to_manifest_delta(manifest_key, record);
+    if (delta_size && *delta_size <= k_max_manifest_delta_size) {
+      return;
+    }
+  }
+
+  // Results appended to the delta file by other ccache invocations after it
+  // has been read are lost when it's removed below, just like results added
+  // by concurrent rewrites of the manifest file.
+  bool saved = false;
   ctx.storage.put(
     manifest_key, core::CacheEntryType::manifest, [&](const auto& path) {
       LOG("Adding result key to {}", path);
       try {
-        auto manifest = read_manifest(path);
+        const bool has_delta = Stat::stat(
+          storage::primary::PrimaryStorage::get_manifest_delta_path(path));
+        auto manifest = read_manifest(path).value_or(core::Manifest());
         const bool added = manifest.add_result(result_key,
                                                ctx.included_files,
                                                ctx.time_of_compilation,
                                                save_timestamp);
-        if (added) {
+        if (added || has_delta) {
           save_manifest(ctx.config, manifest, path);
+          saved = true;
         }
-        return added;
+        return saved;
       } catch (const core::Error& e) {
         LOG("Failed to add result key to {}: {}", path, e.what());
         return false;
       }
     });
+  if (saved) {
+    ctx.storage.primary.remove_manifest_delta(manifest_key);
+  }
+}
+
+// Make `result_key` the most recently used result in the manifest so that it
+// isn't evicted when new results are added.
+static void
+promote_in_manifest_file(Context& ctx,
+                         const Digest& manifest_key,
+                         core::Manifest& manifest,
+                         const Digest& result_key)
+{
+  if (ctx.config.read_only() || ctx.config.read_only_direct()
+      || !manifest.promote_result(result_key)) {
+    return;
+  }
+
+  MTR_SCOPE("manifest", "manifest_promote");
+
+  // The manifest was read including its delta file, so the delta file is
+  // obsolete once the manifest file has been rewritten. Secondary storage is
+  // not updated since the result order only matters for local eviction.
+  const auto saved_path = ctx.storage.primary.put(
+    manifest_key, core::CacheEntryType::manifest, [&](const auto& path) {
+      LOG("Promoting result key in {}", path);
+      try {
+        save_manifest(ctx.config, manifest, path);
+        return true;
+      } catch (const core::Error& e) {
+        LOG("Failed to promote result key in {}: {}", path, e.what());
+        return false;
+      }
+    });
+  if (saved_path) {
+    ctx.storage.primary.remove_manifest_delta(manifest_key);
+  }
 }
 
 struct FindCoverageFileResult
@@ -842,6 +1338,7 @@ find_coverage_file(const Context& ctx)
 static bool
 write_result(Context& ctx,
              const std::string& result_path,
+             const std::string& obj_path,
              const Stat& obj_stat,
              const std::string& stdout_data,
              const std::string& stderr_data)
@@ -857,8 +1354,12 @@ write_result(Context& ctx,
     result_writer.write_data(Result::FileType::stdout_output, stdout_data);
   }
   if (obj_stat) {
-    result_writer.write_file(Result::FileType::object,
-                             ctx.args_info.output_obj);
+    if (obj_path == ctx.args_info.output_obj) {
+      result_writer.write_file(Result::FileType::object, obj_path);
+    } else {
+      result_writer.write_tmp_file(
+        Result::FileType::object, obj_path, ctx.args_info.output_obj);
+    }
   }
   if (ctx.args_info.generating_dependencies) {
     result_writer.write_file(Result::FileType::dependency,
@@ -928,6 +1429,27 @@ rewrite_stdout_from_compiler(const Context& ctx, std::string&& stdout_data)
   }
 }
 
+// Return whether the compiler can write the object file to a temporary file
+// that is then moved into the cache as a raw file, thus avoiding storing the
+// object file by copying.
+static bool
+should_compile_into_cache(const Context& ctx)
+{
+  // The object file will be stored as a raw file only if file_clone or
+  // hard_link is enabled. The object file name must not affect the compiler
+  // output, which it does for e.g. dependency, coverage and .dwo files.
+  return (ctx.config.file_clone() || ctx.config.hard_link())
+         && !ctx.config.read_only() && !ctx.config.depend_mode()
+         && !ctx.config.is_compiler_group_msvc()
+         && ctx.args_info.output_obj != "/dev/null"
+         && !ctx.args_info.output_is_precompiled_header
+         && !ctx.args_info.generating_dependencies
+         && !ctx.args_info.generating_coverage
+         && !ctx.args_info.generating_stackusage
+         && !ctx.args_info.seen_split_dwarf && !ctx.args_info.profile_arcs
+         && !ctx.args_info.profile_generate;
+}
+
 // Run the real compiler and put the result in cache. Returns the result key.
 static nonstd::expected<Digest, Failure>
 to_cache(Context& ctx,
@@ -936,11 +1458,24 @@ to_cache(Context& ctx,
          const Args& depend_extra_args,
          Hash* depend_mode_hash)
 {
+  std::string obj_path = ctx.args_info.output_obj;
+  if (should_compile_into_cache(ctx)) {
+    // Use a directory inside the cache directory so that the file can be
+    // renamed into the cache. temporary_dir may be on another file system.
+    TemporaryFile tmp_obj(FMT("{}/tmp/tmp.obj", ctx.config.cache_dir()));
+    ctx.register_pending_tmp_file(tmp_obj.path);
+    obj_path = tmp_obj.path;
+    // Only the unique filename is of interest; let the compiler create the
+    // file so that it's possible to detect whether it produced one.
+    Util::unlink_safe(obj_path);
+    LOG("Compiling to {}", obj_path);
+  }
+
   if (ctx.config.is_compiler_group_msvc()) {
-    args.push_back(fmt::format("-Fo{}", ctx.args_info.output_obj));
+    args.push_back(fmt::format("-Fo{}", obj_path));
   } else {
     args.push_back("-o");
-    args.push_back(ctx.args_info.output_obj);
+    args.push_back(obj_path);
   }
 
   if (ctx.config.hard_link() && ctx.args_info.output_obj != "/dev/null") {
@@ -983,18 +1518,11 @@ to_cache(Context& ctx,
   LOG_RAW("Running real compiler");
   MTR_BEGIN("execute", "compiler");
 
-  TemporaryFile tmp_stdout(FMT("{}/tmp.stdout", ctx.config.temporary_dir()));
-  ctx.register_pending_tmp_file(tmp_stdout.path);
-  std::string tmp_stdout_path = tmp_stdout.path;
-
-  TemporaryFile tmp_stderr(FMT("{}/tmp.stderr", ctx.config.temporary_dir()));
-  ctx.register_pending_tmp_file(tmp_stderr.path);
-  std::string tmp_stderr_path = tmp_stderr.path;
-
+  std::string stdout_data;
+  std::string stderr_data;
   nonstd::expected<int, Failure> status;
   if (!ctx.config.depend_mode()) {
-    status =
-      do_execute(ctx, args, std::move(tmp_stdout), std::move(tmp_stderr));
+    status = do_execute(ctx, args, stdout_data, stderr_data);
     args.pop_back(3);
   } else {
     // Use the original arguments (including dependency options) in depend
@@ -1005,8 +1533,7 @@ to_cache(Context& ctx,
     add_prefix(ctx, depend_mode_args, ctx.config.prefix_command());
 
     ctx.time_of_compilation = time(nullptr);
-    status = do_execute(
-      ctx, depend_mode_args, std::move(tmp_stdout), std::move(tmp_stderr));
+    status = do_execute(ctx, depend_mode_args, stdout_data, stderr_data);
   }
   MTR_END("execute", "compiler");
 
@@ -1014,23 +1541,15 @@ to_cache(Context& ctx,
     return nonstd::make_unexpected(status.error());
   }
 
-  // Merge stderr from the preprocessor (if any) and stderr from
-  // the real compiler into tmp_stderr.
+  // Merge stderr from the preprocessor (if any) and stderr from the real
+  // compiler.
   if (!ctx.cpp_stderr.empty()) {
-    std::string combined_stderr =
-      Util::read_file(ctx.cpp_stderr) + Util::read_file(tmp_stderr_path);
-    Util::write_file(tmp_stderr_path, combined_stderr);
-  }
-
-  std::string stdout_data;
-  std::string stderr_data;
-  try {
-    stdout_data = Util::read_file(tmp_stdout_path);
-    stderr_data = Util::read_file(tmp_stderr_path);
-  } catch (core::Error&) {
-    // The stdout or stderr file was removed - cleanup in progress? Better bail
-    // out.
-    return nonstd::make_unexpected(Statistic::missing_cache_file);
+    try {
+      stderr_data = Util::read_file(ctx.cpp_stderr) + stderr_data;
+    } catch (core::Error&) {
+      // The stderr file was removed - cleanup in progress? Better bail out.
+      return nonstd::make_unexpected(Statistic::missing_cache_file);
+    }
   }
 
   stdout_data = rewrite_stdout_from_compiler(ctx, std::move(stdout_data));
@@ -1064,7 +1583,7 @@ to_cache(Context& ctx,
     Depfile::make_paths_relative_in_output_dep(ctx);
   }
 
-  const auto obj_stat = Stat::stat(ctx.args_info.output_obj);
+  const auto obj_stat = Stat::stat(obj_path);
   if (!obj_stat) {
     if (ctx.args_info.expect_output_obj) {
       LOG_RAW("Compiler didn't produce an object file (unexpected)");
@@ -1080,9 +1599,29 @@ to_cache(Context& ctx,
   MTR_BEGIN("result", "result_put");
   const bool added = ctx.storage.put(
     *result_key, core::CacheEntryType::result, [&](const auto& path) {
-      return write_result(ctx, path, obj_stat, stdout_data, stderr_data);
+      return write_result(
+        ctx, path, obj_path, obj_stat, stdout_data, stderr_data);
     });
   MTR_END("result", "result_put");
+
+  if (obj_path != ctx.args_info.output_obj && Stat::stat(obj_path)) {
+    // The object file wasn't moved into the cache.
+    try {
+      Util::rename(obj_path, ctx.args_info.output_obj);
+    } catch (const core::Error&) {
+      // Most likely the temporary directory is on another file system.
+      try {
+        Util::copy_file(obj_path, ctx.args_info.output_obj, true);
+      } catch (const core::Error& e) {
+        LOG("Failed to copy {} to {}: {}",
+            obj_path,
+            ctx.args_info.output_obj,
+            e.what());
+        return nonstd::make_unexpected(Statistic::internal_error);
+      }
+    }
+  }
+
   if (!added) {
     return nonstd::make_unexpected(Statistic::internal_error);
   }
@@ -1108,18 +1647,29 @@ get_result_key_from_cpp(Context& ctx, Args& args, Hash& hash)
     // We are compiling a .i or .ii file - that means we can skip the cpp stage
     // and directly form the correct i_tmpfile.
     stdout_path = ctx.args_info.input_file;
+    hash.hash_delimiter("cpp");
+    TRY(process_preprocessed_file(ctx, hash, stdout_path));
   } else {
     // Run cpp on the input file to obtain the .i.
 
-    TemporaryFile tmp_stdout(
-      FMT("{}/tmp.cpp_stdout", ctx.config.temporary_dir()));
-    ctx.register_pending_tmp_file(tmp_stdout.path);
+#ifndef _WIN32
+    // The preprocessed output is processed through a pipe and only needs to be
+    // stored if the compiler is going to compile it.
+    const bool store_cpp_output = !ctx.config.run_second_cpp();
+#else
+    const bool store_cpp_output = true;
+#endif
+    optional<TemporaryFile> tmp_stdout;
+    if (store_cpp_output) {
+      tmp_stdout.emplace(FMT("{}/tmp.cpp_stdout", ctx.config.temporary_dir()));
+      ctx.register_pending_tmp_file(tmp_stdout->path);
 
-    // stdout_path needs the proper cpp_extension for the compiler to do its
-    // thing correctly.
-    stdout_path = FMT("{}.{}", tmp_stdout.path, ctx.config.cpp_extension());
-    Util::hard_link(tmp_stdout.path, stdout_path);
-    ctx.register_pending_tmp_file(stdout_path);
+      // stdout_path needs the proper cpp_extension for the compiler to do its
+      // thing correctly.
+      stdout_path = FMT("{}.{}", tmp_stdout->path, ctx.config.cpp_extension());
+      Util::hard_link(tmp_stdout->path, stdout_path);
+      ctx.register_pending_tmp_file(stdout_path);
+    }
 
     TemporaryFile tmp_stderr(
       FMT("{}/tmp.cpp_stderr", ctx.config.temporary_dir()));
@@ -1141,8 +1691,14 @@ get_result_key_from_cpp(Context& ctx, Args& args, Hash& hash)
     add_prefix(ctx, args, ctx.config.prefix_command_cpp());
     LOG_RAW("Running preprocessor");
     MTR_BEGIN("execute", "preprocessor");
+#ifndef _WIN32
+    hash.hash_delimiter("cpp");
+    const auto status = do_execute_preprocessor(
+      ctx, args, hash, stdout_path, std::move(tmp_stderr));
+#else
     const auto status =
-      do_execute(ctx, args, std::move(tmp_stdout), std::move(tmp_stderr));
+      do_execute(ctx, args, std::move(*tmp_stdout), std::move(tmp_stderr));
+#endif
     MTR_END("execute", "preprocessor");
     args.pop_back(args_added);
 
@@ -1152,10 +1708,12 @@ get_result_key_from_cpp(Context& ctx, Args& args, Hash& hash)
       LOG("Preprocessor gave exit status {}", *status);
       return nonstd::make_unexpected(Statistic::preprocessor_error);
     }
-  }
 
-  hash.hash_delimiter("cpp");
-  TRY(process_preprocessed_file(ctx, hash, stdout_path));
+#ifdef _WIN32
+    hash.hash_delimiter("cpp");
+    TRY(process_preprocessed_file(ctx, hash, stdout_path));
+#endif
+  }
 
   hash.hash_delimiter("cppstderr");
   if (!ctx.args_info.direct_i_file && !hash.hash_file(stderr_path)) {
@@ -1181,6 +1739,74 @@ get_result_key_from_cpp(Context& ctx, Args& args, Hash& hash)
   return hash.digest();
 }
 
+// Add the result of an expensive compiler check (hashing the compiler binary or
+// running a command), computed by `hash_identity`, to `hash`. If
+// compiler_check_cache is enabled, the result is persisted in primary storage,
+// keyed by the compiler check, the compiler's path and stat data and PATH, so
+// that later invocations only need a lookup.
+static bool
+hash_compiler_identity(const Context& ctx,
+                       Hash& hash,
+                       const Stat& st,
+                       const std::string& path,
+                       const std::function<bool(Hash&)>& hash_identity)
+{
+  if (!ctx.config.compiler_check_cache()) {
+    return hash_identity(hash);
+  }
+
+  Hash key_hash;
+  key_hash.hash_delimiter("compiler_check");
+  key_hash.hash(ctx.config.compiler_check());
+  key_hash.hash_delimiter("path");
+  key_hash.hash(path);
+  key_hash.hash(ctx.orig_args[0]); // Substituted for %compiler%
+  key_hash.hash_delimiter("stat");
+  key_hash.hash(static_cast<int64_t>(st.device()));
+  key_hash.hash(static_cast<int64_t>(st.inode()));
+  key_hash.hash(st.size());
+  key_hash.hash(st.mtim().tv_sec);
+  key_hash.hash(st.mtim().tv_nsec);
+  key_hash.hash(st.ctim().tv_sec);
+  key_hash.hash(st.ctim().tv_nsec);
+  key_hash.hash_delimiter("PATH");
+  const char* env_path = getenv("PATH");
+  key_hash.hash(env_path ? env_path : "");
+  const auto identity_path =
+    ctx.storage.primary.get_compiler_identity_path(key_hash.digest());
+
+  Digest digest;
+  try {
+    const auto data = Util::read_file(identity_path);
+    if (data.size() == Digest::size()) {
+      memcpy(digest.bytes(), data.data(), Digest::size());
+      LOG("Using compiler identity from {}", identity_path);
+      hash.hash(digest.bytes(), Digest::size(), Hash::HashType::binary);
+      return true;
+    }
+  } catch (const core::Error&) {
+    // Not known yet.
+  }
+
+  Hash identity_hash;
+  if (!hash_identity(identity_hash)) {
+    return false;
+  }
+  digest = identity_hash.digest();
+
+  try {
+    AtomicFile identity_file(identity_path, AtomicFile::Mode::binary);
+    identity_file.write(std::string(
+      reinterpret_cast<const char*>(digest.bytes()), Digest::size()));
+    identity_file.commit();
+  } catch (const core::Error& e) {
+    LOG("Failed to write {}: {}", identity_path, e.what());
+  }
+
+  hash.hash(digest.bytes(), Digest::size(), Hash::HashType::binary);
+  return true;
+}
+
 // Hash mtime or content of a file, or the output of a command, according to
 // the CCACHE_COMPILERCHECK setting.
 static nonstd::expected<void, Failure>
@@ -1201,10 +1827,15 @@ hash_compiler(const Context& ctx,
     hash.hash(&ctx.config.compiler_check()[7]);
   } else if (ctx.config.compiler_check() == "content" || !allow_command) {
     hash.hash_delimiter("cc_content");
-    hash_binary_file(ctx, hash, path);
+    hash_compiler_identity(ctx, hash, st, path, [&](Hash& identity_hash) {
+      return hash_binary_file(ctx, identity_hash, path);
+    });
   } else { // command string
-    if (!hash_multicommand_output(
-          hash, ctx.config.compiler_check(), ctx.orig_args[0])) {
+    if (!hash_compiler_identity(
+          ctx, hash, st, path, [&](Hash& identity_hash) {
+            return hash_multicommand_output(
+              identity_hash, ctx.config.compiler_check(), ctx.orig_args[0]);
+          })) {
       LOG("Failure running compiler check command: {}",
           ctx.config.compiler_check());
       return nonstd::make_unexpected(Statistic::compiler_check_failed);
@@ -1767,17 +2398,22 @@ calculate_result_and_manifest_key(Context& ctx,
     if (manifest_path) {
       LOG("Looking for result key in {}", *manifest_path);
       MTR_BEGIN("manifest", "manifest_get");
+      nonstd::optional<core::Manifest> manifest;
       try {
-        const auto manifest = read_manifest(*manifest_path);
-        result_key = manifest.look_up_result_digest(ctx);
+        manifest = read_manifest(*manifest_path);
+        if (manifest) {
+          result_key = manifest->look_up_result_digest(ctx);
+        }
       } catch (const core::Error& e) {
         LOG("Failed to look up result key in {}: {}", *manifest_path, e.what());
       }
       MTR_END("manifest", "manifest_get");
       if (result_key) {
         LOG_RAW("Got result key from manifest");
+        promote_in_manifest_file(ctx, *manifest_key, *manifest, *result_key);
       } else {
         LOG_RAW("Did not find result key in manifest");
+        ctx.manifest = std::move(manifest);
       }
     }
   } else if (ctx.args_info.arch_args.empty()) {
@@ -1855,6 +2491,7 @@ from_cache(Context& ctx, FromCacheCallMode mode, const Digest& result_key)
 
   try {
     result_reader.read(result_retriever);
+    result_retriever.finalize();
   } catch (core::Error& e) {
     LOG("Failed to get result from cache: {}", e.what());
     return false;
@@ -2135,17 +2772,6 @@ do_cache_compilation(Context& ctx, const char* const* argv)
     ctx.config.set_depend_mode(false);
   }
 
-  if (ctx.storage.has_secondary_storage()) {
-    if (ctx.config.file_clone()) {
-      LOG_RAW("Disabling file clone mode since secondary storage is enabled");
-      ctx.config.set_file_clone(false);
-    }
-    if (ctx.config.hard_link()) {
-      LOG_RAW("Disabling hard link mode since secondary storage is enabled");
-      ctx.config.set_hard_link(false);
-    }
-  }
-
   LOG("Source file: {}", ctx.args_info.input_file);
   if (ctx.args_info.generating_dependencies) {
     LOG("Dependency file: {}", ctx.args_info.output_dep);
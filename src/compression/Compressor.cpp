@@ -23,6 +23,11 @@
 #include "assertions.hpp"
 
 #include <core/Writer.hpp>
+#include <core/exceptions.hpp>
+
+#ifdef HAVE_LZ4_COMPRESSION
+#  include "Lz4Compressor.hpp"
+#endif
 
 #include <memory>
 
@@ -31,14 +36,24 @@ namespace compression {
 std::unique_ptr<Compressor>
 Compressor::create_from_type(const Type type,
                              core::Writer& writer,
-                             const int8_t compression_level)
+                             const int8_t compression_level,
+                             const uint32_t dictionary_id,
+                             const uint64_t input_size_hint)
 {
   switch (type) {
   case compression::Type::none:
     return std::make_unique<NullCompressor>(writer);
 
   case compression::Type::zstd:
-    return std::make_unique<ZstdCompressor>(writer, compression_level);
+    return std::make_unique<ZstdCompressor>(
+      writer, compression_level, dictionary_id, input_size_hint);
+
+  case compression::Type::lz4:
+#ifdef HAVE_LZ4_COMPRESSION
+    return std::make_unique<Lz4Compressor>(writer, compression_level);
+#else
+    throw core::Error("LZ4 compression is not supported by this ccache build");
+#endif
   }
 
   ASSERT(false);
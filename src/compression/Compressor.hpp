@@ -37,10 +37,22 @@ class Compressor : public core::Writer
 public:
   virtual ~Compressor() = default;
 
+  // `dictionary_id` is the ID of a compression dictionary (see
+  // dictionary.hpp), or 0 for no dictionary. `input_size_hint` is the
+  // approximate amount of data that will be written, or 0 if unknown.
   static std::unique_ptr<Compressor>
-  create_from_type(Type type, core::Writer& writer, int8_t compression_level);
+  create_from_type(Type type,
+                   core::Writer& writer,
+                   int8_t compression_level,
+                   uint32_t dictionary_id = 0,
+                   uint64_t input_size_hint = 0);
 
   virtual int8_t actual_compression_level() const = 0;
+
+  // End the current compressed frame so that data written after this call
+  // starts a new frame that can be decompressed independently, reusing the
+  // compression context. Does not finalize the underlying writer.
+  virtual void end_frame() = 0;
 };
 
 } // namespace compression
@@ -22,17 +22,32 @@
 #include "ZstdDecompressor.hpp"
 #include "assertions.hpp"
 
+#include <core/exceptions.hpp>
+
+#ifdef HAVE_LZ4_COMPRESSION
+#  include "Lz4Decompressor.hpp"
+#endif
+
 namespace compression {
 
 std::unique_ptr<Decompressor>
-Decompressor::create_from_type(Type type, core::Reader& reader)
+Decompressor::create_from_type(Type type,
+                               core::Reader& reader,
+                               const uint32_t dictionary_id)
 {
   switch (type) {
   case compression::Type::none:
     return std::make_unique<NullDecompressor>(reader);
 
   case compression::Type::zstd:
-    return std::make_unique<ZstdDecompressor>(reader);
+    return std::make_unique<ZstdDecompressor>(reader, dictionary_id);
+
+  case compression::Type::lz4:
+#ifdef HAVE_LZ4_COMPRESSION
+    return std::make_unique<Lz4Decompressor>(reader);
+#else
+    throw core::Error("LZ4 compression is not supported by this ccache build");
+#endif
   }
 
   ASSERT(false);
@@ -21,6 +21,7 @@
 #include <compression/types.hpp>
 #include <core/Reader.hpp>
 
+#include <cstdint>
 #include <memory>
 
 namespace compression {
@@ -30,9 +31,10 @@ class Decompressor : public core::Reader
 public:
   virtual ~Decompressor() = default;
 
-  // Create a decompressor for the specified type.
-  static std::unique_ptr<Decompressor> create_from_type(Type type,
-                                                        core::Reader& reader);
+  // Create a decompressor for the specified type. `dictionary_id` is the ID of
+  // a compression dictionary (see dictionary.hpp), or 0 for no dictionary.
+  static std::unique_ptr<Decompressor>
+  create_from_type(Type type, core::Reader& reader, uint32_t dictionary_id = 0);
 
   // Finalize decompression.
   //
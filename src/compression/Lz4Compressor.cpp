@@ -0,0 +1,176 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "Lz4Compressor.hpp"
+
+#include "Logging.hpp"
+#include "assertions.hpp"
+
+#include <core/exceptions.hpp>
+
+#include <lz4frame.h>
+#include <lz4hc.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace compression {
+
+namespace {
+
+LZ4F_preferences_t
+get_preferences(const int compression_level)
+{
+  LZ4F_preferences_t preferences;
+  memset(&preferences, 0, sizeof(preferences));
+  preferences.compressionLevel = compression_level;
+  preferences.frameInfo.contentChecksumFlag = LZ4F_noContentChecksum;
+  return preferences;
+}
+
+} // namespace
+
+Lz4Compressor::Lz4Compressor(core::Writer& writer, int8_t compression_level)
+  : m_writer(writer),
+    m_lz4_context(nullptr)
+{
+  if (compression_level == 0) {
+    compression_level = default_compression_level;
+    LOG("Using default compression level {}", compression_level);
+  }
+
+  m_compression_level = std::min<int>(compression_level, LZ4HC_CLEVEL_MAX);
+  if (m_compression_level != compression_level) {
+    LOG("Using compression level {} (max liblz4 level) instead of {}",
+        m_compression_level,
+        compression_level);
+  }
+
+  const LZ4F_errorCode_t ret =
+    LZ4F_createCompressionContext(&m_lz4_context, LZ4F_VERSION);
+  if (LZ4F_isError(ret)) {
+    throw core::Error("error initializing LZ4 compression context");
+  }
+
+  // Each call to LZ4F_compressUpdate is passed at most
+  // CCACHE_READ_BUFFER_SIZE bytes, so this also fits the frame header and
+  // footer.
+  const auto preferences = get_preferences(m_compression_level);
+  m_output_buffer.resize(
+    std::max<size_t>(LZ4F_compressBound(CCACHE_READ_BUFFER_SIZE, &preferences),
+                     LZ4F_HEADER_SIZE_MAX));
+
+  try {
+    begin_frame();
+  } catch (const core::Error&) {
+    LZ4F_freeCompressionContext(m_lz4_context);
+    throw;
+  }
+}
+
+Lz4Compressor::~Lz4Compressor()
+{
+  LZ4F_freeCompressionContext(m_lz4_context);
+}
+
+int8_t
+Lz4Compressor::actual_compression_level() const
+{
+  return m_compression_level;
+}
+
+void
+Lz4Compressor::begin_frame()
+{
+  const auto preferences = get_preferences(m_compression_level);
+  const size_t header_size = LZ4F_compressBegin(m_lz4_context,
+                                                m_output_buffer.data(),
+                                                m_output_buffer.size(),
+                                                &preferences);
+  if (LZ4F_isError(header_size)) {
+    throw core::Error("error initializing LZ4 compression stream");
+  }
+
+  // The caller may write its own data to the underlying writer after
+  // construction, so hold back the frame header until the first write.
+  m_frame_header.assign(m_output_buffer.begin(),
+                        m_output_buffer.begin() + header_size);
+}
+
+void
+Lz4Compressor::write_frame_header()
+{
+  if (!m_frame_header.empty()) {
+    m_writer.write(m_frame_header.data(), m_frame_header.size());
+    m_frame_header.clear();
+  }
+}
+
+void
+Lz4Compressor::write(const void* const data, const size_t count)
+{
+  write_frame_header();
+
+  const uint8_t* input = static_cast<const uint8_t*>(data);
+  size_t bytes_left = count;
+  while (bytes_left > 0) {
+    const size_t chunk_size =
+      std::min<size_t>(bytes_left, CCACHE_READ_BUFFER_SIZE);
+    const size_t compressed_bytes = LZ4F_compressUpdate(m_lz4_context,
+                                                        m_output_buffer.data(),
+                                                        m_output_buffer.size(),
+                                                        input,
+                                                        chunk_size,
+                                                        nullptr);
+    ASSERT(!LZ4F_isError(compressed_bytes));
+    if (compressed_bytes > 0) {
+      m_writer.write(m_output_buffer.data(), compressed_bytes);
+    }
+    input += chunk_size;
+    bytes_left -= chunk_size;
+  }
+}
+
+void
+Lz4Compressor::write_frame_footer()
+{
+  write_frame_header();
+
+  const size_t compressed_bytes = LZ4F_compressEnd(
+    m_lz4_context, m_output_buffer.data(), m_output_buffer.size(), nullptr);
+  ASSERT(!LZ4F_isError(compressed_bytes));
+  if (compressed_bytes > 0) {
+    m_writer.write(m_output_buffer.data(), compressed_bytes);
+  }
+}
+
+void
+Lz4Compressor::end_frame()
+{
+  write_frame_footer();
+  begin_frame();
+}
+
+void
+Lz4Compressor::finalize()
+{
+  write_frame_footer();
+  m_writer.finalize();
+}
+
+} // namespace compression
@@ -0,0 +1,60 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#pragma once
+
+#include "Compressor.hpp"
+
+#include <NonCopyable.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct LZ4F_cctx_s;
+
+namespace compression {
+
+class Lz4Compressor : public Compressor, NonCopyable
+{
+public:
+  // Levels up to 2 select the fast LZ4 mode (negative levels trade ratio for
+  // even more speed) and higher levels select LZ4HC.
+  Lz4Compressor(core::Writer& writer, int8_t compression_level);
+
+  ~Lz4Compressor() override;
+
+  int8_t actual_compression_level() const override;
+  void write(const void* data, size_t count) override;
+  void end_frame() override;
+  void finalize() override;
+
+  constexpr static uint8_t default_compression_level = 1;
+
+private:
+  core::Writer& m_writer;
+  LZ4F_cctx_s* m_lz4_context;
+  std::vector<uint8_t> m_output_buffer;
+  std::vector<uint8_t> m_frame_header;
+  int8_t m_compression_level;
+
+  void begin_frame();
+  void write_frame_header();
+  void write_frame_footer();
+};
+
+} // namespace compression
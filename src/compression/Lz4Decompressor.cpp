@@ -0,0 +1,90 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "Lz4Decompressor.hpp"
+
+#include "assertions.hpp"
+
+#include <core/exceptions.hpp>
+
+#include <lz4frame.h>
+
+namespace compression {
+
+Lz4Decompressor::Lz4Decompressor(core::Reader& reader)
+  : m_reader(reader),
+    m_input_size(0),
+    m_input_consumed(0),
+    m_lz4_context(nullptr),
+    m_reached_stream_end(false)
+{
+  const LZ4F_errorCode_t ret =
+    LZ4F_createDecompressionContext(&m_lz4_context, LZ4F_VERSION);
+  if (LZ4F_isError(ret)) {
+    throw core::Error("failed to initialize LZ4 decompression context");
+  }
+}
+
+Lz4Decompressor::~Lz4Decompressor()
+{
+  LZ4F_freeDecompressionContext(m_lz4_context);
+}
+
+size_t
+Lz4Decompressor::read(void* const data, const size_t count)
+{
+  size_t bytes_read = 0;
+  while (bytes_read < count) {
+    ASSERT(m_input_size >= m_input_consumed);
+    if (m_input_size == m_input_consumed) {
+      m_input_size = m_reader.read(m_input_buffer, sizeof(m_input_buffer));
+      m_input_consumed = 0;
+    }
+
+    size_t input_size = m_input_size - m_input_consumed;
+    size_t output_size = count - bytes_read;
+    const size_t ret =
+      LZ4F_decompress(m_lz4_context,
+                      static_cast<uint8_t*>(data) + bytes_read,
+                      &output_size,
+                      m_input_buffer + m_input_consumed,
+                      &input_size,
+                      nullptr);
+    if (LZ4F_isError(ret)) {
+      throw core::Error("Failed to read from LZ4 input stream");
+    }
+    bytes_read += output_size;
+    m_input_consumed += input_size;
+    if (ret == 0) {
+      m_reached_stream_end = true;
+      break;
+    }
+  }
+
+  return count;
+}
+
+void
+Lz4Decompressor::finalize()
+{
+  if (!m_reached_stream_end) {
+    throw core::Error("Garbage data at end of LZ4 input stream");
+  }
+}
+
+} // namespace compression
@@ -0,0 +1,48 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#pragma once
+
+#include "Decompressor.hpp"
+
+#include <cstdint>
+
+struct LZ4F_dctx_s;
+
+namespace compression {
+
+class Lz4Decompressor : public Decompressor
+{
+public:
+  explicit Lz4Decompressor(core::Reader& reader);
+
+  ~Lz4Decompressor() override;
+
+  size_t read(void* data, size_t count) override;
+  void finalize() override;
+
+private:
+  core::Reader& m_reader;
+  char m_input_buffer[CCACHE_READ_BUFFER_SIZE];
+  size_t m_input_size;
+  size_t m_input_consumed;
+  LZ4F_dctx_s* m_lz4_context;
+  bool m_reached_stream_end;
+};
+
+} // namespace compression
@@ -38,6 +38,11 @@ NullCompressor::write(const void* const data, const size_t count)
   m_writer.write(data, count);
 }
 
+void
+NullCompressor::end_frame()
+{
+}
+
 void
 NullCompressor::finalize()
 {
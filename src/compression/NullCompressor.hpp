@@ -32,6 +32,7 @@ public:
 
   int8_t actual_compression_level() const override;
   void write(const void* data, size_t count) override;
+  void end_frame() override;
   void finalize() override;
 
 private:
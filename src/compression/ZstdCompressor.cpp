@@ -21,15 +21,32 @@
 #include "Logging.hpp"
 #include "assertions.hpp"
 
+#include <compression/dictionary.hpp>
 #include <core/exceptions.hpp>
 
 #include <zstd.h>
 
 #include <algorithm>
+#include <thread>
 
 namespace compression {
 
-ZstdCompressor::ZstdCompressor(core::Writer& writer, int8_t compression_level)
+namespace {
+
+// Input of at least this size is compressed using worker threads and long
+// distance matching. zstd splits input into jobs of several MiB, so smaller
+// input won't benefit. Note that cache entries are compressed in frames of at
+// most 64 MiB, so this must be well below that.
+const uint64_t k_min_large_input_size = 16 * 1024 * 1024;
+
+uint32_t g_max_threads = 1;
+
+} // namespace
+
+ZstdCompressor::ZstdCompressor(core::Writer& writer,
+                               int8_t compression_level,
+                               const uint32_t dictionary_id,
+                               const uint64_t input_size_hint)
   : m_writer(writer),
     m_zstd_stream(ZSTD_createCStream()),
     m_zstd_in(std::make_unique<ZSTD_inBuffer_s>()),
@@ -63,6 +80,23 @@ ZstdCompressor::ZstdCompressor(core::Writer& writer, int8_t compression_level)
     ZSTD_freeCStream(m_zstd_stream);
     throw core::Error("error initializing zstd compression stream");
   }
+
+  set_parameters_for_input_size(input_size_hint);
+
+  if (dictionary_id != 0) {
+    try {
+      const auto& dictionary = get_dictionary(dictionary_id);
+      ret = ZSTD_CCtx_loadDictionary(
+        m_zstd_stream, dictionary.data(), dictionary.size());
+      if (ZSTD_isError(ret)) {
+        throw core::Error("error loading zstd compression dictionary {}",
+                          dictionary_id);
+      }
+    } catch (const core::Error&) {
+      ZSTD_freeCStream(m_zstd_stream);
+      throw;
+    }
+  }
 }
 
 ZstdCompressor::~ZstdCompressor()
@@ -70,6 +104,44 @@ ZstdCompressor::~ZstdCompressor()
   ZSTD_freeCStream(m_zstd_stream);
 }
 
+void
+ZstdCompressor::set_max_threads(const uint32_t threads)
+{
+  // More threads than cores would only add overhead.
+  const uint32_t cores = std::thread::hardware_concurrency();
+  g_max_threads = cores > 0 ? std::min(threads, cores) : threads;
+}
+
+void
+ZstdCompressor::set_parameters_for_input_size(const uint64_t input_size)
+{
+  if (input_size < k_min_large_input_size) {
+    return;
+  }
+
+  if (g_max_threads > 1) {
+    // The calling thread mostly waits for the workers, so spend the whole
+    // thread budget on workers.
+    const size_t ret = ZSTD_CCtx_setParameter(
+      m_zstd_stream, ZSTD_c_nbWorkers, static_cast<int>(g_max_threads));
+    if (ZSTD_isError(ret)) {
+      LOG("Not using zstd worker threads: {}", ZSTD_getErrorName(ret));
+    } else {
+      LOG("Using {} zstd worker threads", g_max_threads);
+    }
+  }
+
+  // The default window size for long distance matching (128 MiB) is still
+  // accepted by decompressors without special configuration.
+  const size_t ret =
+    ZSTD_CCtx_setParameter(m_zstd_stream, ZSTD_c_enableLongDistanceMatching, 1);
+  if (ZSTD_isError(ret)) {
+    LOG("Not using zstd long distance matching: {}", ZSTD_getErrorName(ret));
+  } else {
+    LOG_RAW("Using zstd long distance matching");
+  }
+}
+
 int8_t
 ZstdCompressor::actual_compression_level() const
 {
@@ -113,9 +185,16 @@ ZstdCompressor::write(const void* const data, const size_t count)
 }
 
 void
-ZstdCompressor::finalize()
+ZstdCompressor::end_frame()
 {
+  // The compression parameters and dictionary are kept for the next frame.
   write(nullptr, 0);
+}
+
+void
+ZstdCompressor::finalize()
+{
+  end_frame();
   m_writer.finalize();
 }
 
@@ -35,22 +35,31 @@ namespace compression {
 class ZstdCompressor : public Compressor, NonCopyable
 {
 public:
-  ZstdCompressor(core::Writer& writer, int8_t compression_level);
+  ZstdCompressor(core::Writer& writer,
+                 int8_t compression_level,
+                 uint32_t dictionary_id = 0,
+                 uint64_t input_size_hint = 0);
 
   ~ZstdCompressor() override;
 
   int8_t actual_compression_level() const override;
   void write(const void* data, size_t count) override;
+  void end_frame() override;
   void finalize() override;
 
   constexpr static uint8_t default_compression_level = 1;
 
+  // Set the maximum number of threads to use when compressing large input.
+  static void set_max_threads(uint32_t threads);
+
 private:
   core::Writer& m_writer;
   ZSTD_CCtx_s* m_zstd_stream;
   std::unique_ptr<ZSTD_inBuffer_s> m_zstd_in;
   std::unique_ptr<ZSTD_outBuffer_s> m_zstd_out;
   int8_t m_compression_level;
+
+  void set_parameters_for_input_size(uint64_t input_size);
 };
 
 } // namespace compression
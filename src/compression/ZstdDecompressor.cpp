@@ -20,16 +20,19 @@
 
 #include "assertions.hpp"
 
+#include <compression/dictionary.hpp>
 #include <core/exceptions.hpp>
 
 namespace compression {
 
-ZstdDecompressor::ZstdDecompressor(core::Reader& reader)
+ZstdDecompressor::ZstdDecompressor(core::Reader& reader,
+                                   const uint32_t dictionary_id)
   : m_reader(reader),
     m_input_size(0),
     m_input_consumed(0),
     m_zstd_stream(ZSTD_createDStream()),
-    m_reached_stream_end(false)
+    m_reached_stream_end(false),
+    m_dictionary_id_to_load(dictionary_id)
 {
   const size_t ret = ZSTD_initDStream(m_zstd_stream);
   if (ZSTD_isError(ret)) {
@@ -46,6 +49,10 @@ ZstdDecompressor::~ZstdDecompressor()
 size_t
 ZstdDecompressor::read(void* const data, const size_t count)
 {
+  if (m_dictionary_id_to_load != 0) {
+    load_dictionary();
+  }
+
   size_t bytes_read = 0;
   while (bytes_read < count) {
     ASSERT(m_input_size >= m_input_consumed);
@@ -77,6 +84,19 @@ ZstdDecompressor::read(void* const data, const size_t count)
   return count;
 }
 
+void
+ZstdDecompressor::load_dictionary()
+{
+  const auto& dictionary = get_dictionary(m_dictionary_id_to_load);
+  const size_t ret = ZSTD_DCtx_loadDictionary(
+    m_zstd_stream, dictionary.data(), dictionary.size());
+  if (ZSTD_isError(ret)) {
+    throw core::Error("Failed to load zstd dictionary {}",
+                      m_dictionary_id_to_load);
+  }
+  m_dictionary_id_to_load = 0;
+}
+
 void
 ZstdDecompressor::finalize()
 {
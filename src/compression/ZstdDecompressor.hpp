@@ -30,7 +30,9 @@ namespace compression {
 class ZstdDecompressor : public Decompressor
 {
 public:
-  explicit ZstdDecompressor(core::Reader& reader);
+  // The dictionary with ID `dictionary_id` (0 for none) is loaded lazily so
+  // that a decompressor can be created without the dictionary being present.
+  explicit ZstdDecompressor(core::Reader& reader, uint32_t dictionary_id = 0);
 
   ~ZstdDecompressor() override;
 
@@ -46,6 +48,9 @@ private:
   ZSTD_inBuffer m_zstd_in;
   ZSTD_outBuffer m_zstd_out;
   bool m_reached_stream_end;
+  uint32_t m_dictionary_id_to_load;
+
+  void load_dictionary();
 };
 
 } // namespace compression
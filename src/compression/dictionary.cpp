@@ -0,0 +1,207 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "dictionary.hpp"
+
+#include <AtomicFile.hpp>
+#include <Config.hpp>
+#include <Logging.hpp>
+#include <Util.hpp>
+#include <core/exceptions.hpp>
+#include <fmtmacros.hpp>
+#include <util/string.hpp>
+
+#include <third_party/nonstd/optional.hpp>
+#include <zdict.h>
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+// Same as the default maximum dictionary size of the zstd command line tool.
+const size_t k_max_dictionary_size = 112640;
+
+const size_t k_min_dictionary_size = 1024;
+
+std::mutex g_mutex;
+std::string g_dictionary_dir;
+nonstd::optional<uint32_t> g_active_id;
+std::unordered_map<uint32_t, std::string> g_dictionaries;
+
+std::string
+get_dictionary_dir(const Config& config)
+{
+  return FMT("{}/dictionaries", config.cache_dir());
+}
+
+std::string
+get_dictionary_path(const std::string& dictionary_dir, const uint32_t id)
+{
+  return FMT("{}/{}.zdict", dictionary_dir, id);
+}
+
+// Return the dictionary with ID `id`, loading it if needed. Must be called with
+// g_mutex held.
+const std::string&
+load_dictionary(const uint32_t id)
+{
+  const auto it = g_dictionaries.find(id);
+  if (it != g_dictionaries.end()) {
+    return it->second;
+  }
+
+  if (g_dictionary_dir.empty()) {
+    throw core::Error("Compression dictionary {} not available", id);
+  }
+  const auto path = get_dictionary_path(g_dictionary_dir, id);
+  std::string dictionary;
+  try {
+    dictionary = Util::read_file(path);
+  } catch (const core::Error& e) {
+    throw core::Error(
+      "Failed to read compression dictionary {}: {}", id, e.what());
+  }
+  LOG("Loaded compression dictionary {}", path);
+  return g_dictionaries.emplace(id, std::move(dictionary)).first->second;
+}
+
+// Must be called with g_mutex held.
+uint32_t
+read_active_id()
+{
+  if (g_dictionary_dir.empty()) {
+    return 0;
+  }
+
+  std::string content;
+  try {
+    content = Util::read_file(FMT("{}/active", g_dictionary_dir));
+  } catch (const core::Error&) {
+    // No dictionary has been trained.
+    return 0;
+  }
+
+  const auto id = util::parse_unsigned(
+    util::strip_whitespace(content), 1, UINT32_MAX, "dictionary ID");
+  if (!id) {
+    LOG("Not using compression dictionary: {}", id.error());
+    return 0;
+  }
+  try {
+    load_dictionary(*id);
+  } catch (const core::Error& e) {
+    LOG("Not using compression dictionary: {}", e.what());
+    return 0;
+  }
+  return *id;
+}
+
+} // namespace
+
+namespace compression {
+
+void
+init_dictionaries(const Config& config)
+{
+  std::lock_guard<std::mutex> lock(g_mutex);
+
+  const auto dictionary_dir = get_dictionary_dir(config);
+  if (dictionary_dir != g_dictionary_dir) {
+    g_dictionary_dir = dictionary_dir;
+    g_active_id = nonstd::nullopt;
+    g_dictionaries.clear();
+  }
+}
+
+uint32_t
+dictionary_id_for_new_entry(const uint64_t entry_size)
+{
+  if (entry_size > k_max_dictionary_entry_size) {
+    return 0;
+  }
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (!g_active_id) {
+    g_active_id = read_active_id();
+  }
+  return *g_active_id;
+}
+
+const std::string&
+get_dictionary(const uint32_t id)
+{
+  std::lock_guard<std::mutex> lock(g_mutex);
+  return load_dictionary(id);
+}
+
+std::string
+train_dictionary(const std::string& samples,
+                 const std::vector<size_t>& sample_sizes)
+{
+  // zstd recommends using about 100 times more sample data than the dictionary
+  // size.
+  std::string dictionary(
+    std::min(k_max_dictionary_size,
+             std::max(samples.size() / 100, k_min_dictionary_size)),
+    '\0');
+  const size_t ret = ZDICT_trainFromBuffer(&dictionary[0],
+                                           dictionary.size(),
+                                           samples.data(),
+                                           sample_sizes.data(),
+                                           sample_sizes.size());
+  if (ZDICT_isError(ret)) {
+    throw core::Error("Failed to train dictionary from {} samples: {}",
+                      sample_sizes.size(),
+                      ZDICT_getErrorName(ret));
+  }
+  dictionary.resize(ret);
+  return dictionary;
+}
+
+uint32_t
+store_dictionary(const Config& config, const std::string& dictionary)
+{
+  const uint32_t id = ZDICT_getDictID(dictionary.data(), dictionary.size());
+  if (id == 0) {
+    throw core::Error("Invalid compression dictionary");
+  }
+
+  const auto dictionary_dir = get_dictionary_dir(config);
+  Util::ensure_dir_exists(dictionary_dir);
+
+  AtomicFile dictionary_file(get_dictionary_path(dictionary_dir, id),
+                             AtomicFile::Mode::binary);
+  dictionary_file.write(dictionary);
+  dictionary_file.commit();
+
+  AtomicFile active_file(FMT("{}/active", dictionary_dir),
+                         AtomicFile::Mode::text);
+  active_file.write(FMT("{}\n", id));
+  active_file.commit();
+
+  std::lock_guard<std::mutex> lock(g_mutex);
+  if (dictionary_dir == g_dictionary_dir) {
+    g_active_id = nonstd::nullopt;
+  }
+
+  return id;
+}
+
+} // namespace compression
@@ -0,0 +1,57 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Config;
+
+// Zstandard dictionaries created by `--train-dictionary` are stored as
+// <cache_dir>/dictionaries/<id>.zdict. New cache entries are compressed with
+// the dictionary whose ID is stored in <cache_dir>/dictionaries/active.
+
+namespace compression {
+
+// Only entries up to this size are compressed with a dictionary since larger
+// entries compress well enough on their own.
+const uint64_t k_max_dictionary_entry_size = 128 * 1024;
+
+// Set up dictionary lookup in the cache directory of `config`. Does not throw.
+void init_dictionaries(const Config& config);
+
+// Return the ID of the dictionary that a new entry of size `entry_size` should
+// be compressed with, or 0 if no dictionary should be used. Does not throw.
+uint32_t dictionary_id_for_new_entry(uint64_t entry_size);
+
+// Return the content of the dictionary with ID `id`. Throws core::Error if the
+// dictionary can't be read.
+const std::string& get_dictionary(uint32_t id);
+
+// Train a dictionary from `samples`, which consists of concatenated samples of
+// sizes `sample_sizes`. Throws core::Error on error.
+std::string train_dictionary(const std::string& samples,
+                             const std::vector<size_t>& sample_sizes);
+
+// Store `dictionary` in the cache directory of `config` and make it the active
+// dictionary. Returns the dictionary ID. Throws core::Error on error.
+uint32_t store_dictionary(const Config& config, const std::string& dictionary);
+
+} // namespace compression
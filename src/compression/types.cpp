@@ -18,23 +18,144 @@
 
 #include "types.hpp"
 
+#include "ZstdCompressor.hpp"
+#include "dictionary.hpp"
+
+#ifdef HAVE_LZ4_COMPRESSION
+#  include "Lz4Compressor.hpp"
+#endif
+
 #include <Config.hpp>
 #include <Context.hpp>
+#include <Logging.hpp>
 #include <assertions.hpp>
 #include <core/exceptions.hpp>
 
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
 namespace compression {
 
+namespace {
+
+// Entries up to this size are compressed in about a millisecond even at
+// k_small_entry_level, so spending more CPU time on them is cheap.
+const uint64_t k_max_small_entry_size = 64 * 1024;
+
+// Level used for small entries. Both zstd and LZ4 (which selects LZ4HC) accept
+// it.
+const int8_t k_small_entry_level = 9;
+
+// Level used for other entries when the system is busy. For zstd this selects
+// the first of the fast negative levels and for LZ4 an acceleration factor of
+// 2.
+const int8_t k_busy_level = -1;
+
+// Level used for cold large entries, i.e. entries that have survived in the
+// cache without being used for a while. They are only recompressed by
+// --recompress, so the extra compression time is not paid by a build. Both
+// zstd and LZ4 accept it.
+const int8_t k_cold_entry_level = 12;
+
+} // namespace
+
+void
+init(const Config& config)
+{
+  init_dictionaries(config);
+  ZstdCompressor::set_max_threads(config.compression_threads());
+}
+
 int8_t
 level_from_config(const Config& config)
 {
   return config.compression() ? config.compression_level() : 0;
 }
 
+int8_t
+default_level(const Type type)
+{
+  switch (type) {
+  case Type::none:
+    return 0;
+
+  case Type::zstd:
+    return ZstdCompressor::default_compression_level;
+
+  case Type::lz4:
+#ifdef HAVE_LZ4_COMPRESSION
+    return Lz4Compressor::default_compression_level;
+#else
+    return 0;
+#endif
+  }
+
+  ASSERT(false);
+}
+
+int8_t
+level_for_entry(const Config& config, const uint64_t entry_size)
+{
+  const int8_t level = level_from_config(config);
+  if (!config.compression() || !config.adaptive_compression()) {
+    return level;
+  }
+
+  const Type type = type_from_config(config);
+  const int8_t base_level = level == 0 ? default_level(type) : level;
+  const int8_t adapted_level =
+    adaptive_level(type, base_level, entry_size, is_system_busy(), false);
+  if (adapted_level != base_level) {
+    LOG("Using adaptive compression level {} instead of {} for {} bytes",
+        adapted_level,
+        base_level,
+        entry_size);
+  }
+  return adapted_level;
+}
+
+int8_t
+adaptive_level(const Type type,
+               const int8_t level,
+               const uint64_t entry_size,
+               const bool system_busy,
+               const bool cold_entry)
+{
+  if (type == Type::none) {
+    return level;
+  } else if (entry_size <= k_max_small_entry_size) {
+    return std::max(level, k_small_entry_level);
+  } else if (cold_entry) {
+    return std::max(level, k_cold_entry_level);
+  } else if (system_busy) {
+    return std::min(level, k_busy_level);
+  } else {
+    return level;
+  }
+}
+
+bool
+is_system_busy()
+{
+  static const bool busy = [] {
+#ifdef HAVE_GETLOADAVG
+    double load;
+    const unsigned int cpus = std::thread::hardware_concurrency();
+    if (cpus > 0 && getloadavg(&load, 1) == 1) {
+      LOG("Load average: {:.2f} ({} CPUs)", load, cpus);
+      return load >= cpus;
+    }
+#endif
+    return false;
+  }();
+  return busy;
+}
+
 Type
 type_from_config(const Config& config)
 {
-  return config.compression() ? Type::zstd : Type::none;
+  return config.compression() ? config.compression_type() : Type::none;
 }
 
 Type
@@ -46,11 +167,45 @@ type_from_int(const uint8_t type)
 
   case static_cast<uint8_t>(Type::zstd):
     return Type::zstd;
+
+  case static_cast<uint8_t>(Type::lz4):
+    return Type::lz4;
   }
 
   throw core::Error("Unknown type: {}", type);
 }
 
+Type
+type_from_string(const std::string& type)
+{
+  if (type == "zstd") {
+    return Type::zstd;
+  } else if (type == "lz4") {
+    return Type::lz4;
+  }
+
+  throw core::Error("unknown compression type: {}", type);
+}
+
+bool
+is_supported(const Type type)
+{
+  switch (type) {
+  case Type::none:
+  case Type::zstd:
+    return true;
+
+  case Type::lz4:
+#ifdef HAVE_LZ4_COMPRESSION
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  ASSERT(false);
+}
+
 std::string
 type_to_string(const Type type)
 {
@@ -60,6 +215,9 @@ type_to_string(const Type type)
 
   case Type::zstd:
     return "zstd";
+
+  case Type::lz4:
+    return "lz4";
   }
 
   ASSERT(false);
@@ -28,14 +28,49 @@ namespace compression {
 enum class Type : uint8_t {
   none = 0,
   zstd = 1,
+  lz4 = 2,
 };
 
+// Set up process-wide compression state from `config`. Does not throw.
+void init(const Config& config);
+
 int8_t level_from_config(const Config& config);
 
+// Return the level that compression level 0 ("default") means for `type`.
+int8_t default_level(Type type);
+
+// Return the compression level to use for a new cache entry with uncompressed
+// size `entry_size`. This is level_from_config unless adaptive_compression is
+// enabled, in which case the level is adjusted by adaptive_level.
+int8_t level_for_entry(const Config& config, uint64_t entry_size);
+
+// Adjust the (non-default) compression level `level` of `type` for an entry
+// of `entry_size` bytes: small entries, for which compression time is
+// negligible, and large entries that are `cold_entry` (not used for a while)
+// get at least a high level, and other entries get at most a fast level if
+// `system_busy` is true.
+int8_t adaptive_level(Type type,
+                      int8_t level,
+                      uint64_t entry_size,
+                      bool system_busy,
+                      bool cold_entry);
+
+// Return whether the system is busy enough (load average at least the number
+// of CPUs) that compression should be kept cheap. The result is computed once
+// per process.
+bool is_system_busy();
+
 Type type_from_config(const Config& config);
 
 Type type_from_int(uint8_t type);
 
+// Parse a compression type name as used in the configuration. Throws
+// core::Error on unknown names.
+Type type_from_string(const std::string& type);
+
+// Return whether this ccache build can compress and decompress `type`.
+bool is_supported(Type type);
+
 std::string type_to_string(Type type);
 
 } // namespace compression
@@ -50,6 +50,7 @@ CacheEntryHeader::CacheEntryHeader(const core::CacheEntryType entry_type_,
     entry_type(entry_type_),
     compression_type(compression_type_),
     compression_level(compression_level_),
+    compression_dictionary_id(0),
     creation_time(creation_time_),
     ccache_version(ccache_version_),
     namespace_(namespace_arg),
@@ -82,6 +83,7 @@ CacheEntryHeader::inspect(FILE* const stream) const
         "Compression type: {}\n",
         compression::type_to_string(compression_type));
   PRINT(stream, "Compression level: {}\n", compression_level);
+  PRINT(stream, "Compression dictionary: {}\n", compression_dictionary_id);
   PRINT(stream, "Creation time: {}\n", creation_time);
   PRINT(stream, "Ccache version: {}\n", ccache_version);
   PRINT(stream, "Namespace: {}\n", namespace_);
@@ -91,8 +93,10 @@ CacheEntryHeader::inspect(FILE* const stream) const
 size_t
 CacheEntryHeader::non_payload_size() const
 {
-  return k_static_header_fields_size + ccache_version.length()
-         + namespace_.length() + k_static_epilogue_fields_size;
+  return k_static_header_fields_size
+         + (entry_format_version >= 1 ? sizeof(compression_dictionary_id) : 0)
+         + ccache_version.length() + namespace_.length()
+         + k_static_epilogue_fields_size;
 }
 
 } // namespace core
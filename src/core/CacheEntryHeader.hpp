@@ -26,33 +26,54 @@
 //
 // Integers are big-endian.
 //
-// <entry>            ::= <header> <payload> <epilogue>
+// <entry>            ::= <header> <payload> <epilogue>  ; format version 0-1
+// <entry>            ::= <header> <frame>* <end_of_frames> <epilogue>
 // <header>           ::= <magic> <format_ver> <entry_type> <compr_type>
-//                        <compr_level> <creation_time> <ccache_ver> <namespace>
-//                        <entry_size>
+//                        <compr_level> <compr_dict_id> <creation_time>
+//                        <ccache_ver> <namespace> <entry_size>
 // <magic>            ::= uint16_t (0xccac)
 // <format_ver>       ::= uint8_t
 // <entry_type>       ::= <result_entry> | <manifest_entry>
 // <result_entry>     ::= 0 (uint8_t)
 // <manifest_entry>   ::= 1 (uint8_t)
-// <compr_type>       ::= <compr_none> | <compr_zstd>
+// <compr_type>       ::= <compr_none> | <compr_zstd> | <compr_lz4>
 // <compr_none>       ::= 0 (uint8_t)
 // <compr_zstd>       ::= 1 (uint8_t)
+// <compr_lz4>        ::= 2 (uint8_t)
 // <compr_level>      ::= int8_t
+// <compr_dict_id>    ::= uint32_t ; ID of zstd dictionary or 0 for none; not
+//                                   present in format version 0
 // <creation_time>    ::= uint64_t (Unix epoch time when entry was created)
 // <ccache_ver>       ::= string length (uint8_t) + string data
 // <namespace>        ::= string length (uint8_t) + string data
-// <entry_size>       ::= uint64_t ; = size of file if stored uncompressed
-// ; potentially compressed from here
+// <entry_size>       ::= uint64_t ; = size of file if stored uncompressed,
+//                                   not counting frame headers
+// ; potentially compressed from here in format version 0-1
 // <payload>          ::= depends on entry_type
 // <epilogue>         ::= <checksum_high> <checksum_low>
 // <checksum_high>    ::= uint64_t ; XXH3-128 (high bits) of entry bytes
 // <checksum_low>     ::= uint64_t ; XXH3-128 (low bits) of entry bytes
+//
+// From format version 2, the payload is split into frames which are
+// compressed independently of each other so that a reader can skip parts of
+// the payload without decompressing them. The epilogue is stored
+// uncompressed and its checksum covers the entry bytes as stored, i.e. the
+// header and the frames including their compressed data, so that it can be
+// verified even if frames are skipped. In format version 0-1, the checksum
+// covers the uncompressed entry bytes.
+//
+// <frame>            ::= <frame_size> <frame_compr_size> <frame_checksum>
+//                        <frame_data>
+// <frame_size>       ::= uint64_t ; size of uncompressed frame data, not 0
+// <frame_compr_size> ::= uint64_t ; size of frame_data
+// <frame_checksum>   ::= uint64_t ; XXH3-64 of uncompressed frame data
+// <frame_data>       ::= frame_compr_size bytes ; compressed part of payload
+// <end_of_frames>    ::= 0 (uint64_t)
 
 namespace core {
 
 const uint16_t k_ccache_magic = 0xccac;
-const uint16_t k_entry_format_version = 0;
+const uint16_t k_entry_format_version = 2;
 
 struct CacheEntryHeader
 {
@@ -69,6 +90,8 @@ struct CacheEntryHeader
   core::CacheEntryType entry_type;
   compression::Type compression_type;
   int8_t compression_level;
+  // When writing, CacheEntryWriter chooses the dictionary.
+  uint32_t compression_dictionary_id;
   uint64_t creation_time;
   std::string ccache_version;
   std::string namespace_;
@@ -18,7 +18,12 @@
 
 #include "CacheEntryReader.hpp"
 
+#include <core/StringReader.hpp>
+#include <core/StringWriter.hpp>
 #include <core/exceptions.hpp>
+#include <util/XXH3_64.hpp>
+
+#include <algorithm>
 
 namespace {
 
@@ -41,8 +46,259 @@ cache_entry_type_from_int(const uint8_t entry_type)
 
 namespace core {
 
+// Reader of a payload split into frames as described in CacheEntryHeader.hpp.
+class CacheEntryReader::FrameReader : public Reader
+{
+public:
+  FrameReader(Reader& reader,
+              compression::Type compression_type,
+              uint32_t dictionary_id);
+
+  size_t read(void* data, size_t count) override;
+  void skip(uint64_t count) override;
+
+  // Return the number of bytes left in the current frame, 0 if there are no
+  // more frames.
+  uint64_t bytes_left_in_frame() const;
+
+  // Read the frames holding the next `count` bytes in raw form, returning
+  // them as a complete frame sequence including the terminator.
+  std::string read_raw_frames(uint64_t count);
+
+  // Check that all frames have been consumed. Throws `core::Error` if not.
+  void finalize();
+
+private:
+  // Reader that stops at the end of the current frame's data.
+  class FrameDataReader : public Reader
+  {
+  public:
+    FrameDataReader(Reader& reader);
+
+    size_t read(void* data, size_t count) override;
+
+    void set_size(uint64_t size);
+    uint64_t bytes_left() const;
+
+  private:
+    Reader& m_reader;
+    uint64_t m_bytes_left = 0;
+  };
+
+  Reader& m_reader;
+  const compression::Type m_compression_type;
+  const uint32_t m_dictionary_id;
+  FrameDataReader m_frame_data_reader;
+  std::unique_ptr<compression::Decompressor> m_decompressor;
+  uint64_t m_frame_bytes_left = 0;
+  uint64_t m_expected_frame_checksum = 0;
+  util::XXH3_64 m_frame_checksum;
+
+  void read_frame_header();
+  void end_frame();
+};
+
+CacheEntryReader::FrameReader::FrameDataReader::FrameDataReader(Reader& reader)
+  : m_reader(reader)
+{
+}
+
+size_t
+CacheEntryReader::FrameReader::FrameDataReader::read(void* const data,
+                                                     const size_t count)
+{
+  if (count > 0 && m_bytes_left == 0) {
+    throw core::Error("Read past end of frame");
+  }
+  const auto bytes_read =
+    m_reader.read(data, std::min(static_cast<uint64_t>(count), m_bytes_left));
+  m_bytes_left -= bytes_read;
+  return bytes_read;
+}
+
+void
+CacheEntryReader::FrameReader::FrameDataReader::set_size(const uint64_t size)
+{
+  m_bytes_left = size;
+}
+
+uint64_t
+CacheEntryReader::FrameReader::FrameDataReader::bytes_left() const
+{
+  return m_bytes_left;
+}
+
+CacheEntryReader::FrameReader::FrameReader(
+  Reader& reader,
+  const compression::Type compression_type,
+  const uint32_t dictionary_id)
+  : m_reader(reader),
+    m_compression_type(compression_type),
+    m_dictionary_id(dictionary_id),
+    m_frame_data_reader(reader)
+{
+  read_frame_header();
+}
+
+void
+CacheEntryReader::FrameReader::read_frame_header()
+{
+  m_decompressor.reset();
+  m_frame_checksum.reset();
+  m_frame_bytes_left = m_reader.read_int<uint64_t>();
+  if (m_frame_bytes_left == 0) {
+    // End of frames.
+    m_frame_data_reader.set_size(0);
+    return;
+  }
+  m_frame_data_reader.set_size(m_reader.read_int<uint64_t>());
+  m_expected_frame_checksum = m_reader.read_int<uint64_t>();
+}
+
+void
+CacheEntryReader::FrameReader::end_frame()
+{
+  m_decompressor->finalize();
+  if (m_frame_data_reader.bytes_left() > 0) {
+    throw core::Error("Garbage data at end of frame");
+  }
+  const auto actual_checksum = m_frame_checksum.digest();
+  if (actual_checksum != m_expected_frame_checksum) {
+    throw core::Error(
+      "Incorrect frame checksum (actual {:016x}, expected {:016x})",
+      actual_checksum,
+      m_expected_frame_checksum);
+  }
+  read_frame_header();
+}
+
+size_t
+CacheEntryReader::FrameReader::read(void* const data, const size_t count)
+{
+  auto* bytes = static_cast<uint8_t*>(data);
+  size_t bytes_read = 0;
+  while (bytes_read < count && m_frame_bytes_left > 0) {
+    if (!m_decompressor) {
+      m_decompressor = compression::Decompressor::create_from_type(
+        m_compression_type, m_frame_data_reader, m_dictionary_id);
+    }
+    const size_t n = std::min(static_cast<uint64_t>(count - bytes_read),
+                              m_frame_bytes_left);
+    m_decompressor->read(bytes + bytes_read, n);
+    m_frame_checksum.update(bytes + bytes_read, n);
+    bytes_read += n;
+    m_frame_bytes_left -= n;
+    if (m_frame_bytes_left == 0) {
+      end_frame();
+    }
+  }
+  if (count > 0 && bytes_read == 0) {
+    throw core::Error("Read past end of payload");
+  }
+  return bytes_read;
+}
+
+void
+CacheEntryReader::FrameReader::skip(uint64_t count)
+{
+  while (count > 0) {
+    if (m_frame_bytes_left == 0) {
+      throw core::Error("Skip past end of payload");
+    }
+    if (!m_decompressor && count >= m_frame_bytes_left) {
+      // Skip the whole frame without decompressing it. The frame data is still
+      // read by `m_reader` so that the checksum of the entry can be verified.
+      m_reader.skip(m_frame_data_reader.bytes_left());
+      count -= m_frame_bytes_left;
+      read_frame_header();
+    } else {
+      uint8_t buffer[CCACHE_READ_BUFFER_SIZE];
+      count -=
+        read(buffer, std::min(count, static_cast<uint64_t>(sizeof(buffer))));
+    }
+  }
+}
+
+uint64_t
+CacheEntryReader::FrameReader::bytes_left_in_frame() const
+{
+  return m_frame_bytes_left;
+}
+
+std::string
+CacheEntryReader::FrameReader::read_raw_frames(uint64_t count)
+{
+  std::string frames;
+  StringWriter frames_writer(frames);
+  while (count > 0) {
+    if (m_decompressor || m_frame_bytes_left > count) {
+      throw core::Error("Payload data doesn't end at a frame boundary");
+    }
+    if (m_frame_bytes_left == 0) {
+      throw core::Error("Read past end of payload");
+    }
+    const uint64_t compressed_size = m_frame_data_reader.bytes_left();
+    frames_writer.write_int(m_frame_bytes_left);
+    frames_writer.write_int(compressed_size);
+    frames_writer.write_int(m_expected_frame_checksum);
+    const size_t data_start = frames.size();
+    frames.resize(data_start + compressed_size);
+    size_t bytes_read = 0;
+    while (bytes_read < compressed_size) {
+      bytes_read += m_reader.read(&frames[data_start + bytes_read],
+                                  compressed_size - bytes_read);
+    }
+    count -= m_frame_bytes_left;
+    read_frame_header();
+  }
+  frames_writer.write_int<uint64_t>(0);
+  return frames;
+}
+
+void
+CacheEntryReader::FrameReader::finalize()
+{
+  if (m_frame_bytes_left > 0) {
+    throw core::Error("Unread payload data");
+  }
+}
+
+// Reader of frames detached from a CacheEntryReader.
+class CacheEntryReader::DetachedPayloadReader : public Reader
+{
+public:
+  DetachedPayloadReader(std::string frames,
+                        compression::Type compression_type,
+                        uint32_t dictionary_id);
+
+  size_t read(void* data, size_t count) override;
+
+private:
+  const std::string m_frames;
+  StringReader m_frames_reader;
+  FrameReader m_frame_reader;
+};
+
+CacheEntryReader::DetachedPayloadReader::DetachedPayloadReader(
+  std::string frames,
+  const compression::Type compression_type,
+  const uint32_t dictionary_id)
+  : m_frames(std::move(frames)),
+    m_frames_reader(m_frames),
+    m_frame_reader(m_frames_reader, compression_type, dictionary_id)
+{
+}
+
+size_t
+CacheEntryReader::DetachedPayloadReader::read(void* const data,
+                                              const size_t count)
+{
+  return m_frame_reader.read(data, count);
+}
+
 CacheEntryReader::CacheEntryReader(core::Reader& reader)
-  : m_checksumming_reader(reader)
+  : m_reader(reader),
+    m_checksumming_reader(reader)
 {
   const auto magic = m_checksumming_reader.read_int<uint16_t>();
   if (magic != core::k_ccache_magic) {
@@ -50,13 +306,15 @@ CacheEntryReader::CacheEntryReader(core::Reader& reader)
   }
 
   const auto entry_format_version = m_checksumming_reader.read_int<uint8_t>();
-  if (entry_format_version != core::k_entry_format_version) {
+  if (entry_format_version > core::k_entry_format_version) {
     throw core::Error("Unknown entry format version: {}", entry_format_version);
   }
 
   const auto entry_type = m_checksumming_reader.read_int<uint8_t>();
   const auto compression_type = m_checksumming_reader.read_int<uint8_t>();
   const auto compression_level = m_checksumming_reader.read_int<int8_t>();
+  const auto compression_dictionary_id =
+    entry_format_version >= 1 ? m_checksumming_reader.read_int<uint32_t>() : 0;
   const auto creation_time = m_checksumming_reader.read_int<uint64_t>();
   const auto ccache_version =
     m_checksumming_reader.read_str(m_checksumming_reader.read_int<uint8_t>());
@@ -72,16 +330,71 @@ CacheEntryReader::CacheEntryReader(core::Reader& reader)
     ccache_version,
     tag,
     entry_size);
+  m_header->entry_format_version = entry_format_version;
+  m_header->compression_dictionary_id = compression_dictionary_id;
 
-  m_decompressor = compression::Decompressor::create_from_type(
-    m_header->compression_type, reader);
-  m_checksumming_reader.set_reader(*m_decompressor);
+  if (entry_format_version >= 2) {
+    // The checksum covers the stored frames so that it can be verified without
+    // decompressing skipped or detached frames.
+    m_frame_reader = std::make_unique<FrameReader>(m_checksumming_reader,
+                                                   m_header->compression_type,
+                                                   compression_dictionary_id);
+  } else {
+    m_decompressor = compression::Decompressor::create_from_type(
+      m_header->compression_type, reader, compression_dictionary_id);
+    m_checksumming_reader.set_reader(*m_decompressor);
+  }
 }
 
+CacheEntryReader::~CacheEntryReader() = default;
+
 size_t
 CacheEntryReader::read(void* const data, const size_t count)
 {
-  return m_checksumming_reader.read(data, count);
+  const auto bytes_read = m_frame_reader
+                            ? m_frame_reader->read(data, count)
+                            : m_checksumming_reader.read(data, count);
+  m_payload_bytes_read += bytes_read;
+  return bytes_read;
+}
+
+void
+CacheEntryReader::skip(const uint64_t count)
+{
+  if (m_frame_reader) {
+    m_frame_reader->skip(count);
+    m_payload_bytes_read += count;
+  } else {
+    // Read the data so that the checksum can still be verified.
+    Reader::skip(count);
+  }
+}
+
+uint64_t
+CacheEntryReader::bytes_left_in_frame() const
+{
+  if (m_frame_reader) {
+    return m_frame_reader->bytes_left_in_frame();
+  } else {
+    const auto payload_size = m_header->payload_size();
+    return payload_size > m_payload_bytes_read
+             ? payload_size - m_payload_bytes_read
+             : 0;
+  }
+}
+
+std::unique_ptr<Reader>
+CacheEntryReader::detach_payload(const uint64_t count)
+{
+  if (!m_frame_reader) {
+    return nullptr;
+  }
+  auto frames = m_frame_reader->read_raw_frames(count);
+  m_payload_bytes_read += count;
+  return std::make_unique<DetachedPayloadReader>(
+    std::move(frames),
+    m_header->compression_type,
+    m_header->compression_dictionary_id);
 }
 
 void
@@ -89,7 +402,14 @@ CacheEntryReader::finalize()
 {
   const util::XXH3_128::Digest actual = m_checksumming_reader.digest();
   util::XXH3_128::Digest expected;
-  m_decompressor->read(expected.bytes(), expected.size());
+  if (m_frame_reader) {
+    m_frame_reader->finalize();
+    if (m_reader.read(expected.bytes(), expected.size()) != expected.size()) {
+      throw core::Error("Read underflow");
+    }
+  } else {
+    m_decompressor->read(expected.bytes(), expected.size());
+  }
 
   // actual == null_digest: Checksumming is not enabled now.
   // expected == null_digest: Checksumming was not enabled when the entry was
@@ -102,7 +422,20 @@ CacheEntryReader::finalize()
                       Util::format_base16(expected.bytes(), expected.size()));
   }
 
-  m_decompressor->finalize();
+  if (m_frame_reader) {
+    bool eof;
+    try {
+      m_reader.read_int<uint8_t>();
+      eof = false;
+    } catch (core::Error&) {
+      eof = true;
+    }
+    if (!eof) {
+      throw core::Error("Garbage data at end of cache entry");
+    }
+  } else {
+    m_decompressor->finalize();
+  }
 }
 
 } // namespace core
@@ -24,6 +24,8 @@
 #include <core/Reader.hpp>
 #include <util/XXH3_128.hpp>
 
+#include <memory>
+
 namespace core {
 
 // This class knows how to read a cache entry with a format described in
@@ -33,10 +35,27 @@ class CacheEntryReader : public Reader
 public:
   // Read cache entry data from `reader`.
   CacheEntryReader(Reader& reader);
+  ~CacheEntryReader() override;
 
   size_t read(void* data, size_t count) override;
   using Reader::read;
 
+  // Skip `count` bytes of payload. For entry format version 2 and newer,
+  // frames that are skipped in their entirety are not decompressed, but they
+  // are still covered by the checksum verified by `finalize`.
+  void skip(uint64_t count) override;
+
+  // Return the number of payload bytes left in the current frame. Entries with
+  // format version 1 and older have a single frame spanning the payload.
+  uint64_t bytes_left_in_frame() const;
+
+  // Return a reader of the next `count` bytes of payload that is independent
+  // of this reader and therefore can be used on another thread. The data must
+  // end on a frame boundary. Returns null for entry format version 1 and older.
+  // The raw frames are covered by the checksum verified by `finalize` and
+  // frame checksums are verified by the returned reader.
+  std::unique_ptr<Reader> detach_payload(uint64_t count);
+
   // Close for reading.
   //
   // This method potentially verifies the end state after reading the cache
@@ -46,10 +65,20 @@ public:
   const CacheEntryHeader& header() const;
 
 private:
+  class FrameReader;
+  class DetachedPayloadReader;
+
+  Reader& m_reader;
   ChecksummingReader m_checksumming_reader;
   std::unique_ptr<CacheEntryHeader> m_header;
   util::XXH3_128 m_checksum;
+  uint64_t m_payload_bytes_read = 0;
+
+  // Set for entry format version 1 and older.
   std::unique_ptr<compression::Decompressor> m_decompressor;
+
+  // Set for entry format version 2 and newer.
+  std::unique_ptr<FrameReader> m_frame_reader;
 };
 
 inline const CacheEntryHeader&
@@ -18,22 +18,162 @@
 
 #include "CacheEntryWriter.hpp"
 
+#include <compression/dictionary.hpp>
 #include <core/CacheEntryHeader.hpp>
+#include <core/StringWriter.hpp>
+#include <util/XXH3_64.hpp>
+
+#include <algorithm>
+
+namespace {
+
+// Upper bound of the uncompressed size of a payload frame. Larger frames are
+// split so that the compressed frame data buffered in memory stays bounded.
+const uint64_t k_max_frame_size = 64 * 1024 * 1024;
+
+uint32_t
+choose_compression_dictionary(const core::CacheEntryHeader& header)
+{
+  // Format version 0 has no room for a dictionary ID.
+  return header.entry_format_version >= 1
+             && header.compression_type == compression::Type::zstd
+           ? compression::dictionary_id_for_new_entry(header.entry_size)
+           : 0;
+}
+
+} // namespace
 
 namespace core {
 
+// Writer that splits data into independently compressed frames as described
+// in CacheEntryHeader.hpp.
+class CacheEntryWriter::FrameWriter : public Writer
+{
+public:
+  FrameWriter(Writer& writer,
+              const CacheEntryHeader& header,
+              uint32_t dictionary_id);
+
+  void write(const void* data, size_t count) override;
+
+  // Write the terminator frame. Does not finalize the underlying writer.
+  void finalize() override;
+
+  void end_frame();
+
+  int8_t actual_compression_level() const;
+
+private:
+  Writer& m_writer;
+  std::string m_frame_data;
+  StringWriter m_frame_data_writer;
+  std::unique_ptr<compression::Compressor> m_compressor;
+  uint64_t m_frame_size = 0;
+  util::XXH3_64 m_frame_checksum;
+};
+
+CacheEntryWriter::FrameWriter::FrameWriter(Writer& writer,
+                                           const CacheEntryHeader& header,
+                                           const uint32_t dictionary_id)
+  : m_writer(writer),
+    m_frame_data_writer(m_frame_data)
+{
+  // The compressor is reused for all frames so that the compression context
+  // (including any dictionary) is only set up once.
+  const uint64_t payload_size =
+    header.entry_size > 0 ? header.payload_size() : 0;
+  m_compressor = compression::Compressor::create_from_type(
+    header.compression_type,
+    m_frame_data_writer,
+    header.compression_level,
+    dictionary_id,
+    std::min(payload_size, k_max_frame_size));
+}
+
+void
+CacheEntryWriter::FrameWriter::write(const void* const data, const size_t count)
+{
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  size_t bytes_left = count;
+  while (bytes_left > 0) {
+    const size_t n = std::min(static_cast<uint64_t>(bytes_left),
+                              k_max_frame_size - m_frame_size);
+    m_compressor->write(bytes, n);
+    m_frame_checksum.update(bytes, n);
+    m_frame_size += n;
+    bytes += n;
+    bytes_left -= n;
+    if (m_frame_size == k_max_frame_size) {
+      end_frame();
+    }
+  }
+}
+
+void
+CacheEntryWriter::FrameWriter::end_frame()
+{
+  if (m_frame_size == 0) {
+    return;
+  }
+
+  m_compressor->end_frame();
+
+  m_writer.write_int(m_frame_size);
+  m_writer.write_int(static_cast<uint64_t>(m_frame_data.size()));
+  m_writer.write_int(m_frame_checksum.digest());
+  m_writer.write(m_frame_data.data(), m_frame_data.size());
+
+  m_frame_data.clear();
+  m_frame_size = 0;
+  m_frame_checksum.reset();
+}
+
+void
+CacheEntryWriter::FrameWriter::finalize()
+{
+  end_frame();
+  m_writer.write_int<uint64_t>(0);
+}
+
+int8_t
+CacheEntryWriter::FrameWriter::actual_compression_level() const
+{
+  return m_compressor->actual_compression_level();
+}
+
 CacheEntryWriter::CacheEntryWriter(core::Writer& writer,
-                                   const CacheEntryHeader& header)
-  : m_checksumming_writer(writer),
-    m_compressor(compression::Compressor::create_from_type(
-      header.compression_type, writer, header.compression_level))
+                                   const CacheEntryHeader& header,
+                                   const bool use_dictionary)
+  : m_writer(writer),
+    m_checksumming_writer(writer),
+    m_compression_dictionary_id(
+      use_dictionary ? choose_compression_dictionary(header) : 0)
 {
+  int8_t actual_compression_level;
+  if (header.entry_format_version >= 2) {
+    // The checksum covers the stored frames, see CacheEntryReader.
+    m_frame_writer = std::make_unique<FrameWriter>(
+      m_checksumming_writer, header, m_compression_dictionary_id);
+    actual_compression_level = m_frame_writer->actual_compression_level();
+  } else {
+    m_compressor =
+      compression::Compressor::create_from_type(header.compression_type,
+                                                writer,
+                                                header.compression_level,
+                                                m_compression_dictionary_id,
+                                                header.entry_size);
+    actual_compression_level = m_compressor->actual_compression_level();
+  }
+
   m_checksumming_writer.write_int(header.magic);
   m_checksumming_writer.write_int(header.entry_format_version);
   m_checksumming_writer.write_int(static_cast<uint8_t>(header.entry_type));
   m_checksumming_writer.write_int(
     static_cast<uint8_t>(header.compression_type));
-  m_checksumming_writer.write_int(m_compressor->actual_compression_level());
+  m_checksumming_writer.write_int(actual_compression_level);
+  if (header.entry_format_version >= 1) {
+    m_checksumming_writer.write_int(m_compression_dictionary_id);
+  }
   m_checksumming_writer.write_int(header.creation_time);
   m_checksumming_writer.write_int<uint8_t>(header.ccache_version.length());
   m_checksumming_writer.write_str(header.ccache_version);
@@ -41,21 +181,44 @@ CacheEntryWriter::CacheEntryWriter(core::Writer& writer,
   m_checksumming_writer.write_str(header.namespace_);
   m_checksumming_writer.write_int(header.entry_size);
 
-  m_checksumming_writer.set_writer(*m_compressor);
+  if (!m_frame_writer) {
+    m_checksumming_writer.set_writer(*m_compressor);
+  }
 }
 
+CacheEntryWriter::~CacheEntryWriter() = default;
+
 void
 CacheEntryWriter::write(const void* const data, const size_t count)
 {
-  m_checksumming_writer.write(data, count);
+  if (m_frame_writer) {
+    m_frame_writer->write(data, count);
+  } else {
+    m_checksumming_writer.write(data, count);
+  }
+}
+
+void
+CacheEntryWriter::end_frame()
+{
+  if (m_frame_writer) {
+    m_frame_writer->end_frame();
+  }
 }
 
 void
 CacheEntryWriter::finalize()
 {
-  const auto digest = m_checksumming_writer.digest();
-  m_compressor->write(digest.bytes(), digest.size());
-  m_compressor->finalize();
+  if (m_frame_writer) {
+    m_frame_writer->finalize();
+    const auto digest = m_checksumming_writer.digest();
+    m_writer.write(digest.bytes(), digest.size());
+    m_writer.finalize();
+  } else {
+    const auto digest = m_checksumming_writer.digest();
+    m_compressor->write(digest.bytes(), digest.size());
+    m_compressor->finalize();
+  }
 }
 
 } // namespace core
@@ -22,6 +22,8 @@
 #include <core/ChecksummingWriter.hpp>
 #include <core/Writer.hpp>
 
+#include <memory>
+
 namespace core {
 
 struct CacheEntryHeader;
@@ -31,11 +33,22 @@ struct CacheEntryHeader;
 class CacheEntryWriter : public Writer
 {
 public:
-  CacheEntryWriter(Writer& writer, const CacheEntryHeader& header);
+  // If `use_dictionary` is false, the entry is compressed without a
+  // compression dictionary, which is needed if it's going to be read by ccache
+  // instances that don't have the dictionary, e.g. via secondary storage.
+  CacheEntryWriter(Writer& writer,
+                   const CacheEntryHeader& header,
+                   bool use_dictionary = true);
+  ~CacheEntryWriter() override;
 
   void write(const void* data, size_t count) override;
   using Writer::write;
 
+  // End the current payload frame, if any, so that data written after this
+  // call ends up in a new frame which can be skipped independently by readers.
+  // Does nothing for entry format version 1 and older.
+  void end_frame();
+
   // Close for writing.
   //
   // This method potentially verifies the end state after writing the cache
@@ -43,8 +56,17 @@ public:
   void finalize() override;
 
 private:
+  class FrameWriter;
+
+  Writer& m_writer;
   ChecksummingWriter m_checksumming_writer;
+  uint32_t m_compression_dictionary_id;
+
+  // Set for entry format version 1 and older.
   std::unique_ptr<compression::Compressor> m_compressor;
+
+  // Set for entry format version 2 and newer.
+  std::unique_ptr<FrameWriter> m_frame_writer;
 };
 
 } // namespace core
@@ -22,6 +22,7 @@
 #include <core/exceptions.hpp>
 
 #include <cstdio>
+#include <limits>
 
 namespace core {
 
@@ -31,6 +32,7 @@ public:
   FileReader(FILE* stream);
 
   size_t read(void* data, size_t size) override;
+  void skip(uint64_t count) override;
 
 private:
   FILE* m_stream;
@@ -53,4 +55,14 @@ FileReader::read(void* const data, const size_t size)
   return bytes_read;
 }
 
+inline void
+FileReader::skip(const uint64_t count)
+{
+  if (count > static_cast<uint64_t>(std::numeric_limits<long>::max())
+      || fseek(m_stream, static_cast<long>(count), SEEK_CUR) != 0) {
+    // Not seekable, e.g. a pipe.
+    Reader::skip(count);
+  }
+}
+
 } // namespace core
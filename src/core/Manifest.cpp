@@ -21,43 +21,113 @@
 #include <Context.hpp>
 #include <Hash.hpp>
 #include <Logging.hpp>
+#include <ThreadPool.hpp>
+#include <compression/Compressor.hpp>
+#include <compression/Decompressor.hpp>
 #include <core/Reader.hpp>
+#include <core/StringReader.hpp>
+#include <core/StringWriter.hpp>
 #include <core/Writer.hpp>
 #include <core/exceptions.hpp>
 #include <fmtmacros.hpp>
 #include <hashutil.hpp>
 #include <util/XXH3_64.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
 // Manifest data format
 // ====================
 //
 // Integers are big-endian.
 //
-// <payload>       ::= <format_ver> <paths> <includes> <results>
-// <format_ver>    ::= uint8_t
-// <paths>         ::= <n_paths> <path_entry>*
-// <n_paths>       ::= uint32_t
-// <path_entry>    ::= <path_len> <path>
-// <path_len>      ::= uint16_t
-// <path>          ::= path_len bytes
-// <includes>      ::= <n_includes> <include_entry>*
-// <n_includes>    ::= uint32_t
-// <include_entry> ::= <path_index> <digest> <fsize> <mtime> <ctime>
-// <path_index>    ::= uint32_t
-// <digest>        ::= Digest::size() bytes
-// <fsize>         ::= uint64_t ; file size
-// <mtime>         ::= int64_t ; modification time
-// <ctime>         ::= int64_t ; status change time
-// <results>       ::= <n_results> <result>*
-// <n_results>     ::= uint32_t
-// <result>        ::= <n_indexes> <include_index>* <key>
-// <n_indexes>     ::= uint32_t
-// <include_index> ::= uint32_t
-// <result_key>    ::= Digest::size() bytes
+// <payload>          ::= <format_ver> <counts> <paths> <includes> <results>
+//                        <indexes> <path_data>
+// <format_ver>       ::= uint8_t
+// <counts>           ::= <n_paths> <n_includes> <n_results> <n_indexes>
+//                        <path_data_size>
+// <n_paths>          ::= uint32_t
+// <n_includes>       ::= uint32_t
+// <n_results>        ::= uint32_t
+// <n_indexes>        ::= uint32_t
+// <path_data_size>   ::= uint32_t
+// <paths>            ::= <path_entry>* ; n_paths entries
+// <path_entry>       ::= <path_offset> <path_len>
+// <path_offset>      ::= uint32_t ; offset of path in path_data
+// <path_len>         ::= uint16_t
+// <includes>         ::= <include_entry>* ; n_includes entries
+// <include_entry>    ::= <path_index> <digest> <fsize> <mtime> <ctime>
+// <path_index>       ::= uint32_t
+// <digest>           ::= Digest::size() bytes
+// <fsize>            ::= uint64_t ; file size
+// <mtime>            ::= int64_t ; modification time
+// <ctime>            ::= int64_t ; status change time
+// <results>          ::= <result>* ; n_results entries
+// <result>           ::= <first_index> <n_result_indexes> <key>
+// <first_index>      ::= uint32_t ; position of first include_index in indexes
+// <n_result_indexes> ::= uint32_t
+// <key>              ::= Digest::size() bytes
+// <indexes>          ::= <include_index>* ; n_indexes entries
+// <include_index>    ::= uint32_t
+// <path_data>        ::= path_data_size bytes
+//
+// All tables have fixed-size entries so that the manifest can be queried in
+// place without being deserialized.
+//
+// Manifest delta format
+// =====================
+//
+// A manifest delta file holds results added to a manifest after the manifest
+// file was last written. Records are appended with O_APPEND in a single write
+// so that concurrent ccache invocations can add results without rewriting (and
+// racing to replace) the whole manifest file. A record adds one result and
+// refers to the paths and include entries of the manifest file it was created
+// for, so only paths and include entries that the manifest file lacks are
+// stored in the record. Records created for another version of the manifest
+// file are recognized by the base checksum and ignored. Records are loaded in
+// order on top of the manifest when it's read.
+//
+// <delta>            ::= <record>*
+// <record>           ::= <record_size> <checksum> <compression_type>
+//                        <record_payload>
+// <record_size>      ::= uint32_t ; size of the rest of the record
+// <checksum>         ::= uint64_t ; XXH3-64 of the rest of the record
+// <compression_type> ::= uint8_t ; see compression::Type
+// <record_payload>   ::= <base_checksum> <n_new_paths> <n_new_includes>
+//                        <n_result_indexes> <key> <new_path>* <include_entry>*
+//                        <include_index>* ; compressed
+// <base_checksum>    ::= uint64_t ; XXH3-64 of the manifest after format_ver
+// <n_new_paths>      ::= uint32_t
+// <n_new_includes>   ::= uint32_t
+// <new_path>         ::= <path_len> <path> ; n_new_paths entries
+// <path>             ::= path_len bytes
+//
+// A path_index of n_paths or more in an include_entry refers to the new paths
+// and an include_index of n_includes or more refers to the new include entries.
 
 const uint32_t k_max_manifest_entries = 100;
 const uint32_t k_max_manifest_file_info_entries = 10000;
 
+// Results this close to the most recently used end are not promoted since
+// they won't be evicted anytime soon, which saves rewriting the manifest.
+const uint32_t k_min_promotion_distance = k_max_manifest_entries / 2;
+
+const size_t k_counts_size = 5 * sizeof(uint32_t);
+const size_t k_path_entry_size = sizeof(uint32_t) + sizeof(uint16_t);
+const size_t k_include_entry_size =
+  sizeof(uint32_t) + Digest::size() + sizeof(uint64_t) + 2 * sizeof(int64_t);
+const size_t k_result_entry_size = 2 * sizeof(uint32_t) + Digest::size();
+const size_t k_index_entry_size = sizeof(uint32_t);
+// Files referenced by a manifest are stated concurrently to hide latency on
+// network file systems, using up to k_max_stat_threads threads with at least
+// k_min_files_per_stat_thread files each.
+const uint32_t k_max_stat_threads = 8;
+const uint32_t k_min_files_per_stat_thread = 64;
+
+const size_t k_delta_record_header_size = sizeof(uint32_t) + sizeof(uint64_t);
+
 namespace std {
 
 template<> struct hash<core::Manifest::FileInfo>
@@ -76,60 +146,142 @@ template<> struct hash<core::Manifest::FileInfo>
 
 namespace core {
 
-const uint8_t Manifest::k_format_version = 0;
+const uint8_t Manifest::k_format_version = 1;
 
-void
-Manifest::read(Reader& reader)
+Manifest::Manifest()
 {
   clear();
+}
 
+void
+Manifest::read(Reader& reader, const uint64_t payload_size)
+{
   const auto format_version = reader.read_int<uint8_t>();
   if (format_version != k_format_version) {
     throw core::Error(
       "Unknown format version: {} != {}", format_version, k_format_version);
   }
 
-  const auto file_count = reader.read_int<uint32_t>();
-  for (uint32_t i = 0; i < file_count; ++i) {
-    m_files.push_back(reader.read_str(reader.read_int<uint16_t>()));
+  uint8_t counts[k_counts_size];
+  if (reader.read(counts, sizeof(counts)) != sizeof(counts)) {
+    throw core::Error("Read underflow");
   }
+  uint32_t file_count;
+  uint32_t file_info_count;
+  uint32_t result_count;
+  uint32_t index_count;
+  uint32_t path_data_size;
+  Util::big_endian_to_int(counts, file_count);
+  Util::big_endian_to_int(counts + 4, file_info_count);
+  Util::big_endian_to_int(counts + 8, result_count);
+  Util::big_endian_to_int(counts + 12, index_count);
+  Util::big_endian_to_int(counts + 16, path_data_size);
 
-  const auto file_info_count = reader.read_int<uint32_t>();
-  for (uint32_t i = 0; i < file_info_count; ++i) {
-    m_file_infos.emplace_back();
-    auto& entry = m_file_infos.back();
+  const uint64_t size =
+    k_counts_size + uint64_t{file_count} * k_path_entry_size
+    + uint64_t{file_info_count} * k_include_entry_size
+    + uint64_t{result_count} * k_result_entry_size
+    + uint64_t{index_count} * k_index_entry_size + path_data_size;
 
-    reader.read_int(entry.index);
-    reader.read(entry.digest.bytes(), Digest::size());
-    reader.read_int(entry.fsize);
-    reader.read_int(entry.mtime);
-    reader.read_int(entry.ctime);
+  // Check the size before allocating since the counts may be corrupt.
+  if (1 + size != payload_size) {
+    throw core::Error("Manifest size {} doesn't match payload size {}",
+                      1 + size,
+                      payload_size);
   }
 
-  const auto result_count = reader.read_int<uint32_t>();
-  for (uint32_t i = 0; i < result_count; ++i) {
-    m_results.emplace_back();
-    auto& entry = m_results.back();
-
-    const auto file_info_index_count = reader.read_int<uint32_t>();
-    for (uint32_t j = 0; j < file_info_index_count; ++j) {
-      entry.file_info_indexes.push_back(reader.read_int<uint32_t>());
-    }
-    reader.read(entry.key.bytes(), Digest::size());
+  // Read the rest of the manifest into a single buffer.
+  std::string data(size, 0);
+  memcpy(&data[0], counts, sizeof(counts));
+  size_t bytes_read = sizeof(counts);
+  while (bytes_read < size) {
+    bytes_read += reader.read(&data[bytes_read], size - bytes_read);
   }
+  set_data(std::move(data));
 }
 
 nonstd::optional<Digest>
 Manifest::look_up_result_digest(const Context& ctx) const
 {
-  std::unordered_map<std::string, FileStats> stated_files;
-  std::unordered_map<std::string, Digest> hashed_files;
+  std::unordered_map<uint32_t /*path index*/, FileStats> stated_files;
+  std::unordered_map<uint32_t /*path index*/, Digest> hashed_files;
+  std::string path_buffer;
+
+#ifdef INODE_CACHE_SUPPORTED
+  // Lookups in the stat cache are cheaper than spawning stat threads.
+  if (!ctx.stat_cache.enabled()) {
+    stat_files(stated_files);
+  }
+#else
+  stat_files(stated_files);
+#endif
+
+  // Results usually share most of their FileInfo entries, so each FileInfo
+  // entry is checked at most once and a mismatching entry eliminates all
+  // results that reference it. To tell results apart quickly, entries that
+  // aren't shared by all results are checked before the shared ones.
+  //
+  // fi_results[fi_result_offsets[i]..fi_result_offsets[i + 1]) holds the
+  // results referencing FileInfo entry i.
+  std::vector<uint32_t> fi_result_offsets(file_info_count() + 1);
+  for (uint32_t r = 0; r < result_count(); ++r) {
+    const auto count = result_file_info_index_count(r);
+    for (uint32_t k = 0; k < count; ++k) {
+      ++fi_result_offsets[result_file_info_index(r, k) + 1];
+    }
+  }
+  std::partial_sum(fi_result_offsets.begin(),
+                   fi_result_offsets.end(),
+                   fi_result_offsets.begin());
+  std::vector<uint32_t> fi_results(fi_result_offsets.back());
+  std::vector<uint32_t> fi_result_ends(fi_result_offsets.begin(),
+                                       fi_result_offsets.end() - 1);
+  for (uint32_t r = 0; r < result_count(); ++r) {
+    const auto count = result_file_info_index_count(r);
+    for (uint32_t k = 0; k < count; ++k) {
+      fi_results[fi_result_ends[result_file_info_index(r, k)]++] = r;
+    }
+  }
+
+  enum class State : uint8_t { unknown, match, mismatch };
+  std::vector<State> fi_states(file_info_count(), State::unknown);
+  std::vector<bool> eliminated(result_count());
+
+  const auto fi_matches = [&](const uint32_t fi_index) {
+    auto& state = fi_states[fi_index];
+    if (state == State::unknown) {
+      if (file_info_matches(
+            ctx, fi_index, stated_files, hashed_files, path_buffer)) {
+        state = State::match;
+      } else {
+        state = State::mismatch;
+        for (uint32_t j = fi_result_offsets[fi_index];
+             j < fi_result_offsets[fi_index + 1];
+             ++j) {
+          eliminated[fi_results[j]] = true;
+        }
+      }
+    }
+    return state == State::match;
+  };
 
   // Check newest result first since it's a more likely to match.
-  for (size_t i = m_results.size(); i > 0; i--) {
-    const auto& result = m_results[i - 1];
-    if (result_matches(ctx, result, stated_files, hashed_files)) {
-      return result.key;
+  for (uint32_t i = result_count(); i > 0; i--) {
+    const uint32_t r = i - 1;
+    const auto count = result_file_info_index_count(r);
+    for (const bool check_shared : {false, true}) {
+      for (uint32_t k = 0; k < count && !eliminated[r]; ++k) {
+        const auto fi_index = result_file_info_index(r, k);
+        const bool shared = fi_result_offsets[fi_index + 1]
+                              - fi_result_offsets[fi_index]
+                            == result_count();
+        if (shared == check_shared) {
+          fi_matches(fi_index);
+        }
+      }
+    }
+    if (!eliminated[r]) {
+      return result_key(r);
     }
   }
 
@@ -142,44 +294,26 @@ Manifest::add_result(const Digest& result_key,
                      const time_t time_of_compilation,
                      const bool save_timestamp)
 {
-  if (m_results.size() > k_max_manifest_entries) {
-    // Normally, there shouldn't be many result entries in the manifest since
-    // new entries are added only if an include file has changed but not the
-    // source file, and you typically change source files more often than header
-    // files. However, it's certainly possible to imagine cases where the
-    // manifest will grow large (for instance, a generated header file that
-    // changes for every build), and this must be taken care of since processing
-    // an ever growing manifest eventually will take too much time. A good way
-    // of solving this would be to maintain the result entries in LRU order and
-    // discarding the old ones. An easy way is to throw away all entries when
-    // there are too many. Let's do that for now.
-    LOG("More than {} entries in manifest file; discarding",
-        k_max_manifest_entries);
-    clear();
-  } else if (m_file_infos.size() > k_max_manifest_file_info_entries) {
-    // Rarely, FileInfo entries can grow large in pathological cases where many
-    // included files change, but the main file does not. This also puts an
-    // upper bound on the number of FileInfo entries.
-    LOG("More than {} FileInfo entries in manifest file; discarding",
-        k_max_manifest_file_info_entries);
-    clear();
-  }
+  check_path_lengths(included_files);
+
+  Entries entries = unpack();
 
   std::unordered_map<std::string, uint32_t /*index*/> mf_files;
-  for (uint32_t i = 0; i < m_files.size(); ++i) {
-    mf_files.emplace(m_files[i], i);
+  for (uint32_t i = 0; i < entries.files.size(); ++i) {
+    mf_files.emplace(entries.files[i], i);
   }
 
   std::unordered_map<FileInfo, uint32_t /*index*/> mf_file_infos;
-  for (uint32_t i = 0; i < m_file_infos.size(); ++i) {
-    mf_file_infos.emplace(m_file_infos[i], i);
+  for (uint32_t i = 0; i < entries.file_infos.size(); ++i) {
+    mf_file_infos.emplace(entries.file_infos[i], i);
   }
 
   std::vector<uint32_t> file_info_indexes;
   file_info_indexes.reserve(included_files.size());
 
   for (const auto& item : included_files) {
-    file_info_indexes.push_back(get_file_info_index(item.first,
+    file_info_indexes.push_back(get_file_info_index(entries,
+                                                    item.first,
                                                     item.second,
                                                     mf_files,
                                                     mf_file_infos,
@@ -188,48 +322,384 @@ Manifest::add_result(const Digest& result_key,
   }
 
   ResultEntry entry{std::move(file_info_indexes), result_key};
-  if (std::find(m_results.begin(), m_results.end(), entry) == m_results.end()) {
-    m_results.push_back(std::move(entry));
-    return true;
-  } else {
+  if (!add_result_entry(entries, std::move(entry))
+      && m_delta_results.empty()) {
     return false;
   }
+
+  evict_least_recently_used(entries);
+  pack(entries);
+  return true;
+}
+
+bool
+Manifest::promote_result(const Digest& result_key)
+{
+  for (uint32_t i = result_count(); i > 0; i--) {
+    if (this->result_key(i - 1) == result_key) {
+      if (result_count() - i < k_min_promotion_distance) {
+        return false;
+      }
+      // Merged delta results may be reordered by unpack, so look up the result
+      // again.
+      Entries entries = unpack();
+      const auto it = std::find_if(
+        entries.results.rbegin(),
+        entries.results.rend(),
+        [&](const ResultEntry& entry) { return entry.key == result_key; });
+      std::rotate(std::prev(it.base()), it.base(), entries.results.end());
+      evict_least_recently_used(entries);
+      pack(entries);
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string
+Manifest::delta_record(
+  const Digest& result_key,
+  const std::unordered_map<std::string, Digest>& included_files,
+  const time_t time_of_compilation,
+  const bool save_timestamp,
+  const compression::Type compression_type,
+  const int8_t compression_level) const
+{
+  check_path_lengths(included_files);
+
+  std::unordered_map<std::string, uint32_t /*index*/> mf_files;
+  for (uint32_t i = 0; i < m_file_count; ++i) {
+    mf_files.emplace(std::string(file_path(i)), i);
+  }
+
+  std::unordered_map<FileInfo, uint32_t /*index*/> mf_file_infos;
+  for (uint32_t i = 0; i < m_file_info_count; ++i) {
+    mf_file_infos.emplace(file_info(i), i);
+  }
+
+  std::vector<const std::string*> new_files;
+  std::vector<FileInfo> new_file_infos;
+  std::vector<uint32_t> file_info_indexes;
+  file_info_indexes.reserve(included_files.size());
+
+  for (const auto& item : included_files) {
+    uint32_t index;
+    const auto f_it = mf_files.find(item.first);
+    if (f_it != mf_files.end()) {
+      index = f_it->second;
+    } else {
+      index = m_file_count + new_files.size();
+      new_files.push_back(&item.first);
+    }
+    const auto fi = make_file_info(
+      index, item.first, item.second, time_of_compilation, save_timestamp);
+    const auto fi_it = mf_file_infos.find(fi);
+    if (fi_it != mf_file_infos.end()) {
+      file_info_indexes.push_back(fi_it->second);
+    } else {
+      file_info_indexes.push_back(m_file_info_count + new_file_infos.size());
+      new_file_infos.push_back(fi);
+    }
+  }
+
+  std::string record(k_delta_record_header_size, 0);
+  StringWriter writer(record);
+  writer.write_int(static_cast<uint8_t>(compression_type));
+  auto compressor = compression::Compressor::create_from_type(
+    compression_type, writer, compression_level);
+
+  compressor->write_int(data_checksum());
+  compressor->write_int<uint32_t>(new_files.size());
+  compressor->write_int<uint32_t>(new_file_infos.size());
+  compressor->write_int<uint32_t>(file_info_indexes.size());
+  compressor->write(result_key.bytes(), Digest::size());
+  for (const auto* file : new_files) {
+    compressor->write_int<uint16_t>(file->length());
+    compressor->write_str(*file);
+  }
+  for (const auto& file_info : new_file_infos) {
+    compressor->write_int<uint32_t>(file_info.index);
+    compressor->write(file_info.digest.bytes(), Digest::size());
+    compressor->write_int(file_info.fsize);
+    compressor->write_int(file_info.mtime);
+    compressor->write_int(file_info.ctime);
+  }
+  for (const auto index : file_info_indexes) {
+    compressor->write_int(index);
+  }
+  compressor->finalize();
+
+  const auto payload_size = record.size() - k_delta_record_header_size;
+  util::XXH3_64 checksum;
+  checksum.update(&record[k_delta_record_header_size], payload_size);
+  auto header = reinterpret_cast<uint8_t*>(&record[0]);
+  Util::int_to_big_endian(static_cast<uint32_t>(payload_size), header);
+  Util::int_to_big_endian(checksum.digest(), header + sizeof(uint32_t));
+  return record;
 }
 
 size_t
-Manifest::serialized_size() const
+Manifest::merge_delta(nonstd::string_view delta)
 {
-  uint64_t size = 0;
+  const auto base_checksum = data_checksum();
 
-  size += 1; // format_ver
-  size += 4; // n_files
-  for (const auto& file : m_files) {
-    size += 2 + file.length();
+  // Records are created independently of each other, so paths and FileInfo
+  // entries that several records add are merged only once.
+  std::unordered_map<std::string, uint32_t /*index*/> delta_files;
+  for (uint32_t i = 0; i < m_delta_files.size(); ++i) {
+    delta_files.emplace(m_delta_files[i], m_file_count + i);
   }
-  size += 4; // n_file_infos
-  size += m_file_infos.size() * (4 + Digest::size() + 8 + 8 + 8);
-  size += 4; // n_results
-  for (const auto& result : m_results) {
-    size += 4; // n_file_info_indexes
-    size += result.file_info_indexes.size() * 4;
-    size += Digest::size();
+  std::unordered_map<FileInfo, uint32_t /*index*/> delta_file_infos;
+  for (uint32_t i = 0; i < m_delta_file_infos.size(); ++i) {
+    delta_file_infos.emplace(m_delta_file_infos[i], m_file_info_count + i);
+  }
+
+  size_t merged_records = 0;
+  while (delta.size() >= k_delta_record_header_size) {
+    const auto header = reinterpret_cast<const uint8_t*>(delta.data());
+    uint32_t payload_size;
+    uint64_t expected_checksum;
+    Util::big_endian_to_int(header, payload_size);
+    Util::big_endian_to_int(header + sizeof(uint32_t), expected_checksum);
+    delta.remove_prefix(k_delta_record_header_size);
+    if (payload_size > delta.size()) {
+      // A record that is still being written or was only partially written.
+      LOG_RAW("Ignoring truncated manifest delta record");
+      break;
+    }
+    const auto payload = delta.substr(0, payload_size);
+    delta.remove_prefix(payload_size);
+
+    util::XXH3_64 checksum;
+    checksum.update(payload.data(), payload.size());
+    if (checksum.digest() != expected_checksum) {
+      LOG_RAW("Ignoring manifest delta record with incorrect checksum");
+      continue;
+    }
+
+    Entries record;
+    uint64_t record_base_checksum;
+    try {
+      record = read_delta_record(payload, record_base_checksum);
+    } catch (const core::Error& e) {
+      LOG("Ignoring invalid manifest delta record: {}", e.what());
+      continue;
+    }
+    if (record_base_checksum != base_checksum) {
+      LOG_RAW("Ignoring manifest delta record for another manifest version");
+      continue;
+    }
+
+    const auto& indexes = record.results.front().file_info_indexes;
+    if (std::any_of(record.file_infos.begin(),
+                    record.file_infos.end(),
+                    [&](const FileInfo& fi) {
+                      return fi.index >= m_file_count + record.files.size();
+                    })
+        || std::any_of(indexes.begin(), indexes.end(), [&](uint32_t index) {
+             return index >= m_file_info_count + record.file_infos.size();
+           })) {
+      LOG_RAW("Ignoring manifest delta record with bad index");
+      continue;
+    }
+
+    std::vector<uint32_t> file_remap;
+    file_remap.reserve(record.files.size());
+    for (auto& file : record.files) {
+      const auto it = delta_files.emplace(file, file_count());
+      if (it.second) {
+        m_delta_files.push_back(std::move(file));
+      }
+      file_remap.push_back(it.first->second);
+    }
+
+    std::vector<uint32_t> file_info_remap;
+    file_info_remap.reserve(record.file_infos.size());
+    for (auto fi : record.file_infos) {
+      if (fi.index >= m_file_count) {
+        fi.index = file_remap[fi.index - m_file_count];
+      }
+      const auto it = delta_file_infos.emplace(fi, file_info_count());
+      if (it.second) {
+        m_delta_file_infos.push_back(fi);
+      }
+      file_info_remap.push_back(it.first->second);
+    }
+
+    ResultEntry result = std::move(record.results.front());
+    for (auto& index : result.file_info_indexes) {
+      if (index >= m_file_info_count) {
+        index = file_info_remap[index - m_file_info_count];
+      }
+    }
+    m_delta_results.push_back(std::move(result));
+    ++merged_records;
   }
 
-  return size;
+  return merged_records;
+}
+
+size_t
+Manifest::serialized_size() const
+{
+  return 1 + m_data.size(); // format_ver + the rest
 }
 
 void
 Manifest::write(Writer& writer) const
 {
   writer.write_int(k_format_version);
-  writer.write_int<uint32_t>(m_files.size());
-  for (const auto& file : m_files) {
+  writer.write(m_data.data(), m_data.size());
+}
+
+bool
+Manifest::FileInfo::operator==(const FileInfo& other) const
+{
+  return index == other.index && digest == other.digest && fsize == other.fsize
+         && mtime == other.mtime && ctime == other.ctime;
+}
+
+bool
+Manifest::ResultEntry::operator==(const ResultEntry& other) const
+{
+  return file_info_indexes == other.file_info_indexes && key == other.key;
+}
+
+void
+Manifest::clear()
+{
+  pack(Entries());
+}
+
+void
+Manifest::set_data(std::string data)
+{
+  const auto* bytes = reinterpret_cast<const uint8_t*>(data.data());
+  if (data.size() < k_counts_size) {
+    throw core::Error("Truncated manifest");
+  }
+  uint32_t path_data_size;
+  Util::big_endian_to_int(bytes, m_file_count);
+  Util::big_endian_to_int(bytes + 4, m_file_info_count);
+  Util::big_endian_to_int(bytes + 8, m_result_count);
+  Util::big_endian_to_int(bytes + 12, m_index_count);
+  Util::big_endian_to_int(bytes + 16, path_data_size);
+
+  m_file_info_offset = k_counts_size + size_t{m_file_count} * k_path_entry_size;
+  m_result_offset =
+    m_file_info_offset + size_t{m_file_info_count} * k_include_entry_size;
+  m_index_offset =
+    m_result_offset + size_t{m_result_count} * k_result_entry_size;
+  m_path_data_offset =
+    m_index_offset + size_t{m_index_count} * k_index_entry_size;
+  if (data.size() != m_path_data_offset + path_data_size) {
+    throw core::Error("Bad manifest size: {} != {}",
+                      data.size(),
+                      m_path_data_offset + path_data_size);
+  }
+
+  m_data = std::move(data);
+  m_delta_files.clear();
+  m_delta_file_infos.clear();
+  m_delta_results.clear();
+
+  // Verify references once here so that lookups don't need to.
+  for (uint32_t i = 0; i < m_file_count; ++i) {
+    const size_t offset = k_counts_size + size_t{i} * k_path_entry_size;
+    if (uint64_t{get_int<uint32_t>(offset)} + get_int<uint16_t>(offset + 4)
+        > path_data_size) {
+      throw core::Error("Bad path entry {} in manifest", i);
+    }
+  }
+  for (uint32_t i = 0; i < m_file_info_count; ++i) {
+    if (get_int<uint32_t>(m_file_info_offset + size_t{i} * k_include_entry_size)
+        >= m_file_count) {
+      throw core::Error("Bad include entry {} in manifest", i);
+    }
+  }
+  for (uint32_t i = 0; i < m_result_count; ++i) {
+    const size_t offset = m_result_offset + size_t{i} * k_result_entry_size;
+    if (uint64_t{get_int<uint32_t>(offset)} + get_int<uint32_t>(offset + 4)
+        > m_index_count) {
+      throw core::Error("Bad result entry {} in manifest", i);
+    }
+  }
+  for (uint32_t i = 0; i < m_index_count; ++i) {
+    if (get_int<uint32_t>(m_index_offset + size_t{i} * k_index_entry_size)
+        >= m_file_info_count) {
+      throw core::Error("Bad include index {} in manifest", i);
+    }
+  }
+}
+
+Manifest::Entries
+Manifest::unpack() const
+{
+  Entries entries;
+
+  entries.files.reserve(file_count());
+  for (uint32_t i = 0; i < file_count(); ++i) {
+    entries.files.emplace_back(file_path(i));
+  }
+
+  entries.file_infos.reserve(file_info_count());
+  for (uint32_t i = 0; i < file_info_count(); ++i) {
+    entries.file_infos.push_back(file_info(i));
+  }
+
+  entries.results.reserve(result_count());
+  for (uint32_t i = 0; i < result_count(); ++i) {
+    ResultEntry result;
+    const auto index_count = result_file_info_index_count(i);
+    result.file_info_indexes.reserve(index_count);
+    for (uint32_t j = 0; j < index_count; ++j) {
+      result.file_info_indexes.push_back(result_file_info_index(i, j));
+    }
+    result.key = result_key(i);
+    if (i < m_result_count) {
+      entries.results.push_back(std::move(result));
+    } else {
+      // A result may have been added by several delta records.
+      add_result_entry(entries, std::move(result));
+    }
+  }
+
+  return entries;
+}
+
+void
+Manifest::pack(const Entries& entries)
+{
+  uint64_t path_data_size = 0;
+  for (const auto& file : entries.files) {
+    path_data_size += file.length();
+  }
+  uint64_t index_count = 0;
+  for (const auto& result : entries.results) {
+    index_count += result.file_info_indexes.size();
+  }
+
+  std::string data;
+  data.reserve(k_counts_size + entries.files.size() * k_path_entry_size
+               + entries.file_infos.size() * k_include_entry_size
+               + entries.results.size() * k_result_entry_size
+               + index_count * k_index_entry_size + path_data_size);
+  StringWriter writer(data);
+
+  writer.write_int<uint32_t>(entries.files.size());
+  writer.write_int<uint32_t>(entries.file_infos.size());
+  writer.write_int<uint32_t>(entries.results.size());
+  writer.write_int<uint32_t>(index_count);
+  writer.write_int<uint32_t>(path_data_size);
+
+  uint32_t path_offset = 0;
+  for (const auto& file : entries.files) {
+    writer.write_int(path_offset);
     writer.write_int<uint16_t>(file.length());
-    writer.write_str(file);
+    path_offset += file.length();
   }
 
-  writer.write_int<uint32_t>(m_file_infos.size());
-  for (const auto& file_info : m_file_infos) {
+  for (const auto& file_info : entries.file_infos) {
     writer.write_int<uint32_t>(file_info.index);
     writer.write(file_info.digest.bytes(), Digest::size());
     writer.write_int(file_info.fsize);
@@ -237,39 +707,277 @@ Manifest::write(Writer& writer) const
     writer.write_int(file_info.ctime);
   }
 
-  writer.write_int<uint32_t>(m_results.size());
-  for (const auto& result : m_results) {
+  uint32_t first_index = 0;
+  for (const auto& result : entries.results) {
+    writer.write_int(first_index);
     writer.write_int<uint32_t>(result.file_info_indexes.size());
+    writer.write(result.key.bytes(), Digest::size());
+    first_index += result.file_info_indexes.size();
+  }
+
+  for (const auto& result : entries.results) {
     for (auto index : result.file_info_indexes) {
       writer.write_int(index);
     }
-    writer.write(result.key.bytes(), Digest::size());
   }
+
+  for (const auto& file : entries.files) {
+    writer.write_str(file);
+  }
+
+  set_data(std::move(data));
 }
 
-bool
-Manifest::FileInfo::operator==(const FileInfo& other) const
+uint64_t
+Manifest::data_checksum() const
 {
-  return index == other.index && digest == other.digest && fsize == other.fsize
-         && mtime == other.mtime && ctime == other.ctime;
+  util::XXH3_64 checksum;
+  checksum.update(m_data.data(), m_data.size());
+  return checksum.digest();
+}
+
+uint32_t
+Manifest::file_count() const
+{
+  return m_file_count + m_delta_files.size();
+}
+
+uint32_t
+Manifest::file_info_count() const
+{
+  return m_file_info_count + m_delta_file_infos.size();
+}
+
+uint32_t
+Manifest::result_count() const
+{
+  return m_result_count + m_delta_results.size();
+}
+
+template<typename T>
+T
+Manifest::get_int(const size_t offset) const
+{
+  T value;
+  Util::big_endian_to_int(
+    reinterpret_cast<const uint8_t*>(m_data.data()) + offset, value);
+  return value;
+}
+
+nonstd::string_view
+Manifest::file_path(const uint32_t index) const
+{
+  if (index >= m_file_count) {
+    return m_delta_files[index - m_file_count];
+  }
+  const size_t offset = k_counts_size + size_t{index} * k_path_entry_size;
+  return nonstd::string_view(m_data.data() + m_path_data_offset
+                               + get_int<uint32_t>(offset),
+                             get_int<uint16_t>(offset + 4));
+}
+
+Manifest::FileInfo
+Manifest::file_info(const uint32_t index) const
+{
+  if (index >= m_file_info_count) {
+    return m_delta_file_infos[index - m_file_info_count];
+  }
+  const size_t offset =
+    m_file_info_offset + size_t{index} * k_include_entry_size;
+  FileInfo fi;
+  fi.index = get_int<uint32_t>(offset);
+  memcpy(fi.digest.bytes(), m_data.data() + offset + 4, Digest::size());
+  fi.fsize = get_int<uint64_t>(offset + 4 + Digest::size());
+  fi.mtime = get_int<int64_t>(offset + 4 + Digest::size() + 8);
+  fi.ctime = get_int<int64_t>(offset + 4 + Digest::size() + 16);
+  return fi;
+}
+
+uint32_t
+Manifest::result_file_info_index_count(const uint32_t result_index) const
+{
+  if (result_index >= m_result_count) {
+    return m_delta_results[result_index - m_result_count]
+      .file_info_indexes.size();
+  }
+  return get_int<uint32_t>(m_result_offset
+                           + size_t{result_index} * k_result_entry_size + 4);
+}
+
+uint32_t
+Manifest::result_file_info_index(const uint32_t result_index,
+                                 const uint32_t i) const
+{
+  if (result_index >= m_result_count) {
+    return m_delta_results[result_index - m_result_count].file_info_indexes[i];
+  }
+  const auto first_index = get_int<uint32_t>(
+    m_result_offset + size_t{result_index} * k_result_entry_size);
+  return get_int<uint32_t>(m_index_offset
+                           + size_t{first_index + i} * k_index_entry_size);
+}
+
+Digest
+Manifest::result_key(const uint32_t result_index) const
+{
+  if (result_index >= m_result_count) {
+    return m_delta_results[result_index - m_result_count].key;
+  }
+  Digest key;
+  memcpy(key.bytes(),
+         m_data.data() + m_result_offset
+           + size_t{result_index} * k_result_entry_size + 8,
+         Digest::size());
+  return key;
+}
+
+void
+Manifest::check_path_lengths(
+  const std::unordered_map<std::string, Digest>& included_files)
+{
+  for (const auto& item : included_files) {
+    if (item.first.length() > std::numeric_limits<uint16_t>::max()) {
+      throw core::Error("Too long path in manifest: {}", item.first);
+    }
+  }
+}
+
+Manifest::Entries
+Manifest::read_delta_record(const nonstd::string_view record,
+                            uint64_t& base_checksum)
+{
+  StringReader reader(record);
+  const auto compression_type =
+    compression::type_from_int(reader.read_int<uint8_t>());
+  auto decompressor =
+    compression::Decompressor::create_from_type(compression_type, reader);
+
+  base_checksum = decompressor->read_int<uint64_t>();
+  const auto file_count = decompressor->read_int<uint32_t>();
+  const auto file_info_count = decompressor->read_int<uint32_t>();
+  const auto index_count = decompressor->read_int<uint32_t>();
+
+  Entries entries;
+  entries.results.emplace_back();
+  auto& result = entries.results.back();
+  decompressor->read(result.key.bytes(), Digest::size());
+
+  // The counts are not trusted to reserve memory since the record may be
+  // corrupt.
+  for (uint32_t i = 0; i < file_count; ++i) {
+    const auto length = decompressor->read_int<uint16_t>();
+    entries.files.push_back(decompressor->read_str(length));
+  }
+  for (uint32_t i = 0; i < file_info_count; ++i) {
+    FileInfo fi;
+    decompressor->read_int(fi.index);
+    decompressor->read(fi.digest.bytes(), Digest::size());
+    decompressor->read_int(fi.fsize);
+    decompressor->read_int(fi.mtime);
+    decompressor->read_int(fi.ctime);
+    entries.file_infos.push_back(fi);
+  }
+  for (uint32_t i = 0; i < index_count; ++i) {
+    result.file_info_indexes.push_back(decompressor->read_int<uint32_t>());
+  }
+  decompressor->finalize();
+
+  return entries;
 }
 
 bool
-Manifest::ResultEntry::operator==(const ResultEntry& other) const
+Manifest::add_result_entry(Entries& entries, ResultEntry&& entry)
 {
-  return file_info_indexes == other.file_info_indexes && key == other.key;
+  const auto it =
+    std::find(entries.results.begin(), entries.results.end(), entry);
+  if (it == entries.results.end()) {
+    entries.results.push_back(std::move(entry));
+  } else if (it + 1 != entries.results.end()) {
+    std::rotate(it, it + 1, entries.results.end());
+  } else {
+    return false;
+  }
+  return true;
 }
 
 void
-Manifest::clear()
+Manifest::evict_least_recently_used(Entries& entries)
 {
-  m_files.clear();
-  m_file_infos.clear();
-  m_results.clear();
+  // Results are kept in least recently used order. A generated header file
+  // that changes for every build would otherwise make the manifest grow
+  // forever, and processing an ever growing manifest eventually takes too much
+  // time. FileInfo entries can also grow large in pathological cases where
+  // many included files change but the main file does not, so keep the most
+  // recently used results whose FileInfo entries fit as well.
+  auto& results = entries.results;
+  std::vector<bool> file_info_used(entries.file_infos.size());
+  size_t file_info_used_count = 0;
+  size_t results_to_keep = 0;
+  for (auto it = results.rbegin();
+       it != results.rend() && results_to_keep < k_max_manifest_entries;
+       ++it) {
+    size_t new_file_infos = 0;
+    for (const auto index : it->file_info_indexes) {
+      new_file_infos += file_info_used[index] ? 0 : 1;
+    }
+    if (results_to_keep > 0
+        && file_info_used_count + new_file_infos
+             > k_max_manifest_file_info_entries) {
+      break;
+    }
+    for (const auto index : it->file_info_indexes) {
+      file_info_used[index] = true;
+    }
+    file_info_used_count += new_file_infos;
+    ++results_to_keep;
+  }
+
+  if (results_to_keep == results.size()) {
+    return;
+  }
+
+  LOG("Evicting {} least recently used result(s) from manifest",
+      results.size() - results_to_keep);
+  results.erase(results.begin(), results.end() - results_to_keep);
+
+  // Garbage collect FileInfo and path entries that no longer are referenced.
+  std::vector<uint32_t> file_info_remap(entries.file_infos.size());
+  std::vector<bool> file_used(entries.files.size());
+  std::vector<FileInfo> file_infos;
+  file_infos.reserve(file_info_used_count);
+  for (size_t i = 0; i < entries.file_infos.size(); ++i) {
+    if (file_info_used[i]) {
+      file_info_remap[i] = file_infos.size();
+      file_infos.push_back(entries.file_infos[i]);
+      file_used[entries.file_infos[i].index] = true;
+    }
+  }
+
+  std::vector<uint32_t> file_remap(entries.files.size());
+  std::vector<std::string> files;
+  for (size_t i = 0; i < entries.files.size(); ++i) {
+    if (file_used[i]) {
+      file_remap[i] = files.size();
+      files.push_back(std::move(entries.files[i]));
+    }
+  }
+
+  for (auto& file_info : file_infos) {
+    file_info.index = file_remap[file_info.index];
+  }
+  for (auto& result : results) {
+    for (auto& index : result.file_info_indexes) {
+      index = file_info_remap[index];
+    }
+  }
+
+  entries.files = std::move(files);
+  entries.file_infos = std::move(file_infos);
 }
 
 uint32_t
 Manifest::get_file_info_index(
+  Entries& entries,
   const std::string& path,
   const Digest& digest,
   const std::unordered_map<std::string, uint32_t>& mf_files,
@@ -277,16 +985,35 @@ Manifest::get_file_info_index(
   const time_t time_of_compilation,
   const bool save_timestamp)
 {
-  FileInfo fi;
-
+  uint32_t index;
   const auto f_it = mf_files.find(path);
   if (f_it != mf_files.end()) {
-    fi.index = f_it->second;
+    index = f_it->second;
   } else {
-    m_files.push_back(path);
-    fi.index = m_files.size() - 1;
+    entries.files.push_back(path);
+    index = entries.files.size() - 1;
   }
 
+  const auto fi =
+    make_file_info(index, path, digest, time_of_compilation, save_timestamp);
+  const auto fi_it = mf_file_infos.find(fi);
+  if (fi_it != mf_file_infos.end()) {
+    return fi_it->second;
+  } else {
+    entries.file_infos.push_back(fi);
+    return entries.file_infos.size() - 1;
+  }
+}
+
+Manifest::FileInfo
+Manifest::make_file_info(const uint32_t index,
+                         const std::string& path,
+                         const Digest& digest,
+                         const time_t time_of_compilation,
+                         const bool save_timestamp)
+{
+  FileInfo fi;
+  fi.index = index;
   fi.digest = digest;
 
   // file_stat.{m,c}time() have a resolution of 1 second, so we can cache the
@@ -318,95 +1045,133 @@ Manifest::get_file_info_index(
     fi.fsize = 0;
   }
 
-  const auto fi_it = mf_file_infos.find(fi);
-  if (fi_it != mf_file_infos.end()) {
-    return fi_it->second;
-  } else {
-    m_file_infos.push_back(fi);
-    return m_file_infos.size() - 1;
+  return fi;
+}
+
+void
+Manifest::stat_files(
+  std::unordered_map<uint32_t, FileStats>& stated_files) const
+{
+  const uint32_t count = file_count();
+  const uint32_t thread_count =
+    std::min(k_max_stat_threads, count / k_min_files_per_stat_thread);
+  if (thread_count < 2) {
+    // Not worth it, so let file_info_matches stat files lazily.
+    return;
+  }
+
+  // Stat errors are not logged here since logging is not thread-safe. Failed
+  // files are left out of stated_files so that file_info_matches retries (and
+  // logs) them when needed.
+  std::vector<nonstd::optional<FileStats>> file_stats(count);
+  ThreadPool thread_pool(thread_count);
+  const uint32_t chunk_size = (count + thread_count - 1) / thread_count;
+  for (uint32_t begin = 0; begin < count; begin += chunk_size) {
+    const uint32_t end = std::min(begin + chunk_size, count);
+    thread_pool.enqueue([this, begin, end, &file_stats] {
+      std::string path;
+      for (uint32_t i = begin; i < end; ++i) {
+        const auto path_view = file_path(i);
+        path.assign(path_view.data(), path_view.size());
+        const auto file_stat = Stat::stat(path);
+        if (file_stat) {
+          file_stats[i] =
+            FileStats{file_stat.size(), file_stat.mtime(), file_stat.ctime()};
+        }
+      }
+    });
+  }
+  thread_pool.shut_down();
+
+  stated_files.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    if (file_stats[i]) {
+      stated_files.emplace(i, *file_stats[i]);
+    }
   }
 }
 
 bool
-Manifest::result_matches(
+Manifest::file_info_matches(
   const Context& ctx,
-  const ResultEntry& result,
-  std::unordered_map<std::string, FileStats>& stated_files,
-  std::unordered_map<std::string, Digest>& hashed_files) const
-{
-  for (uint32_t file_info_index : result.file_info_indexes) {
-    const auto& fi = m_file_infos[file_info_index];
-    const auto& path = m_files[fi.index];
-
-    auto stated_files_iter = stated_files.find(path);
-    if (stated_files_iter == stated_files.end()) {
-      auto file_stat = Stat::stat(path, Stat::OnError::log);
-      if (!file_stat) {
-        return false;
-      }
-      FileStats st;
-      st.size = file_stat.size();
-      st.mtime = file_stat.mtime();
-      st.ctime = file_stat.ctime();
-      stated_files_iter = stated_files.emplace(path, st).first;
-    }
-    const FileStats& fs = stated_files_iter->second;
+  const uint32_t file_info_index,
+  std::unordered_map<uint32_t, FileStats>& stated_files,
+  std::unordered_map<uint32_t, Digest>& hashed_files,
+  std::string& path_buffer) const
+{
+  const auto fi = file_info(file_info_index);
+  const auto path = file_path(fi.index);
 
-    if (fi.fsize != fs.size) {
+  auto stated_files_iter = stated_files.find(fi.index);
+  if (stated_files_iter == stated_files.end()) {
+    path_buffer.assign(path.data(), path.size());
+#ifdef INODE_CACHE_SUPPORTED
+    auto file_stat = ctx.stat_cache.stat(path_buffer, Stat::OnError::log);
+#else
+    auto file_stat = Stat::stat(path_buffer, Stat::OnError::log);
+#endif
+    if (!file_stat) {
       return false;
     }
+    FileStats st;
+    st.size = file_stat.size();
+    st.mtime = file_stat.mtime();
+    st.ctime = file_stat.ctime();
+    stated_files_iter = stated_files.emplace(fi.index, st).first;
+  }
+  const FileStats& fs = stated_files_iter->second;
 
-    // Clang stores the mtime of the included files in the precompiled header,
-    // and will error out if that header is later used without rebuilding.
-    if ((ctx.config.compiler_type() == CompilerType::clang
-         || ctx.config.compiler_type() == CompilerType::other)
-        && ctx.args_info.output_is_precompiled_header
-        && !ctx.args_info.fno_pch_timestamp && fi.mtime != fs.mtime) {
-      LOG("Precompiled header includes {}, which has a new mtime", path);
-      return false;
-    }
+  if (fi.fsize != fs.size) {
+    return false;
+  }
 
-    if (ctx.config.sloppiness().is_enabled(core::Sloppy::file_stat_matches)) {
-      if (!(ctx.config.sloppiness().is_enabled(
-            core::Sloppy::file_stat_matches_ctime))) {
-        if (fi.mtime == fs.mtime && fi.ctime == fs.ctime) {
-          LOG("mtime/ctime hit for {}", path);
-          continue;
-        } else {
-          LOG("mtime/ctime miss for {}", path);
-        }
-      } else {
-        if (fi.mtime == fs.mtime) {
-          LOG("mtime hit for {}", path);
-          continue;
-        } else {
-          LOG("mtime miss for {}", path);
-        }
-      }
-    }
+  // Clang stores the mtime of the included files in the precompiled header,
+  // and will error out if that header is later used without rebuilding.
+  if ((ctx.config.compiler_type() == CompilerType::clang
+       || ctx.config.compiler_type() == CompilerType::other)
+      && ctx.args_info.output_is_precompiled_header
+      && !ctx.args_info.fno_pch_timestamp && fi.mtime != fs.mtime) {
+    LOG("Precompiled header includes {}, which has a new mtime", path);
+    return false;
+  }
 
-    auto hashed_files_iter = hashed_files.find(path);
-    if (hashed_files_iter == hashed_files.end()) {
-      Hash hash;
-      int ret = hash_source_code_file(ctx, hash, path, fs.size);
-      if (ret & HASH_SOURCE_CODE_ERROR) {
-        LOG("Failed hashing {}", path);
-        return false;
+  if (ctx.config.sloppiness().is_enabled(core::Sloppy::file_stat_matches)) {
+    if (!(ctx.config.sloppiness().is_enabled(
+          core::Sloppy::file_stat_matches_ctime))) {
+      if (fi.mtime == fs.mtime && fi.ctime == fs.ctime) {
+        LOG("mtime/ctime hit for {}", path);
+        return true;
+      } else {
+        LOG("mtime/ctime miss for {}", path);
       }
-      if (ret & HASH_SOURCE_CODE_FOUND_TIME) {
-        return false;
+    } else {
+      if (fi.mtime == fs.mtime) {
+        LOG("mtime hit for {}", path);
+        return true;
+      } else {
+        LOG("mtime miss for {}", path);
       }
-
-      Digest actual = hash.digest();
-      hashed_files_iter = hashed_files.emplace(path, actual).first;
     }
+  }
 
-    if (fi.digest != hashed_files_iter->second) {
+  auto hashed_files_iter = hashed_files.find(fi.index);
+  if (hashed_files_iter == hashed_files.end()) {
+    path_buffer.assign(path.data(), path.size());
+    Hash hash;
+    int ret = hash_source_code_file(ctx, hash, path_buffer, fs.size);
+    if (ret & HASH_SOURCE_CODE_ERROR) {
+      LOG("Failed hashing {}", path);
       return false;
     }
+    if (ret & HASH_SOURCE_CODE_FOUND_TIME) {
+      return false;
+    }
+
+    Digest actual = hash.digest();
+    hashed_files_iter = hashed_files.emplace(fi.index, actual).first;
   }
 
-  return true;
+  return fi.digest == hashed_files_iter->second;
 }
 
 void
@@ -414,30 +1179,32 @@ Manifest::dump(FILE* const stream) const
 {
   PRINT(stream, "Manifest format version: {}\n", k_format_version);
 
-  PRINT(stream, "File paths ({}):\n", m_files.size());
-  for (size_t i = 0; i < m_files.size(); ++i) {
-    PRINT(stream, "  {}: {}\n", i, m_files[i]);
+  PRINT(stream, "File paths ({}):\n", file_count());
+  for (uint32_t i = 0; i < file_count(); ++i) {
+    PRINT(stream, "  {}: {}\n", i, file_path(i));
   }
 
-  PRINT(stream, "File infos ({}):\n", m_file_infos.size());
-  for (size_t i = 0; i < m_file_infos.size(); ++i) {
+  PRINT(stream, "File infos ({}):\n", file_info_count());
+  for (uint32_t i = 0; i < file_info_count(); ++i) {
+    const auto fi = file_info(i);
     PRINT(stream, "  {}:\n", i);
-    PRINT(stream, "    Path index: {}\n", m_file_infos[i].index);
-    PRINT(stream, "    Hash: {}\n", m_file_infos[i].digest.to_string());
-    PRINT(stream, "    File size: {}\n", m_file_infos[i].fsize);
-    PRINT(stream, "    Mtime: {}\n", m_file_infos[i].mtime);
-    PRINT(stream, "    Ctime: {}\n", m_file_infos[i].ctime);
+    PRINT(stream, "    Path index: {}\n", fi.index);
+    PRINT(stream, "    Hash: {}\n", fi.digest.to_string());
+    PRINT(stream, "    File size: {}\n", fi.fsize);
+    PRINT(stream, "    Mtime: {}\n", fi.mtime);
+    PRINT(stream, "    Ctime: {}\n", fi.ctime);
   }
 
-  PRINT(stream, "Results ({}):\n", m_results.size());
-  for (size_t i = 0; i < m_results.size(); ++i) {
+  PRINT(stream, "Results ({}):\n", result_count());
+  for (uint32_t i = 0; i < result_count(); ++i) {
     PRINT(stream, "  {}:\n", i);
     PRINT_RAW(stream, "    File info indexes:");
-    for (uint32_t file_info_index : m_results[i].file_info_indexes) {
-      PRINT(stream, " {}", file_info_index);
+    const auto index_count = result_file_info_index_count(i);
+    for (uint32_t j = 0; j < index_count; ++j) {
+      PRINT(stream, " {}", result_file_info_index(i, j));
     }
     PRINT_RAW(stream, "\n");
-    PRINT(stream, "    Key: {}\n", m_results[i].key.to_string());
+    PRINT(stream, "    Key: {}\n", result_key(i).to_string());
   }
 }
 
@@ -19,8 +19,10 @@
 #pragma once
 
 #include <Digest.hpp>
+#include <compression/types.hpp>
 
 #include <third_party/nonstd/optional.hpp>
+#include <third_party/nonstd/string_view.hpp>
 
 #include <cstdint>
 #include <string>
@@ -39,15 +41,49 @@ class Manifest
 public:
   static const uint8_t k_format_version;
 
-  Manifest() = default;
+  Manifest();
 
-  void read(Reader& reader);
+  // Read a manifest serialized in `payload_size` bytes from `reader`. Throws
+  // core::Error on error, e.g. if the data doesn't match `payload_size`.
+  void read(Reader& reader, uint64_t payload_size);
   nonstd::optional<Digest> look_up_result_digest(const Context& ctx) const;
 
+  // Add a result as the most recently used one, evicting the least recently
+  // used results if there are too many. Returns false if the manifest is
+  // unchanged, i.e. if the result already was the most recently used one and
+  // no delta records have been merged. Throws core::Error if an included file's
+  // path is too long to be stored.
   bool add_result(const Digest& result_key,
                   std::unordered_map<std::string, Digest>& included_files,
                   time_t time_of_compilation,
                   bool save_timestamp);
+
+  // Make the newest result with key `result_key` the most recently used one
+  // unless it already is among the most recently used results. Returns false if
+  // the manifest is unchanged.
+  bool promote_result(const Digest& result_key);
+
+  // Create a record for a manifest delta file that adds a result as the most
+  // recently used one. The record refers to the paths and FileInfo entries of
+  // the manifest as read from its file and only holds those that the manifest
+  // doesn't have. Throws core::Error if an included file's path is too long to
+  // be stored.
+  std::string
+  delta_record(const Digest& result_key,
+               const std::unordered_map<std::string, Digest>& included_files,
+               time_t time_of_compilation,
+               bool save_timestamp,
+               compression::Type compression_type,
+               int8_t compression_level) const;
+
+  // Load the records of a manifest delta file on top of the manifest so that
+  // their results are looked up as the most recently used ones. Truncated or
+  // corrupt records and records created for another version of the manifest
+  // are ignored. Returns the number of merged records.
+  size_t merge_delta(nonstd::string_view delta);
+
+  // Serialization only covers results from merged delta records once they
+  // have been folded into the manifest by add_result or promote_result.
   size_t serialized_size() const;
   void write(Writer& writer) const;
 
@@ -63,7 +99,7 @@ private:
 
   struct FileInfo
   {
-    uint32_t index; // Index to m_files.
+    uint32_t index; // Index to files.
     Digest digest;  // Digest of referenced file.
     uint64_t fsize; // Size of referenced file.
     int64_t mtime;  // mtime of referenced file.
@@ -76,29 +112,82 @@ private:
 
   struct ResultEntry
   {
-    std::vector<uint32_t> file_info_indexes; // Indexes to m_file_infos.
+    std::vector<uint32_t> file_info_indexes; // Indexes to file_infos.
     Digest key;                              // Key of the result.
 
     bool operator==(const ResultEntry& other) const;
   };
 
-  std::vector<std::string> m_files;   // Names of referenced include files.
-  std::vector<FileInfo> m_file_infos; // Info about referenced include files.
-  std::vector<ResultEntry> m_results;
+  // Unpacked form of the manifest, only used when modifying the manifest.
+  struct Entries
+  {
+    std::vector<std::string> files;   // Names of referenced include files.
+    std::vector<FileInfo> file_infos; // Info about referenced include files.
+    std::vector<ResultEntry> results;
+  };
+
+  // The manifest in serialized form (excluding the format version), which is
+  // queried in place so that a lookup doesn't need to allocate memory per
+  // entry.
+  std::string m_data;
+  uint32_t m_file_count = 0;
+  uint32_t m_file_info_count = 0;
+  uint32_t m_result_count = 0;
+  uint32_t m_index_count = 0;
+  size_t m_file_info_offset = 0;
+  size_t m_result_offset = 0;
+  size_t m_index_offset = 0;
+  size_t m_path_data_offset = 0;
+
+  // Paths, FileInfo entries and results merged from manifest delta records,
+  // numbered after those in m_data.
+  std::vector<std::string> m_delta_files;
+  std::vector<FileInfo> m_delta_file_infos;
+  std::vector<ResultEntry> m_delta_results;
 
   void clear();
-  uint32_t get_file_info_index(
+  void set_data(std::string data);
+  Entries unpack() const;
+  void pack(const Entries& entries);
+
+  uint64_t data_checksum() const;
+
+  uint32_t file_count() const;
+  uint32_t file_info_count() const;
+  uint32_t result_count() const;
+
+  template<typename T> T get_int(size_t offset) const;
+  nonstd::string_view file_path(uint32_t index) const;
+  FileInfo file_info(uint32_t index) const;
+  uint32_t result_file_info_index_count(uint32_t result_index) const;
+  uint32_t result_file_info_index(uint32_t result_index, uint32_t i) const;
+  Digest result_key(uint32_t result_index) const;
+
+  static void check_path_lengths(
+    const std::unordered_map<std::string, Digest>& included_files);
+  static Entries read_delta_record(nonstd::string_view record,
+                                   uint64_t& base_checksum);
+  static bool add_result_entry(Entries& entries, ResultEntry&& entry);
+  static void evict_least_recently_used(Entries& entries);
+  static uint32_t get_file_info_index(
+    Entries& entries,
     const std::string& path,
     const Digest& digest,
     const std::unordered_map<std::string, uint32_t>& mf_files,
     const std::unordered_map<FileInfo, uint32_t>& mf_file_infos,
     time_t time_of_compilation,
     bool save_timestamp);
-  bool
-  result_matches(const Context& ctx,
-                 const ResultEntry& result,
-                 std::unordered_map<std::string, FileStats>& stated_files,
-                 std::unordered_map<std::string, Digest>& hashed_files) const;
+  static FileInfo make_file_info(uint32_t index,
+                                 const std::string& path,
+                                 const Digest& digest,
+                                 time_t time_of_compilation,
+                                 bool save_timestamp);
+  void stat_files(std::unordered_map<uint32_t, FileStats>& stated_files) const;
+  bool file_info_matches(const Context& ctx,
+                         uint32_t file_info_index,
+                         std::unordered_map<uint32_t, FileStats>& stated_files,
+                         std::unordered_map<uint32_t, Digest>& hashed_files,
+                         std::string& path_buffer) const;
 };
 
 } // namespace core
@@ -21,6 +21,7 @@
 #include <Util.hpp>
 #include <core/exceptions.hpp>
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <string>
@@ -37,6 +38,11 @@ public:
   // no bytes could be read.
   virtual size_t read(void* data, size_t count) = 0;
 
+  // Skip `count` bytes. The default implementation reads and discards the
+  // data; subclasses may override this with something cheaper. Throws
+  // `core::Error` on failure.
+  virtual void skip(uint64_t count);
+
   // Read an integer. Throws Error on failure.
   template<typename T> T read_int();
 
@@ -68,6 +74,20 @@ Reader::read_int(T& value)
   value = read_int<T>();
 }
 
+inline void
+Reader::skip(uint64_t count)
+{
+  uint8_t buffer[CCACHE_READ_BUFFER_SIZE];
+  while (count > 0) {
+    const auto bytes_read =
+      read(buffer, std::min(count, static_cast<uint64_t>(sizeof(buffer))));
+    if (bytes_read == 0) {
+      throw core::Error("Read underflow");
+    }
+    count -= bytes_read;
+  }
+}
+
 inline std::string
 Reader::read_str(const size_t length)
 {
@@ -0,0 +1,62 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#pragma once
+
+#include <core/Reader.hpp>
+#include <core/exceptions.hpp>
+
+#include "third_party/nonstd/string_view.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace core {
+
+// Reader that reads from a string.
+class StringReader : public Reader
+{
+public:
+  StringReader(nonstd::string_view input);
+
+  size_t read(void* data, size_t count) override;
+
+private:
+  nonstd::string_view m_input;
+};
+
+inline StringReader::StringReader(nonstd::string_view input) : m_input(input)
+{
+}
+
+inline size_t
+StringReader::read(void* const data, const size_t count)
+{
+  if (count == 0) {
+    return 0;
+  }
+  if (m_input.empty()) {
+    throw core::Error("Failed to read from string");
+  }
+  const size_t bytes_read = std::min(count, m_input.size());
+  memcpy(data, m_input.data(), bytes_read);
+  m_input.remove_prefix(bytes_read);
+  return bytes_read;
+}
+
+} // namespace core
@@ -0,0 +1,55 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#pragma once
+
+#include <core/Writer.hpp>
+
+#include <string>
+
+namespace core {
+
+// Writer that appends written data to a string.
+class StringWriter : public Writer
+{
+public:
+  StringWriter(std::string& output);
+
+  void write(const void* data, size_t size) override;
+  void finalize() override;
+
+private:
+  std::string& m_output;
+};
+
+inline StringWriter::StringWriter(std::string& output) : m_output(output)
+{
+}
+
+inline void
+StringWriter::write(const void* const data, const size_t size)
+{
+  m_output.append(static_cast<const char*>(data), size);
+}
+
+inline void
+StringWriter::finalize()
+{
+}
+
+} // namespace core
@@ -28,6 +28,7 @@
 #include <ResultExtractor.hpp>
 #include <ResultInspector.hpp>
 #include <ccache.hpp>
+#include <compression/types.hpp>
 #include <core/CacheEntryReader.hpp>
 #include <core/FileReader.hpp>
 #include <core/Manifest.hpp>
@@ -104,9 +105,13 @@ Common options:
                                limit); available suffixes: k, M, G, T (decimal)
                                and Ki, Mi, Gi, Ti (binary); default suffix: G
     -X, --recompress LEVEL     recompress the cache to level LEVEL (integer or
-                               "uncompressed") using the Zstandard algorithm;
-                               see "Cache compression" in the manual for details
+                               "uncompressed") using the algorithm chosen by
+                               compression_type; see "Cache compression" in
+                               the manual for details
     -o, --set-config KEY=VAL   set configuration item KEY to value VAL
+        --train-dictionary     train a Zstandard dictionary from small cache
+                               entries and use it for new entries; see "Cache
+                               compression" in the manual for details
     -x, --show-compression     show compression statistics
     -p, --show-config          show current configuration options in
                                human-readable format
@@ -172,7 +177,7 @@ inspect_path(const std::string& path)
   switch (header.entry_type) {
   case core::CacheEntryType::manifest: {
     core::Manifest manifest;
-    manifest.read(cache_entry_reader);
+    manifest.read(cache_entry_reader, header.payload_size());
     cache_entry_reader.finalize();
     manifest.dump(stdout);
     break;
@@ -218,6 +223,15 @@ print_compression_statistics(const storage::primary::CompressionStatistics& cs)
     C(FMT("{:.3f} x ", ratio)).right_align(),
     FMT("({:.1f}% space savings)", savings),
   });
+  if (cs.lz4_compr_size > 0) {
+    const double lz4_ratio =
+      static_cast<double>(cs.lz4_content_size) / cs.lz4_compr_size;
+    table.add_row({
+      "  LZ4 compressed:",
+      C(human_readable(cs.lz4_compr_size)).right_align(),
+      FMT("({:.3f} x compression ratio)", lz4_ratio),
+    });
+  }
   table.add_row({
     "Incompressible data:",
     C(human_readable(cs.incompr_size)).right_align(),
@@ -226,6 +240,46 @@ print_compression_statistics(const storage::primary::CompressionStatistics& cs)
   PRINT_RAW(stdout, table.render());
 }
 
+#ifdef INODE_CACHE_SUPPORTED
+static void
+print_inode_cache_statistics(const Config& config, const uint8_t verbosity)
+{
+  InodeCache inode_cache(config);
+  // Don't create the inode cache just to show that it's empty.
+  if (!config.inode_cache() || !Stat::stat(inode_cache.get_file())) {
+    return;
+  }
+  const int64_t hits = inode_cache.get_hits();
+  const int64_t misses = inode_cache.get_misses();
+  if (hits < 0 || misses < 0) {
+    return;
+  }
+  const int64_t errors = inode_cache.get_errors();
+  const int64_t lookups = hits + misses;
+
+  using C = util::TextTable::Cell;
+  util::TextTable table;
+  table.add_heading("Inode cache:");
+  table.add_row({
+    "  Hits:",
+    C(hits),
+    "/",
+    C(lookups),
+    lookups > 0 ? FMT("({:.2f} %)", 100.0 * hits / lookups) : "",
+  });
+  table.add_row({"  Misses:", C(misses)});
+  if (verbosity > 1 || errors > 0) {
+    table.add_row({"  Errors:", C(errors)});
+  }
+  table.add_row({"  Collisions:", C(inode_cache.get_collisions())});
+  table.add_row({"  Evictions:", C(inode_cache.get_evictions())});
+  if (verbosity > 0) {
+    table.add_row({"  Capacity:", C(inode_cache.get_capacity())});
+  }
+  PRINT_RAW(stdout, table.render());
+}
+#endif
+
 static void
 trim_dir(const std::string& dir,
          const uint64_t trim_max_size,
@@ -281,11 +335,20 @@ trim_dir(const std::string& dir,
         Util::format_human_readable_size(size_after));
 }
 
+static std::string
+get_features()
+{
+  std::string features = storage::get_features();
+  if (compression::is_supported(compression::Type::lz4)) {
+    features += " lz4-compression";
+  }
+  return features;
+}
+
 static std::string
 get_version_text()
 {
-  return FMT(
-    VERSION_TEXT, CCACHE_NAME, CCACHE_VERSION, storage::get_features());
+  return FMT(VERSION_TEXT, CCACHE_NAME, CCACHE_VERSION, get_features());
 }
 
 std::string
@@ -306,6 +369,7 @@ enum {
   INSPECT,
   PRINT_STATS,
   SHOW_LOG_STATS,
+  TRAIN_DICTIONARY,
   TRIM_DIR,
   TRIM_MAX_SIZE,
   TRIM_METHOD,
@@ -337,6 +401,7 @@ const option long_options[] = {
   {"show-config", no_argument, nullptr, 'p'},
   {"show-log-stats", no_argument, nullptr, SHOW_LOG_STATS},
   {"show-stats", no_argument, nullptr, 's'},
+  {"train-dictionary", no_argument, nullptr, TRAIN_DICTIONARY},
   {"trim-dir", required_argument, nullptr, TRIM_DIR},
   {"trim-max-size", required_argument, nullptr, TRIM_MAX_SIZE},
   {"trim-method", required_argument, nullptr, TRIM_METHOD},
@@ -400,6 +465,7 @@ process_main_options(int argc, const char* const* argv)
          != -1) {
     Config config;
     config.read();
+    compression::init(config);
 
     const std::string arg = optarg ? optarg : std::string();
 
@@ -572,12 +638,27 @@ process_main_options(int argc, const char* const* argv)
       PRINT_RAW(stdout,
                 statistics.format_human_readable(
                   config, last_updated, verbosity, false));
+#ifdef INODE_CACHE_SUPPORTED
+      print_inode_cache_statistics(config, verbosity);
+#endif
       if (verbosity == 0) {
         PRINT_RAW(stdout, "\nUse the -v/--verbose option for more details.\n");
       }
       break;
     }
 
+    case TRAIN_DICTIONARY: {
+      ProgressBar progress_bar("Scanning...");
+      const auto dictionary_id =
+        storage::primary::PrimaryStorage(config).train_dictionary(
+          [&](double progress) { progress_bar.update(progress); });
+      if (isatty(STDOUT_FILENO)) {
+        PRINT_RAW(stdout, "\n");
+      }
+      PRINT(stdout, "Created compression dictionary {}\n", dictionary_id);
+      break;
+    }
+
     case TRIM_DIR:
       if (!trim_max_size) {
         throw Error("please specify --trim-max-size when using --trim-dir");
@@ -614,7 +695,9 @@ process_main_options(int argc, const char* const* argv)
 
       ProgressBar progress_bar("Recompressing...");
       storage::primary::PrimaryStorage(config).recompress(
-        wanted_level, [&](double progress) { progress_bar.update(progress); });
+        wanted_level, config.compression_type(), [&](double progress) {
+          progress_bar.update(progress);
+        });
       break;
     }
 
@@ -632,6 +715,7 @@ process_main_options(int argc, const char* const* argv)
   if (evict_max_age || evict_namespace) {
     Config config;
     config.read();
+    compression::init(config);
 
     ProgressBar progress_bar("Evicting...");
     storage::primary::PrimaryStorage(config).evict(
@@ -44,10 +44,19 @@
 
 #ifdef _WIN32
 #  include "Finalizer.hpp"
+#else
+#  include <poll.h>
+#  include <spawn.h>
+
+#  include <csignal>
 #endif
 
 using nonstd::string_view;
 
+#if !defined(_WIN32) && !defined(environ)
+DLLIMPORT extern char** environ;
+#endif
+
 #ifdef _WIN32
 static int win32execute(const char* path,
                         const char* const* argv,
@@ -191,34 +200,87 @@ win32execute(const char* path,
 
 #else
 
-// Execute a compiler backend, capturing all output to the given paths the full
-// path to the compiler to run is in argv[0].
-int
-execute(Context& ctx, const char* const* argv, Fd&& fd_out, Fd&& fd_err)
+pid_t
+spawn_process(const char* const* argv,
+              int fd_out,
+              int fd_err,
+              bool search_path,
+              bool close_stdin)
 {
-  LOG("Executing {}", Util::format_argv_for_logging(argv));
-
-  {
-    SignalHandlerBlocker signal_handler_blocker;
-    ctx.compiler_pid = fork();
+  posix_spawn_file_actions_t file_actions;
+  posix_spawn_file_actions_init(&file_actions);
+  if (close_stdin) {
+    posix_spawn_file_actions_addclose(&file_actions, STDIN_FILENO);
+  }
+  posix_spawn_file_actions_adddup2(&file_actions, fd_out, STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2(&file_actions, fd_err, STDERR_FILENO);
+  if (fd_out > STDERR_FILENO) {
+    posix_spawn_file_actions_addclose(&file_actions, fd_out);
+  }
+  if (fd_err > STDERR_FILENO && fd_err != fd_out) {
+    posix_spawn_file_actions_addclose(&file_actions, fd_err);
   }
 
-  if (ctx.compiler_pid == -1) {
-    throw core::Fatal("Failed to fork: {}", strerror(errno));
+  // The caller may have blocked signals while starting the process, but they
+  // should not stay blocked in the new process.
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t sigmask;
+  sigemptyset(&sigmask);
+  posix_spawnattr_setsigmask(&attr, &sigmask);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+  pid_t pid;
+  const auto spawn = search_path ? posix_spawnp : posix_spawn;
+  const int error = spawn(&pid,
+                          argv[0],
+                          &file_actions,
+                          &attr,
+                          const_cast<char* const*>(argv),
+                          environ);
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&file_actions);
+
+  if (error != 0) {
+    errno = error;
+    return -1;
   }
+  return pid;
+}
 
-  if (ctx.compiler_pid == 0) {
-    // Child.
-    dup2(*fd_out, STDOUT_FILENO);
-    fd_out.close();
-    dup2(*fd_err, STDERR_FILENO);
-    fd_err.close();
-    exit(execv(argv[0], const_cast<char* const*>(argv)));
+static bool
+start_process(Context& ctx,
+              const char* const* argv,
+              Fd&& fd_out,
+              Fd&& fd_err)
+{
+  LOG("Executing {}", Util::format_argv_for_logging(argv));
+
+  pid_t pid;
+  int error;
+  {
+    SignalHandlerBlocker signal_handler_blocker;
+    pid = spawn_process(argv, *fd_out, *fd_err, false, false);
+    error = errno;
+    if (pid != -1) {
+      ctx.compiler_pid = pid;
+    }
   }
 
   fd_out.close();
   fd_err.close();
 
+  if (pid == -1) {
+    LOG("Failed to execute {}: {}", argv[0], strerror(error));
+    return false;
+  }
+  return true;
+}
+
+static int
+wait_for_process(Context& ctx)
+{
   int status;
   int result;
 
@@ -241,6 +303,108 @@ execute(Context& ctx, const char* const* argv, Fd&& fd_out, Fd&& fd_err)
   return WEXITSTATUS(status);
 }
 
+// Execute a compiler backend, capturing all output to the given paths the full
+// path to the compiler to run is in argv[0].
+int
+execute(Context& ctx, const char* const* argv, Fd&& fd_out, Fd&& fd_err)
+{
+  if (!start_process(ctx, argv, std::move(fd_out), std::move(fd_err))) {
+    return -1;
+  }
+  return wait_for_process(ctx);
+}
+
+static void
+create_pipe(Fd& read_fd, Fd& write_fd)
+{
+  int pipe_fds[2];
+  if (pipe(pipe_fds) != 0) {
+    throw core::Fatal("Failed to create pipe: {}", strerror(errno));
+  }
+  read_fd = Fd(pipe_fds[0]);
+  write_fd = Fd(pipe_fds[1]);
+  Util::set_cloexec_flag(*read_fd);
+}
+
+int
+execute(
+  Context& ctx,
+  const char* const* argv,
+  const std::function<void(const void* data, size_t size)>& stdout_receiver,
+  Fd&& fd_err)
+{
+  Fd read_fd;
+  Fd write_fd;
+  create_pipe(read_fd, write_fd);
+
+  if (!start_process(ctx, argv, std::move(write_fd), std::move(fd_err))) {
+    return -1;
+  }
+  if (!Util::read_fd(*read_fd, stdout_receiver)) {
+    LOG("Failed to read from pipe: {}", strerror(errno));
+  }
+  // Closing the pipe makes the process exit because of SIGPIPE if it's still
+  // writing.
+  read_fd.close();
+  return wait_for_process(ctx);
+}
+
+int
+execute(Context& ctx,
+        const char* const* argv,
+        std::string& stdout_data,
+        std::string& stderr_data)
+{
+  Fd stdout_read_fd;
+  Fd stdout_write_fd;
+  create_pipe(stdout_read_fd, stdout_write_fd);
+  Fd stderr_read_fd;
+  Fd stderr_write_fd;
+  create_pipe(stderr_read_fd, stderr_write_fd);
+
+  if (!start_process(
+        ctx, argv, std::move(stdout_write_fd), std::move(stderr_write_fd))) {
+    return -1;
+  }
+
+  // Read from both pipes as data arrives so that the process doesn't block on
+  // a full pipe.
+  std::string* const outputs[] = {&stdout_data, &stderr_data};
+  struct pollfd poll_fds[] = {{*stdout_read_fd, POLLIN, 0},
+                              {*stderr_read_fd, POLLIN, 0}};
+  size_t open_fds = 2;
+  char buffer[CCACHE_READ_BUFFER_SIZE];
+  while (open_fds > 0) {
+    if (poll(poll_fds, 2, -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG("Failed to poll pipes: {}", strerror(errno));
+      break;
+    }
+    for (size_t i = 0; i < 2; ++i) {
+      if (poll_fds[i].fd == -1 || poll_fds[i].revents == 0) {
+        continue;
+      }
+      const auto n = read(poll_fds[i].fd, buffer, sizeof(buffer));
+      if (n > 0) {
+        outputs[i]->append(buffer, n);
+      } else if (n == 0 || errno != EINTR) {
+        if (n == -1) {
+          LOG("Failed to read from pipe: {}", strerror(errno));
+        }
+        // Negative file descriptors are ignored by poll.
+        poll_fds[i].fd = -1;
+        --open_fds;
+      }
+    }
+  }
+
+  stdout_read_fd.close();
+  stderr_read_fd.close();
+  return wait_for_process(ctx);
+}
+
 void
 execute_noreturn(const char* const* argv, const std::string& /*temp_dir*/)
 {
@@ -20,12 +20,47 @@
 
 #include "Fd.hpp"
 
+#include <functional>
 #include <string>
 
+#ifndef _WIN32
+#  include <sys/types.h>
+#endif
+
 class Context;
 
 int execute(Context& ctx, const char* const* argv, Fd&& fd_out, Fd&& fd_err);
 
+#ifndef _WIN32
+// Like execute but standard output is read through a pipe and passed to
+// `stdout_receiver` while the process runs.
+int execute(
+  Context& ctx,
+  const char* const* argv,
+  const std::function<void(const void* data, size_t size)>& stdout_receiver,
+  Fd&& fd_err);
+
+// Like execute but standard output and standard error are read through pipes
+// into `stdout_data` and `stderr_data`.
+int execute(Context& ctx,
+            const char* const* argv,
+            std::string& stdout_data,
+            std::string& stderr_data);
+#endif
+
+#ifndef _WIN32
+// Start a new process running `argv` with standard output and standard error
+// redirected to `fd_out` and `fd_err`. argv[0] is searched for in `$PATH` if
+// `search_path` is true. Standard input is closed if `close_stdin` is true.
+//
+// Returns the process ID, or -1 with errno set on failure.
+pid_t spawn_process(const char* const* argv,
+                    int fd_out,
+                    int fd_err,
+                    bool search_path,
+                    bool close_stdin);
+#endif
+
 void execute_noreturn(const char* const* argv, const std::string& temp_dir);
 
 // Find an executable named `name` in `$PATH`. Exclude any executables that are
@@ -52,10 +52,19 @@
 #  include <immintrin.h>
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define HAVE_SSE2_SCAN
+#endif
+
 using nonstd::string_view;
 
 namespace {
 
+// Source code is checked for temporal macros and hashed in chunks of this size
+// to keep each chunk in the CPU cache between the two passes.
+const size_t k_hash_chunk_size = 16 * 1024;
+
 // Returns one of HASH_SOURCE_CODE_FOUND_DATE, HASH_SOURCE_CODE_FOUND_TIME or
 // HASH_SOURCE_CODE_FOUND_TIMESTAMP if "_DATE__", "_TIME__" or "_TIMESTAMP__"
 // starts at str[pos].
@@ -93,17 +102,20 @@ check_for_temporal_macros_helper(string_view str, size_t pos)
   return 0;
 }
 
+// Like check_for_temporal_macros but only looks for macros whose leading
+// underscore is at a position in [begin, end).
 int
-check_for_temporal_macros_bmh(string_view str)
+check_for_temporal_macros_bmh(string_view str, size_t begin, size_t end)
 {
   int result = 0;
 
   // We're using the Boyer-Moore-Horspool algorithm, which searches starting
   // from the *end* of the needle. Our needles are 8 characters long, so i
-  // starts at 7.
-  size_t i = 7;
+  // starts at begin + 7.
+  size_t i = begin + 7;
+  const size_t i_end = std::min(end + 7, str.length());
 
-  while (i < str.length()) {
+  while (i < i_end) {
     // Check whether the substring ending at str[i] has the form "_....E..". On
     // the assumption that 'E' is less common in source than '_', we check
     // str[i-2] first.
@@ -121,7 +133,7 @@ check_for_temporal_macros_bmh(string_view str)
 
 #ifdef HAVE_AVX2
 #  ifndef _MSC_VER // MSVC does not need explicit enabling of AVX2.
-int check_for_temporal_macros_avx2(string_view str)
+int check_for_temporal_macros_avx2(string_view str, size_t begin, size_t end)
   __attribute__((target("avx2")));
 #  endif
 
@@ -129,7 +141,7 @@ int check_for_temporal_macros_avx2(string_view str)
 // __TIME__ and __TIMESTAMP__, is heavily inspired by
 // <http://0x80.pl/articles/simd-strfind.html>.
 int
-check_for_temporal_macros_avx2(string_view str)
+check_for_temporal_macros_avx2(string_view str, size_t begin, size_t end)
 {
   int result = 0;
 
@@ -137,8 +149,8 @@ check_for_temporal_macros_avx2(string_view str)
   const __m256i first = _mm256_set1_epi8('_');
   const __m256i last = _mm256_set1_epi8('E');
 
-  size_t pos = 0;
-  for (; pos + 5 + 32 <= str.length(); pos += 32) {
+  size_t pos = begin;
+  for (; pos + 32 <= end && pos + 5 + 32 <= str.length(); pos += 32) {
     // Load 32 bytes from the current position in the input string, with
     // block_last being offset 5 bytes (i.e. the offset of 'E' in all three
     // macros).
@@ -174,12 +186,165 @@ check_for_temporal_macros_avx2(string_view str)
     }
   }
 
-  result |= check_for_temporal_macros_bmh(str.substr(pos));
+  result |= check_for_temporal_macros_bmh(str, pos, end);
 
   return result;
 }
 #endif
 
+bool
+is_preprocessed_directive(string_view str, size_t pos)
+{
+  switch (str[pos]) {
+  case '#':
+    return pos == 0 || str[pos - 1] == '\n';
+  case '.':
+    return pos + 2 < str.length() && str[pos + 1] == 'i'
+           && str[pos + 2] == 'n';
+  case '_':
+    return pos + 2 < str.length() && str[pos + 1] == '_'
+           && str[pos + 2] == '_';
+  default:
+    return false;
+  }
+}
+
+size_t
+find_preprocessed_directive_scalar(string_view str, size_t pos)
+{
+  for (; pos < str.length(); ++pos) {
+    if (is_preprocessed_directive(str, pos)) {
+      return pos;
+    }
+  }
+  return pos;
+}
+
+inline unsigned
+count_trailing_zeros(uint32_t mask)
+{
+#ifndef _MSC_VER
+  return __builtin_ctz(mask);
+#else
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return index;
+#endif
+}
+
+#ifdef HAVE_SSE2_SCAN
+// Compares the byte before and the two bytes after each of 16 positions at
+// once. The byte before position 0 is checked separately.
+size_t
+find_preprocessed_directive_sse2(string_view str, size_t pos)
+{
+  if (pos == 0) {
+    if (str.empty() || is_preprocessed_directive(str, 0)) {
+      return 0;
+    }
+    pos = 1;
+  }
+
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i hash = _mm_set1_epi8('#');
+  const __m128i dot = _mm_set1_epi8('.');
+  const __m128i letter_i = _mm_set1_epi8('i');
+  const __m128i letter_n = _mm_set1_epi8('n');
+  const __m128i underscore = _mm_set1_epi8('_');
+
+  for (; pos + 16 + 2 <= str.length(); pos += 16) {
+    const __m128i prev =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(&str[pos - 1]));
+    const __m128i cur =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(&str[pos]));
+    const __m128i next =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(&str[pos + 1]));
+    const __m128i next2 =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(&str[pos + 2]));
+
+    const __m128i at_hash = _mm_and_si128(_mm_cmpeq_epi8(prev, newline),
+                                          _mm_cmpeq_epi8(cur, hash));
+    const __m128i at_dot_in = _mm_and_si128(
+      _mm_cmpeq_epi8(cur, dot),
+      _mm_and_si128(_mm_cmpeq_epi8(next, letter_i),
+                    _mm_cmpeq_epi8(next2, letter_n)));
+    const __m128i at_underscores = _mm_and_si128(
+      _mm_cmpeq_epi8(cur, underscore),
+      _mm_and_si128(_mm_cmpeq_epi8(next, underscore),
+                    _mm_cmpeq_epi8(next2, underscore)));
+
+    const uint32_t mask = _mm_movemask_epi8(
+      _mm_or_si128(at_hash, _mm_or_si128(at_dot_in, at_underscores)));
+    if (mask != 0) {
+      return pos + count_trailing_zeros(mask);
+    }
+  }
+
+  return find_preprocessed_directive_scalar(str, pos);
+}
+#endif
+
+#ifdef HAVE_AVX2
+#  ifndef _MSC_VER // MSVC does not need explicit enabling of AVX2.
+size_t find_preprocessed_directive_avx2(string_view str, size_t pos)
+  __attribute__((target("avx2")));
+#  endif
+
+// Same as find_preprocessed_directive_sse2 but for 32 positions at once. The
+// remaining tail is handled by the SSE2 variant if available.
+size_t
+find_preprocessed_directive_avx2(string_view str, size_t pos)
+{
+  if (pos == 0) {
+    if (str.empty() || is_preprocessed_directive(str, 0)) {
+      return 0;
+    }
+    pos = 1;
+  }
+
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i hash = _mm256_set1_epi8('#');
+  const __m256i dot = _mm256_set1_epi8('.');
+  const __m256i letter_i = _mm256_set1_epi8('i');
+  const __m256i letter_n = _mm256_set1_epi8('n');
+  const __m256i underscore = _mm256_set1_epi8('_');
+
+  for (; pos + 32 + 2 <= str.length(); pos += 32) {
+    const __m256i prev =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&str[pos - 1]));
+    const __m256i cur =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&str[pos]));
+    const __m256i next =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&str[pos + 1]));
+    const __m256i next2 =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&str[pos + 2]));
+
+    const __m256i at_hash = _mm256_and_si256(_mm256_cmpeq_epi8(prev, newline),
+                                             _mm256_cmpeq_epi8(cur, hash));
+    const __m256i at_dot_in = _mm256_and_si256(
+      _mm256_cmpeq_epi8(cur, dot),
+      _mm256_and_si256(_mm256_cmpeq_epi8(next, letter_i),
+                       _mm256_cmpeq_epi8(next2, letter_n)));
+    const __m256i at_underscores = _mm256_and_si256(
+      _mm256_cmpeq_epi8(cur, underscore),
+      _mm256_and_si256(_mm256_cmpeq_epi8(next, underscore),
+                       _mm256_cmpeq_epi8(next2, underscore)));
+
+    const uint32_t mask = _mm256_movemask_epi8(
+      _mm256_or_si256(at_hash, _mm256_or_si256(at_dot_in, at_underscores)));
+    if (mask != 0) {
+      return pos + count_trailing_zeros(mask);
+    }
+  }
+
+#  ifdef HAVE_SSE2_SCAN
+  return find_preprocessed_directive_sse2(str, pos);
+#  else
+  return find_preprocessed_directive_scalar(str, pos);
+#  endif
+}
+#endif
+
 int
 hash_source_code_file_nocache(const Context& ctx,
                               Hash& hash,
@@ -219,17 +384,54 @@ get_content_type(const Config& config, const std::string& path)
 }
 #endif
 
+int
+check_for_temporal_macros(string_view str, size_t begin, size_t end)
+{
+#ifdef HAVE_AVX2
+  if (blake3_cpu_supports_avx2()) {
+    return check_for_temporal_macros_avx2(str, begin, end);
+  }
+#endif
+  return check_for_temporal_macros_bmh(str, begin, end);
+}
+
 } // namespace
 
 int
 check_for_temporal_macros(string_view str)
 {
+  return check_for_temporal_macros(str, 0, str.length());
+}
+
+size_t
+find_preprocessed_directive(string_view str, size_t pos)
+{
+#ifdef HAVE_AVX2
+  if (blake3_cpu_supports_avx2()) {
+    return find_preprocessed_directive_avx2(str, pos);
+  }
+#endif
+#ifdef HAVE_SSE2_SCAN
+  return find_preprocessed_directive_sse2(str, pos);
+#else
+  return find_preprocessed_directive_scalar(str, pos);
+#endif
+}
+
+std::vector<FindPreprocessedDirectiveFunction>
+find_preprocessed_directive_variants()
+{
+  std::vector<FindPreprocessedDirectiveFunction> variants{
+    find_preprocessed_directive_scalar};
+#ifdef HAVE_SSE2_SCAN
+  variants.push_back(find_preprocessed_directive_sse2);
+#endif
 #ifdef HAVE_AVX2
   if (blake3_cpu_supports_avx2()) {
-    return check_for_temporal_macros_avx2(str);
+    variants.push_back(find_preprocessed_directive_avx2);
   }
 #endif
-  return check_for_temporal_macros_bmh(str);
+  return variants;
 }
 
 int
@@ -240,15 +442,19 @@ hash_source_code_string(const Context& ctx,
 {
   int result = HASH_SOURCE_CODE_OK;
 
-  // Check for __DATE__, __TIME__ and __TIMESTAMP__if the sloppiness
-  // configuration tells us we should.
-  if (!(ctx.config.sloppiness().is_enabled(core::Sloppy::time_macros))) {
-    result |= check_for_temporal_macros(str);
+  // Check for __DATE__, __TIME__ and __TIMESTAMP__ if the sloppiness
+  // configuration tells us we should, and hash the source string. Both are done
+  // a chunk at a time so that the string is only read once from memory.
+  const bool check_temporal_macros =
+    !ctx.config.sloppiness().is_enabled(core::Sloppy::time_macros);
+  for (size_t pos = 0; pos < str.length(); pos += k_hash_chunk_size) {
+    const size_t chunk_end = std::min(pos + k_hash_chunk_size, str.length());
+    if (check_temporal_macros) {
+      result |= check_for_temporal_macros(str, pos, chunk_end);
+    }
+    hash.hash(str.substr(pos, chunk_end - pos));
   }
 
-  // Hash the source string.
-  hash.hash(str);
-
   if (result & HASH_SOURCE_CODE_FOUND_DATE) {
     LOG("Found __DATE__ in {}", path);
 
@@ -482,43 +688,37 @@ hash_command_output(Hash& hash,
     throw core::Fatal("pipe failed: {}", strerror(errno));
   }
 
-  pid_t pid = fork();
+  Util::set_cloexec_flag(pipefd[0]);
+  const pid_t pid =
+    spawn_process(argv.data(), pipefd[1], pipefd[1], true, true);
   if (pid == -1) {
-    throw core::Fatal("fork failed: {}", strerror(errno));
-  }
-
-  if (pid == 0) {
-    // Child.
+    LOG("Failed to execute {}: {}", argv[0], strerror(errno));
     close(pipefd[0]);
-    close(0);
-    dup2(pipefd[1], 1);
-    dup2(pipefd[1], 2);
-    _exit(execvp(argv[0], const_cast<char* const*>(argv.data())));
-    // Never reached.
-  } else {
-    // Parent.
     close(pipefd[1]);
-    bool ok = hash.hash_fd(pipefd[0]);
-    if (!ok) {
-      LOG("Error hashing compiler check command output: {}", strerror(errno));
-    }
-    close(pipefd[0]);
+    return false;
+  }
+  close(pipefd[1]);
 
-    int status;
-    int result;
-    while ((result = waitpid(pid, &status, 0)) != pid) {
-      if (result == -1 && errno == EINTR) {
-        continue;
-      }
-      LOG("waitpid failed: {}", strerror(errno));
-      return false;
-    }
-    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
-      LOG("Compiler check command returned {}", WEXITSTATUS(status));
-      return false;
+  bool ok = hash.hash_fd(pipefd[0]);
+  if (!ok) {
+    LOG("Error hashing compiler check command output: {}", strerror(errno));
+  }
+  close(pipefd[0]);
+
+  int status;
+  int result;
+  while ((result = waitpid(pid, &status, 0)) != pid) {
+    if (result == -1 && errno == EINTR) {
+      continue;
     }
-    return ok;
+    LOG("waitpid failed: {}", strerror(errno));
+    return false;
   }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    LOG("Compiler check command returned {}", WEXITSTATUS(status));
+    return false;
+  }
+  return ok;
 #endif
 }
 
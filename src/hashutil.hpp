@@ -22,6 +22,7 @@
 
 #include <cstddef>
 #include <string>
+#include <vector>
 
 class Config;
 class Context;
@@ -41,6 +42,21 @@ const int HASH_SOURCE_CODE_FOUND_TIMESTAMP = (1 << 3);
 // appropriately.
 int check_for_temporal_macros(nonstd::string_view str);
 
+// Returns the position of the first place in the preprocessed output `str`, at
+// or after `pos`, that may start something that process_preprocessed_file
+// needs to look at: a '#' first on a line (linemarkers and pragmas), ".in" (as
+// in ".incbin") or "___" (as in distcc-pump banners). Returns str.length() if
+// there is no such place.
+size_t find_preprocessed_directive(nonstd::string_view str, size_t pos);
+
+// Tested by unit tests: the implementations that find_preprocessed_directive
+// chooses from, i.e. the scalar one and the vectorized ones that the compiler
+// and the CPU support.
+using FindPreprocessedDirectiveFunction = size_t (*)(nonstd::string_view str,
+                                                     size_t pos);
+std::vector<FindPreprocessedDirectiveFunction>
+find_preprocessed_directive_variants();
+
 // Hash a string. Returns a bitmask of HASH_SOURCE_CODE_* results.
 int hash_source_code_string(const Context& ctx,
                             Hash& hash,
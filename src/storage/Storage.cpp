@@ -21,10 +21,16 @@
 #include <Config.hpp>
 #include <Logging.hpp>
 #include <MiniTrace.hpp>
+#include <Result.hpp>
 #include <TemporaryFile.hpp>
 #include <Util.hpp>
 #include <assertions.hpp>
+#include <core/CacheEntryHeader.hpp>
+#include <core/CacheEntryReader.hpp>
+#include <core/CacheEntryWriter.hpp>
 #include <core/Statistic.hpp>
+#include <core/StringReader.hpp>
+#include <core/StringWriter.hpp>
 #include <core/exceptions.hpp>
 #include <fmtmacros.hpp>
 #include <storage/secondary/FileStorage.hpp>
@@ -203,6 +209,46 @@ get_storage(const Url& url)
   }
 }
 
+// Return `data` (a cache entry) recompressed without compression dictionary
+// since dictionaries only exist in primary storage.
+static std::string
+without_compression_dictionary(const std::string& data)
+{
+  core::StringReader string_reader(data);
+  core::CacheEntryReader reader(string_reader);
+  const auto header = reader.header();
+  if (header.compression_dictionary_id == 0) {
+    return data;
+  }
+
+  std::string result;
+  core::StringWriter string_writer(result);
+  core::CacheEntryWriter writer(string_writer, header, false);
+  uint8_t buffer[CCACHE_READ_BUFFER_SIZE];
+  uint64_t bytes_left = header.payload_size();
+  while (bytes_left > 0) {
+    const auto bytes_read =
+      reader.read(buffer, std::min<uint64_t>(sizeof(buffer), bytes_left));
+    writer.write(buffer, bytes_read);
+    bytes_left -= bytes_read;
+  }
+  reader.finalize();
+  writer.finalize();
+  return result;
+}
+
+// Return the entry at `path` in primary storage in a form suitable for
+// secondary storage.
+static std::string
+read_entry_for_secondary_storage(const std::string& path,
+                                 const core::CacheEntryType type)
+{
+  // Raw files of a result only exist in primary storage, so embed them.
+  return type == core::CacheEntryType::result
+           ? Result::serialize_with_embedded_files(path)
+           : without_compression_dictionary(Util::read_file(path));
+}
+
 Storage::Storage(const Config& config) : primary(config), m_config(config)
 {
 }
@@ -246,7 +292,7 @@ Storage::get(const Digest& key, const core::CacheEntryType type)
       if (should_put_in_secondary_storage) {
         std::string value;
         try {
-          value = Util::read_file(*path);
+          value = read_entry_for_secondary_storage(*path, type);
         } catch (const core::Error& e) {
           LOG("Failed to read {}: {}", *path, e.what());
           return path; // Don't indicate failure since primary storage was OK.
@@ -310,7 +356,7 @@ Storage::put(const Digest& key,
   if (should_put_in_secondary_storage) {
     std::string value;
     try {
-      value = Util::read_file(*path);
+      value = read_entry_for_secondary_storage(*path, type);
     } catch (const core::Error& e) {
       LOG("Failed to read {}: {}", *path, e.what());
       return true; // Don't indicate failure since primary storage was OK.
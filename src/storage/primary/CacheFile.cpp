@@ -37,6 +37,8 @@ CacheFile::type() const
 {
   if (util::ends_with(m_path, "M")) {
     return Type::manifest;
+  } else if (util::ends_with(m_path, "D")) {
+    return Type::manifest_delta;
   } else if (util::ends_with(m_path, Result::k_file_suffix)) {
     return Type::result;
   } else if (util::ends_with(m_path, "W")) {
@@ -19,6 +19,7 @@
 #include "PrimaryStorage.hpp"
 
 #include <Config.hpp>
+#include <Fd.hpp>
 #include <Logging.hpp>
 #include <MiniTrace.hpp>
 #include <Util.hpp>
@@ -28,6 +29,9 @@
 #include <fmtmacros.hpp>
 #include <storage/primary/StatsFile.hpp>
 #include <util/file.hpp>
+#include <util/string.hpp>
+
+#include <fcntl.h>
 
 #ifdef HAVE_UNISTD_H
 #  include <unistd.h>
@@ -266,6 +270,90 @@ PrimaryStorage::remove(const Digest& key, const core::CacheEntryType type)
   }
 }
 
+std::string
+PrimaryStorage::get_manifest_delta_path(const std::string& manifest_path)
+{
+  ASSERT(util::ends_with(manifest_path, "M"));
+  return manifest_path.substr(0, manifest_path.length() - 1) + "D";
+}
+
+nonstd::optional<uint64_t>
+PrimaryStorage::append_to_manifest_delta(const Digest& key,
+                                         const nonstd::string_view record)
+{
+  MTR_SCOPE("primary_storage", "append_to_manifest_delta");
+
+  const auto cache_file =
+    look_up_cache_file(key, core::CacheEntryType::manifest);
+  if (!cache_file.stat) {
+    return nonstd::nullopt;
+  }
+
+  const auto delta_path = get_manifest_delta_path(cache_file.path);
+  const auto old_stat = Stat::stat(delta_path);
+
+  // With O_APPEND the write lands at the end of the file atomically, so
+  // records from concurrent ccache invocations are not interleaved.
+  Fd fd(
+    open(delta_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_BINARY, 0666));
+  if (!fd) {
+    LOG("Failed to open {}: {}", delta_path, strerror(errno));
+    return nonstd::nullopt;
+  }
+  try {
+    Util::write_fd(*fd, record.data(), record.size());
+  } catch (const core::Error& e) {
+    LOG("Failed to write to {}: {}", delta_path, e.what());
+    return nonstd::nullopt;
+  }
+  fd.close();
+
+  const auto new_stat = Stat::stat(delta_path, Stat::OnError::log);
+  if (!new_stat) {
+    return nonstd::nullopt;
+  }
+
+  LOG("Appended {} bytes to {}", record.size(), delta_path);
+
+  m_manifest_key = key;
+  m_manifest_path = cache_file.path;
+  m_manifest_counter_updates.increment(
+    Statistic::cache_size_kibibyte,
+    Util::size_change_kibibyte(old_stat, new_stat));
+  m_manifest_counter_updates.increment(Statistic::files_in_cache,
+                                       old_stat ? 0 : 1);
+
+  return new_stat.size();
+}
+
+void
+PrimaryStorage::remove_manifest_delta(const Digest& key)
+{
+  const auto cache_file =
+    look_up_cache_file(key, core::CacheEntryType::manifest);
+  const auto delta_path = get_manifest_delta_path(cache_file.path);
+  const auto delta_stat = Stat::stat(delta_path);
+  if (!delta_stat || !Util::unlink_safe(delta_path)) {
+    return;
+  }
+
+  LOG("Removed {}", delta_path);
+
+  if (!m_config.stats()) {
+    return;
+  }
+
+  // Counter updates can't be negative, so account for the removed file in the
+  // level 1 stats file right away.
+  const auto stats_file =
+    FMT("{}/{:x}/stats", m_config.cache_dir(), key.bytes()[0] >> 4);
+  StatsFile(stats_file).update([&](auto& cs) {
+    cs.increment(Statistic::cache_size_kibibyte,
+                 Util::size_change_kibibyte(delta_stat, Stat()));
+    cs.increment(Statistic::files_in_cache, -1);
+  });
+}
+
 void
 PrimaryStorage::increment_statistic(const Statistic statistic,
                                     const int64_t value)
@@ -378,11 +466,29 @@ PrimaryStorage::update_stats_and_maybe_move_cache_file(
         // Two ccache processes may move the file at the same time, so failure
         // to rename is OK.
       }
+      if (type == core::CacheEntryType::manifest) {
+        // Keep the manifest delta file next to the manifest file.
+        const auto current_delta_path = get_manifest_delta_path(current_path);
+        if (Stat::stat(current_delta_path)) {
+          try {
+            Util::rename(current_delta_path,
+                         get_manifest_delta_path(wanted_path));
+          } catch (const core::Error&) {
+            // Same as above.
+          }
+        }
+      }
     }
   }
   return counters;
 }
 
+std::string
+PrimaryStorage::get_compiler_identity_path(const Digest& key) const
+{
+  return get_path_in_cache(k_min_cache_levels, key.to_string() + "C");
+}
+
 std::string
 PrimaryStorage::get_path_in_cache(const uint8_t level,
                                   const nonstd::string_view name) const
@@ -19,12 +19,14 @@
 #pragma once
 
 #include <Digest.hpp>
+#include <compression/types.hpp>
 #include <core/StatisticsCounters.hpp>
 #include <core/types.hpp>
 #include <storage/primary/util.hpp>
 #include <storage/types.hpp>
 
 #include <third_party/nonstd/optional.hpp>
+#include <third_party/nonstd/string_view.hpp>
 
 #include <cstdint>
 
@@ -39,6 +41,8 @@ struct CompressionStatistics
   uint64_t content_size;
   uint64_t incompr_size;
   uint64_t on_disk_size;
+  uint64_t lz4_compr_size;
+  uint64_t lz4_content_size;
 };
 
 class PrimaryStorage
@@ -61,6 +65,28 @@ public:
 
   void remove(const Digest& key, core::CacheEntryType type);
 
+  // --- Manifest deltas ---
+
+  // Returns the path of the delta file belonging to the manifest file at
+  // `manifest_path`.
+  static std::string get_manifest_delta_path(const std::string& manifest_path);
+
+  // Append `record` to the delta file of manifest `key` in a single write.
+  // Returns the size of the delta file after appending, or nullopt if the
+  // manifest doesn't exist or appending failed.
+  nonstd::optional<uint64_t>
+  append_to_manifest_delta(const Digest& key, nonstd::string_view record);
+
+  // Remove the delta file of manifest `key`, if any.
+  void remove_manifest_delta(const Digest& key);
+
+  // --- Compiler identities ---
+
+  // Returns the path of the file storing the compiler identity with key `key`.
+  // The file is stored among the cache entries so that cleanup and wiping
+  // remove it like any other file in the cache.
+  std::string get_compiler_identity_path(const Digest& key) const;
+
   // --- Statistics ---
 
   void increment_statistic(core::Statistic statistic, int64_t value = 1);
@@ -91,8 +117,14 @@ public:
   get_compression_statistics(const ProgressReceiver& progress_receiver) const;
 
   void recompress(nonstd::optional<int8_t> level,
+                  compression::Type type,
                   const ProgressReceiver& progress_receiver);
 
+  // Train a compression dictionary from small cache entries and make it the
+  // dictionary to use for new entries. Returns the dictionary ID. Throws
+  // core::Error on error.
+  uint32_t train_dictionary(const ProgressReceiver& progress_receiver);
+
 private:
   const Config& m_config;
 
@@ -130,6 +130,9 @@ PrimaryStorage::clean_dir(const std::string& subdir,
     }
 
     if (namespace_ && file.type() == CacheFile::Type::raw) {
+      // Raw files are named <prefix><entry_number>W for result <prefix>R, and
+      // a result has at most one entry per file type, so the entry number is a
+      // single digit.
       const auto result_filename =
         FMT("{}R", file.path().substr(0, file.path().length() - 2));
       raw_files_map[result_filename].push_back(file.path());
@@ -184,8 +187,18 @@ PrimaryStorage::clean_dir(const std::string& subdir,
       }
 
       // For namespace eviction we need to remove raw files based on result
-      // filename since they don't have a header.
-      if (file.type() == CacheFile::Type::result) {
+      // filename and manifest delta files based on manifest filename since
+      // they don't have a header.
+      if (file.type() == CacheFile::Type::manifest) {
+        const auto delta_path = get_manifest_delta_path(file.path());
+        const auto delta_stat = Stat::lstat(delta_path);
+        if (delta_stat) {
+          delete_file(delta_path,
+                      delta_stat.size_on_disk(),
+                      &cache_size,
+                      &files_in_cache);
+        }
+      } else if (file.type() == CacheFile::Type::result) {
         const auto entry = raw_files_map.find(file.path());
         if (entry != raw_files_map.end()) {
           for (const auto& raw_file : entry->second) {
@@ -24,8 +24,10 @@
 #include <Logging.hpp>
 #include <Result.hpp>
 #include <ThreadPool.hpp>
+#include <Util.hpp>
 #include <assertions.hpp>
-#include <compression/ZstdCompressor.hpp>
+#include <compression/dictionary.hpp>
+#include <compression/types.hpp>
 #include <core/CacheEntryReader.hpp>
 #include <core/CacheEntryWriter.hpp>
 #include <core/FileReader.hpp>
@@ -43,15 +45,21 @@
 #  include <unistd.h>
 #endif
 
+#include <ctime>
 #include <memory>
 #include <string>
 #include <thread>
+#include <vector>
 
 namespace storage {
 namespace primary {
 
 namespace {
 
+// Entries not used (cache hits update the modification time) for at least this
+// many seconds are considered cold by adaptive compression.
+const time_t k_min_cold_entry_age = 24 * 60 * 60;
+
 class RecompressionStatistics
 {
 public:
@@ -129,7 +137,8 @@ open_file(const std::string& path, const char* const mode)
 static std::unique_ptr<core::CacheEntryReader>
 create_reader(const CacheFile& cache_file, core::Reader& reader)
 {
-  if (cache_file.type() == CacheFile::Type::unknown) {
+  if (cache_file.type() == CacheFile::Type::manifest_delta
+      || cache_file.type() == CacheFile::Type::unknown) {
     throw core::Error("unknown file type for {}", cache_file.path());
   }
 
@@ -146,7 +155,9 @@ static void
 recompress_file(RecompressionStatistics& statistics,
                 const std::string& stats_file,
                 const CacheFile& cache_file,
-                const nonstd::optional<int8_t> level)
+                const nonstd::optional<int8_t> level,
+                const compression::Type type,
+                const bool adaptive)
 {
   auto file = open_file(cache_file.path(), "rb");
   core::FileReader file_reader(file.get());
@@ -154,34 +165,59 @@ recompress_file(RecompressionStatistics& statistics,
 
   const auto old_stat = Stat::stat(cache_file.path(), Stat::OnError::log);
   const uint64_t content_size = reader->header().entry_size;
-  const int8_t wanted_level =
-    level
-      ? (*level == 0 ? compression::ZstdCompressor::default_compression_level
-                     : *level)
+  const compression::Type wanted_type = level ? type : compression::Type::none;
+  int8_t wanted_level =
+    level ? (*level == 0 ? compression::default_level(type) : *level) : 0;
+  if (level && adaptive) {
+    // Recompression is typically done when the system is idle, so don't
+    // consider system load.
+    const bool cold_entry =
+      old_stat && time(nullptr) - old_stat.mtime() >= k_min_cold_entry_age;
+    wanted_level = compression::adaptive_level(
+      type, wanted_level, content_size, false, cold_entry);
+  }
+  const uint32_t wanted_dictionary_id =
+    wanted_type == compression::Type::zstd
+      ? compression::dictionary_id_for_new_entry(content_size)
       : 0;
 
-  if (reader->header().compression_level == wanted_level) {
+  if (reader->header().compression_type == wanted_type
+      && reader->header().compression_level == wanted_level
+      && reader->header().compression_dictionary_id == wanted_dictionary_id) {
     statistics.update(content_size, old_stat.size(), old_stat.size(), 0);
     return;
   }
 
   LOG("Recompressing {} to {}",
       cache_file.path(),
-      level ? FMT("level {}", wanted_level) : "uncompressed");
+      level
+        ? FMT("{} level {}", compression::type_to_string(type), wanted_level)
+        : "uncompressed");
   AtomicFile atomic_new_file(cache_file.path(), AtomicFile::Mode::binary);
   core::FileWriter file_writer(atomic_new_file.stream());
   auto header = reader->header();
-  header.compression_type =
-    level ? compression::Type::zstd : compression::Type::none;
+  header.entry_format_version = core::k_entry_format_version;
+  header.set_entry_size_from_payload_size(reader->header().payload_size());
+  header.compression_type = wanted_type;
   header.compression_level = wanted_level;
   auto writer = create_writer(file_writer, header);
 
+  // Copy the payload frame by frame to keep the frame boundaries that make
+  // parts of the payload skippable.
   char buffer[CCACHE_READ_BUFFER_SIZE];
   size_t bytes_left = reader->header().payload_size();
   while (bytes_left > 0) {
-    size_t bytes_to_read = std::min(bytes_left, sizeof(buffer));
+    const uint64_t bytes_left_in_frame = reader->bytes_left_in_frame();
+    if (bytes_left_in_frame == 0) {
+      throw core::Error("payload of {} is truncated", cache_file.path());
+    }
+    const size_t bytes_to_read = std::min<uint64_t>(
+      {bytes_left, bytes_left_in_frame, sizeof(buffer)});
     reader->read(buffer, bytes_to_read);
     writer->write(buffer, bytes_to_read);
+    if (bytes_to_read == bytes_left_in_frame) {
+      writer->end_frame();
+    }
     bytes_left -= bytes_to_read;
   }
   reader->finalize();
@@ -190,6 +226,12 @@ recompress_file(RecompressionStatistics& statistics,
   file.close();
 
   atomic_new_file.commit();
+
+  // Keep the timestamps so that recompression doesn't make the entry look
+  // recently used, neither to cleanup nor to the next adaptive recompression.
+  if (old_stat) {
+    Util::set_timestamps(cache_file.path(), old_stat.mtime(), old_stat.atime());
+  }
   const auto new_stat = Stat::stat(cache_file.path(), Stat::OnError::log);
 
   StatsFile(stats_file).update([=](auto& cs) {
@@ -224,6 +266,10 @@ PrimaryStorage::get_compression_statistics(
           auto reader = create_reader(cache_file, file_reader);
           cs.compr_size += cache_file.lstat().size();
           cs.content_size += reader->header().entry_size;
+          if (reader->header().compression_type == compression::Type::lz4) {
+            cs.lz4_compr_size += cache_file.lstat().size();
+            cs.lz4_content_size += reader->header().entry_size;
+          }
         } catch (core::Error&) {
           cs.incompr_size += cache_file.lstat().size();
         }
@@ -238,12 +284,14 @@ PrimaryStorage::get_compression_statistics(
 
 void
 PrimaryStorage::recompress(const nonstd::optional<int8_t> level,
+                           const compression::Type type,
                            const ProgressReceiver& progress_receiver)
 {
   const size_t threads = std::thread::hardware_concurrency();
   const size_t read_ahead = 2 * threads;
   ThreadPool thread_pool(threads, read_ahead);
   RecompressionStatistics statistics;
+  const bool adaptive = m_config.adaptive_compression();
 
   for_each_level_1_subdir(
     m_config.cache_dir(),
@@ -258,14 +306,17 @@ PrimaryStorage::recompress(const nonstd::optional<int8_t> level,
       for (size_t i = 0; i < files.size(); ++i) {
         const auto& file = files[i];
 
-        if (file.type() != CacheFile::Type::unknown) {
-          thread_pool.enqueue([&statistics, stats_file, file, level] {
-            try {
-              recompress_file(statistics, stats_file, file, level);
-            } catch (core::Error&) {
-              // Ignore for now.
-            }
-          });
+        if (file.type() != CacheFile::Type::manifest_delta
+            && file.type() != CacheFile::Type::unknown) {
+          thread_pool.enqueue(
+            [&statistics, stats_file, file, level, type, adaptive] {
+              try {
+                recompress_file(
+                  statistics, stats_file, file, level, type, adaptive);
+              } catch (core::Error&) {
+                // Ignore for now.
+              }
+            });
         } else {
           statistics.update(0, 0, 0, file.lstat().size());
         }
@@ -334,5 +385,53 @@ PrimaryStorage::recompress(const nonstd::optional<int8_t> level,
   PRINT(stdout, "Size change:          {:>9s}\n", size_difference_str);
 }
 
+uint32_t
+PrimaryStorage::train_dictionary(const ProgressReceiver& progress_receiver)
+{
+  // Limit the amount of sample data to keep memory usage and training time
+  // reasonable.
+  const size_t max_samples_size = 100 * 1024 * 1024;
+
+  std::string samples;
+  std::vector<size_t> sample_sizes;
+
+  for_each_level_1_subdir(
+    m_config.cache_dir(),
+    [&](const auto& subdir, const auto& sub_progress_receiver) {
+      const std::vector<CacheFile> files = get_level_1_files(
+        subdir, [&](double progress) { sub_progress_receiver(progress / 2); });
+
+      for (size_t i = 0; i < files.size() && samples.size() < max_samples_size;
+           ++i) {
+        const auto& cache_file = files[i];
+        try {
+          auto file = open_file(cache_file.path(), "rb");
+          core::FileReader file_reader(file.get());
+          auto reader = create_reader(cache_file, file_reader);
+          if (reader->header().entry_size
+              > compression::k_max_dictionary_entry_size) {
+            continue;
+          }
+          std::string sample(reader->header().payload_size(), '\0');
+          reader->read(&sample[0], sample.size());
+          reader->finalize();
+          samples += sample;
+          sample_sizes.push_back(sample.size());
+        } catch (core::Error&) {
+          // Not a readable cache entry, e.g. a raw file: ignore.
+        }
+
+        sub_progress_receiver(1.0 / 2 + 1.0 * i / files.size() / 2);
+      }
+    },
+    progress_receiver);
+
+  LOG("Training compression dictionary from {} entries ({} bytes)",
+      sample_sizes.size(),
+      samples.size());
+  const auto dictionary = compression::train_dictionary(samples, sample_sizes);
+  return compression::store_dictionary(m_config, dictionary);
+}
+
 } // namespace primary
 } // namespace storage
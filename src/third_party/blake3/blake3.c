@@ -244,6 +244,26 @@ INLINE size_t compress_parents_parallel(const uint8_t *child_chaining_values,
   }
 }
 
+// ccache modification: Subtrees at least this long are split with the join
+// function passed to blake3_hasher_update_parallel, if any.
+#define BLAKE3_MIN_JOIN_LEN (128 * BLAKE3_CHUNK_LEN)
+
+typedef struct {
+  blake3_join_fn join;
+  void *context;
+} blake3_joiner;
+
+struct blake3_subtree_task {
+  const uint8_t *input;
+  size_t input_len;
+  const uint32_t *key;
+  uint64_t chunk_counter;
+  uint8_t flags;
+  uint8_t *out;
+  const blake3_joiner *joiner;
+  size_t num_cvs;
+};
+
 // The wide helper function returns (writes out) an array of chaining values
 // and returns the length of that array. The number of chaining values returned
 // is the dyanmically detected SIMD degree, at most MAX_SIMD_DEGREE. Or fewer,
@@ -265,7 +285,8 @@ static size_t blake3_compress_subtree_wide(const uint8_t *input,
                                            size_t input_len,
                                            const uint32_t key[8],
                                            uint64_t chunk_counter,
-                                           uint8_t flags, uint8_t *out) {
+                                           uint8_t flags, uint8_t *out,
+                                           const blake3_joiner *joiner) {
   // Note that the single chunk case does *not* bump the SIMD degree up to 2
   // when it is 1. If this implementation adds multi-threading in the future,
   // this gives us the option of multi-threading even the 2-chunk case, which
@@ -299,12 +320,27 @@ static size_t blake3_compress_subtree_wide(const uint8_t *input,
   }
   uint8_t *right_cvs = &cv_array[degree * BLAKE3_OUT_LEN];
 
-  // Recurse! If this implementation adds multi-threading support in the
-  // future, this is where it will go.
-  size_t left_n = blake3_compress_subtree_wide(input, left_input_len, key,
-                                               chunk_counter, flags, cv_array);
-  size_t right_n = blake3_compress_subtree_wide(
-      right_input, right_input_len, key, right_chunk_counter, flags, right_cvs);
+  // Recurse! ccache modification: Large subtrees are handed to the joiner,
+  // which may hash the two halves on different threads.
+  size_t left_n;
+  size_t right_n;
+  if (joiner && input_len >= BLAKE3_MIN_JOIN_LEN) {
+    blake3_subtree_task left = {input, left_input_len, key, chunk_counter,
+                                flags, cv_array, joiner, 0};
+    blake3_subtree_task right = {right_input, right_input_len, key,
+                                 right_chunk_counter, flags, right_cvs,
+                                 joiner, 0};
+    joiner->join(joiner->context, &left, &right);
+    left_n = left.num_cvs;
+    right_n = right.num_cvs;
+  } else {
+    left_n = blake3_compress_subtree_wide(input, left_input_len, key,
+                                          chunk_counter, flags, cv_array,
+                                          joiner);
+    right_n = blake3_compress_subtree_wide(right_input, right_input_len, key,
+                                           right_chunk_counter, flags,
+                                           right_cvs, joiner);
+  }
 
   // The special case again. If simd_degree=1, then we'll have left_n=1 and
   // right_n=1. Rather than compressing them into a single output, return
@@ -320,6 +356,12 @@ static size_t blake3_compress_subtree_wide(const uint8_t *input,
                                    out);
 }
 
+void blake3_subtree_task_run(blake3_subtree_task *task) {
+  task->num_cvs = blake3_compress_subtree_wide(
+      task->input, task->input_len, task->key, task->chunk_counter,
+      task->flags, task->out, task->joiner);
+}
+
 // Hash a subtree with compress_subtree_wide(), and then condense the resulting
 // list of chaining values down to a single parent node. Don't compress that
 // last parent node, however. Instead, return its message bytes (the
@@ -332,14 +374,15 @@ static size_t blake3_compress_subtree_wide(const uint8_t *input,
 // chunk or less. That's a different codepath.
 INLINE void compress_subtree_to_parent_node(
     const uint8_t *input, size_t input_len, const uint32_t key[8],
-    uint64_t chunk_counter, uint8_t flags, uint8_t out[2 * BLAKE3_OUT_LEN]) {
+    uint64_t chunk_counter, uint8_t flags, uint8_t out[2 * BLAKE3_OUT_LEN],
+    const blake3_joiner *joiner) {
 #if defined(BLAKE3_TESTING)
   assert(input_len > BLAKE3_CHUNK_LEN);
 #endif
 
   uint8_t cv_array[MAX_SIMD_DEGREE_OR_2 * BLAKE3_OUT_LEN];
-  size_t num_cvs = blake3_compress_subtree_wide(input, input_len, key,
-                                                chunk_counter, flags, cv_array);
+  size_t num_cvs = blake3_compress_subtree_wide(
+      input, input_len, key, chunk_counter, flags, cv_array, joiner);
   assert(num_cvs <= MAX_SIMD_DEGREE_OR_2);
 
   // If MAX_SIMD_DEGREE is greater than 2 and there's enough input,
@@ -452,8 +495,9 @@ INLINE void hasher_push_cv(blake3_hasher *self, uint8_t new_cv[BLAKE3_OUT_LEN],
   self->cv_stack_len += 1;
 }
 
-void blake3_hasher_update(blake3_hasher *self, const void *input,
-                          size_t input_len) {
+static void hasher_update_base(blake3_hasher *self, const void *input,
+                               size_t input_len,
+                               const blake3_joiner *joiner) {
   // Explicitly checking for zero avoids causing UB by passing a null pointer
   // to memcpy. This comes up in practice with things like:
   //   std::vector<uint8_t> v;
@@ -539,7 +583,7 @@ void blake3_hasher_update(blake3_hasher *self, const void *input,
       uint8_t cv_pair[2 * BLAKE3_OUT_LEN];
       compress_subtree_to_parent_node(input_bytes, subtree_len, self->key,
                                       self->chunk.chunk_counter,
-                                      self->chunk.flags, cv_pair);
+                                      self->chunk.flags, cv_pair, joiner);
       hasher_push_cv(self, cv_pair, self->chunk.chunk_counter);
       hasher_push_cv(self, &cv_pair[BLAKE3_OUT_LEN],
                      self->chunk.chunk_counter + (subtree_chunks / 2));
@@ -561,6 +605,18 @@ void blake3_hasher_update(blake3_hasher *self, const void *input,
   }
 }
 
+void blake3_hasher_update(blake3_hasher *self, const void *input,
+                          size_t input_len) {
+  hasher_update_base(self, input, input_len, NULL);
+}
+
+void blake3_hasher_update_parallel(blake3_hasher *self, const void *input,
+                                   size_t input_len, blake3_join_fn join,
+                                   void *join_context) {
+  blake3_joiner joiner = {join, join_context};
+  hasher_update_base(self, input, input_len, &joiner);
+}
+
 void blake3_hasher_finalize(const blake3_hasher *self, uint8_t *out,
                             size_t out_len) {
   blake3_hasher_finalize_seek(self, 0, out, out_len);
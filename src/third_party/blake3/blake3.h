@@ -53,6 +53,20 @@ void blake3_hasher_finalize_seek(const blake3_hasher *self, uint64_t seek,
                                  uint8_t *out, size_t out_len);
 void blake3_hasher_reset(blake3_hasher *self);
 
+// ccache modification: Multi-threaded hashing of large inputs.
+//
+// blake3_hasher_update_parallel works like blake3_hasher_update but hands the
+// two halves of large subtrees to `join`, which must run both tasks with
+// blake3_subtree_task_run before returning, typically on different threads.
+// The result is the same as if blake3_hasher_update had been called.
+typedef struct blake3_subtree_task blake3_subtree_task;
+typedef void (*blake3_join_fn)(void *context, blake3_subtree_task *left,
+                               blake3_subtree_task *right);
+void blake3_subtree_task_run(blake3_subtree_task *task);
+void blake3_hasher_update_parallel(blake3_hasher *self, const void *input,
+                                   size_t input_len, blake3_join_fn join,
+                                   void *join_context);
+
 #ifdef __cplusplus
 }
 #endif
@@ -313,6 +313,27 @@ fi
         test_failed "Result file seems to be uncompressed"
     fi
 
+    # -------------------------------------------------------------------------
+    TEST "Adaptive recompression of cold entry"
+
+    generate_code 5000 large.c
+    $CCACHE_COMPILE -c large.c
+    expect_stat cache_miss 1
+    result_file=$(find $CCACHE_DIR -name '*R')
+    if ! $CCACHE --inspect $result_file | grep 'Compression level: 1$' >/dev/null 2>&1; then
+        test_failed "Result file not compressed with level 1"
+    fi
+
+    # Cold entries are recompressed with a higher level. Recompressing again
+    # must not see the rewritten entry as recently used and lower the level.
+    backdate $result_file
+    for i in 1 2; do
+        CCACHE_ADAPTIVECOMPRESS=1 $CCACHE -X 1 >/dev/null
+        if ! $CCACHE --inspect $result_file | grep 'Compression level: 12$' >/dev/null 2>&1; then
+            test_failed "Result file not compressed with level 12 after recompression $i"
+        fi
+    done
+
     # -------------------------------------------------------------------------
     TEST "Corrupt result file"
 
@@ -658,6 +679,33 @@ b"
     expect_content prefix.result "a
 b"
 
+    # -------------------------------------------------------------------------
+    TEST "Preprocessor output received in small pieces"
+
+    cat <<'EOF' >dribble
+#!/bin/sh
+"$@" | dd bs=7 2>/dev/null
+EOF
+    chmod +x dribble
+    for i in 1 2 3; do
+        echo "int h$i;" >h$i.h
+        echo "#include \"h$i.h\"" >>file.c
+    done
+    echo '#include <stdio.h>' >>file.c
+
+    $CCACHE_COMPILE -c file.c
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 1
+
+    PATH=.:$PATH CCACHE_PREFIX_CPP=dribble $CCACHE_COMPILE -c file.c
+    expect_stat preprocessed_cache_hit 1
+    expect_stat cache_miss 1
+
+    echo "int h2_2;" >>h2.h
+    PATH=.:$PATH CCACHE_PREFIX_CPP=dribble $CCACHE_COMPILE -c file.c
+    expect_stat preprocessed_cache_hit 1
+    expect_stat cache_miss 2
+
     # -------------------------------------------------------------------------
     TEST "Files in cache"
 
@@ -1000,6 +1048,52 @@ EOF
     expect_stat preprocessed_cache_hit 2
     expect_stat cache_miss 2
 
+    # -------------------------------------------------------------------------
+    TEST "CCACHE_COMPILERCHECK=command result is reused"
+
+    cat >compiler.sh <<EOF
+#!/bin/sh
+CCACHE_DISABLE=1 # If $COMPILER happens to be a ccache symlink...
+export CCACHE_DISABLE
+exec $COMPILER "\$@"
+EOF
+    chmod +x compiler.sh
+
+    cat <<EOF >check.sh
+#!/bin/sh
+echo checked >>check.log
+echo version 1
+EOF
+    chmod +x check.sh
+    export CCACHE_COMPILERCHECK=./check.sh
+    export CCACHE_COMPILERCHECK_CACHE=1
+
+    $CCACHE ./compiler.sh -c test1.c
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 1
+    expect_content check.log "checked"
+
+    $CCACHE ./compiler.sh -c test1.c
+    expect_stat preprocessed_cache_hit 1
+    expect_stat cache_miss 1
+    expect_content check.log "checked"
+
+    echo "# Compiler upgrade" >>compiler.sh
+    $CCACHE ./compiler.sh -c test1.c
+    expect_stat preprocessed_cache_hit 2
+    expect_stat cache_miss 1
+    expect_content check.log "checked
+checked"
+
+    # The remembered result is removed when clearing the cache.
+    $CCACHE -C >/dev/null
+    $CCACHE ./compiler.sh -c test1.c
+    expect_stat preprocessed_cache_hit 2
+    expect_stat cache_miss 2
+    expect_content check.log "checked
+checked
+checked"
+
     # -------------------------------------------------------------------------
     TEST "CCACHE_COMPILERCHECK=unknown_command"
 
@@ -1237,6 +1331,35 @@ EOF
     expect_content stdout "cc_out|"
     expect_content stderr "cpp_err|cc_err|"
 
+    # -------------------------------------------------------------------------
+    TEST "Caching large stdout and stderr"
+
+    # Write more than fits in a pipe buffer to stderr before writing to stdout.
+    cat >compiler.sh <<EOF
+#!/bin/sh
+if [ \$1 != -E ]; then
+    awk 'BEGIN { for (i = 0; i < 10000; i++) print "warning", i }' >&2
+    awk 'BEGIN { for (i = 0; i < 10000; i++) print "output", i }'
+fi
+CCACHE_DISABLE=1 # If $COMPILER happens to be a ccache symlink...
+export CCACHE_DISABLE
+exec $COMPILER "\$@"
+EOF
+    chmod +x compiler.sh
+    ./compiler.sh -c test1.c >reference_stdout 2>reference_stderr
+
+    $CCACHE ./compiler.sh -c test1.c >stdout 2>stderr
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 1
+    expect_content stdout "$(cat reference_stdout)"
+    expect_equal_content reference_stderr stderr
+
+    $CCACHE ./compiler.sh -c test1.c >stdout 2>stderr
+    expect_stat preprocessed_cache_hit 1
+    expect_stat cache_miss 1
+    expect_content stdout "$(cat reference_stdout)"
+    expect_equal_content reference_stderr stderr
+
     # -------------------------------------------------------------------------
     TEST "--zero-stats"
 
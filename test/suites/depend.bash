@@ -225,7 +225,7 @@ EOF
     expect_stat direct_cache_hit 1
     expect_stat preprocessed_cache_hit 0
     expect_stat cache_miss 2
-    expect_stat files_in_cache 3      # 2x result, 1x manifest
+    expect_stat files_in_cache 4      # 2x result, 1x manifest, 1x delta
 
     # Compile dir3. dir3 header change does not change object file compared to
     # dir1, but ccache still adds an additional .o/.d file in the cache due to
@@ -238,7 +238,7 @@ EOF
     expect_stat direct_cache_hit 1
     expect_stat preprocessed_cache_hit 0
     expect_stat cache_miss 3
-    expect_stat files_in_cache 4      # 3x result, 1x manifest
+    expect_stat files_in_cache 5      # 3x result, 1x manifest, 1x delta
 
     # Compile dir4. dir4 header adds a new dependency.
     cd $BASEDIR4
@@ -250,7 +250,7 @@ EOF
     expect_stat direct_cache_hit 1
     expect_stat preprocessed_cache_hit 0
     expect_stat cache_miss 4
-    expect_stat files_in_cache 5      # 4x result, 1x manifest
+    expect_stat files_in_cache 6      # 4x result, 1x manifest, 1x delta
 
     # Recompile dir1 second time.
     cd $BASEDIR1
@@ -261,7 +261,7 @@ EOF
     expect_stat direct_cache_hit 2
     expect_stat preprocessed_cache_hit 0
     expect_stat cache_miss 4
-    expect_stat files_in_cache 5
+    expect_stat files_in_cache 6
 
     # Recompile dir2.
     cd $BASEDIR2
@@ -272,7 +272,7 @@ EOF
     expect_stat direct_cache_hit 3
     expect_stat preprocessed_cache_hit 0
     expect_stat cache_miss 4
-    expect_stat files_in_cache 5
+    expect_stat files_in_cache 6
 
     # Recompile dir3.
     cd $BASEDIR3
@@ -283,7 +283,7 @@ EOF
     expect_stat direct_cache_hit 4
     expect_stat preprocessed_cache_hit 0
     expect_stat cache_miss 4
-    expect_stat files_in_cache 5
+    expect_stat files_in_cache 6
 
     # Recompile dir4.
     cd $BASEDIR4
@@ -295,7 +295,7 @@ EOF
     expect_stat direct_cache_hit 5
     expect_stat preprocessed_cache_hit 0
     expect_stat cache_miss 4
-    expect_stat files_in_cache 5
+    expect_stat files_in_cache 6
 
     # -------------------------------------------------------------------------
     TEST "Source file with special characters"
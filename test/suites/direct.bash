@@ -114,6 +114,39 @@ SUITE_direct() {
     expect_stat preprocessed_cache_hit 0
     expect_stat cache_miss 2
 
+    # -------------------------------------------------------------------------
+    TEST "Many include files"
+
+    for i in $(seq 50); do
+        echo "int h$i;" >h$i.h
+        echo "#include \"h$i.h\"" >>many.c
+    done
+    backdate h*.h
+
+    CCACHE_DEBUG_INCLUDED=1 $CCACHE_COMPILE -c many.c >included.txt
+    expect_stat direct_cache_hit 0
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 1
+    grep -c '^h[0-9]*\.h$' included.txt >count.txt
+    expect_content count.txt 50
+
+    $CCACHE_COMPILE -c many.c
+    expect_stat direct_cache_hit 1
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 1
+
+    echo "int h25_2;" >>h25.h
+    backdate h25.h
+    $CCACHE_COMPILE -c many.c
+    expect_stat direct_cache_hit 1
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 2
+
+    $CCACHE_COMPILE -c many.c
+    expect_stat direct_cache_hit 2
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 2
+
     # -------------------------------------------------------------------------
     TEST "Removed but previously compiled header file"
 
@@ -438,6 +471,68 @@ EOF
     expect_stat preprocessed_cache_hit 0
     expect_stat cache_miss 5
 
+    # -------------------------------------------------------------------------
+    TEST "Manifest delta file"
+
+    cp test1.h test1.h.saved
+
+    $CCACHE_COMPILE -c test.c
+    expect_stat cache_miss 1
+    expect_stat files_in_cache 2 # result + manifest
+    manifest_file=$(find $CCACHE_DIR -name '*M')
+    cp $manifest_file saved.manifest
+
+    echo "int test1_2;" >>test1.h
+    backdate test1.h
+    $CCACHE_COMPILE -c test.c
+    expect_stat cache_miss 2
+    expect_stat files_in_cache 4 # 2x result + manifest + manifest delta
+    expect_equal_content $manifest_file saved.manifest
+    expect_exists ${manifest_file%M}D
+    if [ $(file_size ${manifest_file%M}D) -ge $(file_size $manifest_file) ]; then
+        test_failed "Manifest delta record not smaller than the manifest"
+    fi
+
+    # A partially written record is ignored.
+    printf x >>${manifest_file%M}D
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 1
+    expect_stat cache_miss 2
+
+    # The oldest result is not promoted since it's nowhere near being evicted,
+    # so the manifest and the delta are left alone.
+    cp test1.h.saved test1.h
+    backdate test1.h
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 2
+    expect_stat cache_miss 2
+    expect_stat files_in_cache 4 # 2x result + manifest + manifest delta
+    expect_equal_content $manifest_file saved.manifest
+    expect_exists ${manifest_file%M}D
+
+    echo "int test1_2;" >>test1.h
+    backdate test1.h
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 3
+    expect_stat cache_miss 2
+
+    # -------------------------------------------------------------------------
+    TEST "Stat cache session"
+
+    export CCACHE_STATCACHE_SESSION=$$
+
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 0
+    expect_stat cache_miss 1
+    temp_dir=$($CCACHE -k temporary_dir)
+    if [ -z "$(find $temp_dir -name 'stat-cache-*' -newer test.c)" ]; then
+        test_failed "Stat cache file not created"
+    fi
+
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 1
+    expect_stat cache_miss 1
+
     # -------------------------------------------------------------------------
     TEST "-MD"
 
@@ -31,6 +31,53 @@ SUITE_hardlink() {
         test_failed "Object files not hard linked"
     fi
 
+    # -------------------------------------------------------------------------
+    TEST "Object file is moved into the cache"
+
+    generate_code 1 test1.c
+
+    $COMPILER -c -o reference_test1.o test1.c
+
+    CCACHE_HARDLINK=1 $CCACHE_COMPILE -c test1.c
+    expect_stat cache_miss 1
+    expect_stat files_in_cache 2
+    expect_equal_object_files reference_test1.o test1.o
+    expect_contains "$CCACHE_LOGFILE" "Compiling to $CCACHE_DIR/tmp/tmp.obj."
+    expect_contains "$CCACHE_LOGFILE" "Moving $CCACHE_DIR/tmp/tmp.obj."
+    if [ -n "$(find $CCACHE_DIR/tmp -name 'tmp.obj.*')" ]; then
+        test_failed "Temporary object file left behind"
+    fi
+
+    CCACHE_HARDLINK=1 $CCACHE_COMPILE -c test1.c -MD
+    expect_stat cache_miss 2
+    expect_equal_object_files reference_test1.o test1.o
+    expect_contains "$CCACHE_LOGFILE" "Hard linking test1.o to"
+
+    # -------------------------------------------------------------------------
+    if $COMPILER -c -gsplit-dwarf -o dwo_probe.o test1.c 2>/dev/null \
+            && [ -e dwo_probe.dwo ]; then
+        TEST "Large .dwo file"
+
+        for i in $(seq 1000); do
+            echo "struct s$i { int a, b; double c; };"
+            echo "int f$i(struct s$i *p) { return p->a + p->b; }"
+        done >test2.c
+
+        CCACHE_HARDLINK=1 $CCACHE_COMPILE -c -g -gsplit-dwarf test2.c
+        expect_stat cache_miss 1
+        expect_stat files_in_cache 3
+
+        mv test2.o test2.o.saved
+        mv test2.dwo test2.dwo.saved
+
+        CCACHE_HARDLINK=1 $CCACHE_COMPILE -c -g -gsplit-dwarf test2.c
+        expect_stat preprocessed_cache_hit 1
+        expect_stat files_in_cache 3
+        if [ ! test2.dwo -ef test2.dwo.saved ]; then
+            test_failed ".dwo files not hard linked"
+        fi
+    fi
+
     # -------------------------------------------------------------------------
     TEST "Corrupted file size is detected"
 
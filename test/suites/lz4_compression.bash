@@ -0,0 +1,73 @@
+SUITE_lz4_compression_PROBE() {
+    if ! $CCACHE --version | fgrep -q -- lz4-compression &> /dev/null; then
+        echo "lz4-compression not available"
+    fi
+}
+
+expect_compression_type() {
+    local result_file="$1"
+    local type="$2"
+
+    if ! $CCACHE --inspect $result_file | grep "Compression type: $type" >/dev/null 2>&1; then
+        test_failed "Result file not $type compressed according to metadata"
+    fi
+}
+
+SUITE_lz4_compression_SETUP() {
+    generate_code 1 test.c
+    $COMPILER -c -o reference_test.o test.c
+
+    export CCACHE_COMPRESSTYPE=lz4
+}
+
+SUITE_lz4_compression() {
+    # -------------------------------------------------------------------------
+    TEST "Base case"
+
+    $CCACHE_COMPILE -c test.c
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 1
+    expect_stat files_in_cache 1
+    expect_equal_object_files reference_test.o test.o
+
+    $CCACHE_COMPILE -c test.c
+    expect_stat preprocessed_cache_hit 1
+    expect_stat cache_miss 1
+    expect_stat files_in_cache 1
+    expect_equal_object_files reference_test.o test.o
+
+    expect_compression_type $(find $CCACHE_DIR -name '*R') lz4
+
+    # -------------------------------------------------------------------------
+    TEST "Readable when compression_type is zstd"
+
+    $CCACHE_COMPILE -c test.c
+    expect_stat preprocessed_cache_hit 0
+    expect_stat cache_miss 1
+
+    CCACHE_COMPRESSTYPE=zstd $CCACHE_COMPILE -c test.c
+    expect_stat preprocessed_cache_hit 1
+    expect_stat cache_miss 1
+    expect_equal_object_files reference_test.o test.o
+
+    # -------------------------------------------------------------------------
+    TEST "Recompress between zstd and LZ4"
+
+    CCACHE_COMPRESSTYPE=zstd $CCACHE_COMPILE -c test.c
+    expect_stat cache_miss 1
+    result_file=$(find $CCACHE_DIR -name '*R')
+    expect_compression_type $result_file zstd
+
+    $CCACHE -X 5 >/dev/null
+    expect_compression_type $result_file lz4
+    $CCACHE -x >compression.txt
+    expect_contains compression.txt "LZ4 compressed:"
+
+    CCACHE_COMPRESSTYPE=zstd $CCACHE -X 1 >/dev/null
+    expect_compression_type $result_file zstd
+
+    $CCACHE_COMPILE -c test.c
+    expect_stat preprocessed_cache_hit 1
+    expect_stat cache_miss 1
+    expect_equal_object_files reference_test.o test.o
+}
@@ -235,6 +235,61 @@ SUITE_secondary_file() {
     expect_stat secondary_storage_miss 0
     expect_file_count 3 '*' secondary # CACHEDIR.TAG + result + manifest
 
+    # -------------------------------------------------------------------------
+    TEST "Raw files"
+
+    $COMPILER -c -o reference_test.o test.c
+
+    CCACHE_HARDLINK=1 $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 0
+    expect_stat cache_miss 1
+    expect_stat files_in_cache 3 # result + raw object file + manifest
+    expect_stat secondary_storage_miss 2
+    expect_file_count 3 '*' secondary # CACHEDIR.TAG + result + manifest
+    expect_equal_object_files reference_test.o test.o
+
+    # Clear primary storage so that the result has to come from secondary
+    # storage, which doesn't have access to the raw object file.
+    $CCACHE -C >/dev/null
+    expect_stat files_in_cache 0
+    rm test.o
+
+    CCACHE_HARDLINK=1 $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 1
+    expect_stat cache_miss 1
+    expect_stat secondary_storage_hit 2 # result + manifest
+    expect_stat files_in_cache 2
+    expect_equal_object_files reference_test.o test.o
+
+    # -------------------------------------------------------------------------
+    TEST "Compression dictionary"
+
+    $COMPILER -c -o reference_test.o test.c
+
+    # Populate primary storage with samples and train a dictionary from them.
+    for i in $(seq 1 40); do
+        printf 'int f%d(int x) { return x * %d + %d; }\n' $i $i $i >train$i.c
+        CCACHE_SECONDARY_STORAGE= $CCACHE_COMPILE -c train$i.c
+    done
+    $CCACHE --train-dictionary >/dev/null
+    expect_exists $CCACHE_DIR/dictionaries/active
+
+    $CCACHE_COMPILE -c test.c
+    expect_stat cache_miss 41
+    expect_file_count 3 '*' secondary # CACHEDIR.TAG + result + manifest
+
+    # The dictionary only exists in the original cache directory, so a fresh
+    # cache directory must be able to read the entries without it.
+    export CCACHE_DIR=$ABS_TESTDIR/fresh
+    rm test.o
+
+    $CCACHE_COMPILE -c test.c
+    expect_stat direct_cache_hit 1
+    expect_stat cache_miss 0
+    expect_stat secondary_storage_hit 2 # result + manifest
+    expect_stat files_in_cache 2
+    expect_equal_object_files reference_test.o test.o
+
     # -------------------------------------------------------------------------
     TEST "Don't share hits"
 
@@ -176,4 +176,21 @@ SUITE_split_dwarf() {
     expect_stat preprocessed_cache_hit 0
     expect_stat cache_miss 1
     expect_exists test.x.dwo
+
+    # -------------------------------------------------------------------------
+    TEST "Large object file"
+
+    # Large enough for the object file to be restored in the background.
+    echo 'char big[2000000] = {1};' >big.c
+
+    $CCACHE_COMPILE -gsplit-dwarf -c big.c
+    expect_stat cache_miss 1
+    mv big.o reference.o
+    mv big.dwo reference.dwo
+
+    $CCACHE_COMPILE -gsplit-dwarf -c big.c
+    expect_stat direct_cache_hit 1
+    expect_stat cache_miss 1
+    expect_equal_content big.o reference.o
+    expect_equal_content big.dwo reference.dwo
 }
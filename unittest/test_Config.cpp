@@ -39,13 +39,17 @@ TEST_CASE("Config: default values")
 {
   Config config;
 
+  CHECK(!config.adaptive_compression());
   CHECK(config.base_dir().empty());
   CHECK(config.cache_dir().empty()); // Set later
   CHECK(config.compiler().empty());
   CHECK(config.compiler_check() == "mtime");
+  CHECK_FALSE(config.compiler_check_cache());
   CHECK(config.compiler_type() == CompilerType::auto_guess);
   CHECK(config.compression());
   CHECK(config.compression_level() == 0);
+  CHECK(config.compression_threads() == 1);
+  CHECK(config.compression_type() == compression::Type::zstd);
   CHECK(config.cpp_extension().empty());
   CHECK(!config.debug());
   CHECK(config.debug_dir().empty());
@@ -58,6 +62,7 @@ TEST_CASE("Config: default values")
   CHECK(config.hash_dir());
   CHECK(config.ignore_headers_in_manifest().empty());
   CHECK(config.ignore_options().empty());
+  CHECK(config.inode_cache_max_size() == 64 * 1000 * 1000);
   CHECK_FALSE(config.keep_comments_cpp());
   CHECK(config.limit_multiple() == Approx(0.8));
   CHECK(config.log_file().empty());
@@ -73,6 +78,7 @@ TEST_CASE("Config: default values")
   CHECK_FALSE(config.reshare());
   CHECK(config.run_second_cpp());
   CHECK(config.sloppiness().to_bitmask() == 0);
+  CHECK(config.stat_cache_session().empty());
   CHECK(config.stats());
   CHECK(config.temporary_dir().empty()); // Set later
   CHECK(config.umask() == nonstd::nullopt);
@@ -260,6 +266,13 @@ TEST_CASE("Config::update_from_file, error handling")
                         "ccache.conf:1: invalid unsigned integer: \"foo\"");
   }
 
+  SUBCASE("unknown compression type")
+  {
+    Util::write_file("ccache.conf", "compression_type = foo");
+    REQUIRE_THROWS_WITH(config.update_from_file("ccache.conf"),
+                        "ccache.conf:1: unknown compression type: foo");
+  }
+
   SUBCASE("missing file")
   {
     CHECK(!config.update_from_file("ccache.conf"));
@@ -373,6 +386,7 @@ TEST_CASE("Config::visit_items")
   Util::write_file(
     "test.conf",
     "absolute_paths_in_stderr = true\n"
+    "adaptive_compression = true\n"
 #ifndef _WIN32
     "base_dir = /bd\n"
 #else
@@ -381,9 +395,12 @@ TEST_CASE("Config::visit_items")
     "cache_dir = cd\n"
     "compiler = c\n"
     "compiler_check = cc\n"
+    "compiler_check_cache = true\n"
     "compiler_type = clang\n"
     "compression = true\n"
     "compression_level = 8\n"
+    "compression_threads = 2\n"
+    "compression_type = zstd\n"
     "cpp_extension = ce\n"
     "debug = false\n"
     "debug_dir = /dd\n"
@@ -397,6 +414,7 @@ TEST_CASE("Config::visit_items")
     "ignore_headers_in_manifest = ihim\n"
     "ignore_options = -a=* -b\n"
     "inode_cache = false\n"
+    "inode_cache_max_size = 12.3M\n"
     "keep_comments_cpp = true\n"
     "limit_multiple = 0.0\n"
     "log_file = lf\n"
@@ -416,6 +434,7 @@ TEST_CASE("Config::visit_items")
     "sloppiness = include_file_mtime, include_file_ctime, time_macros,"
     " file_stat_matches, file_stat_matches_ctime, pch_defines, system_headers,"
     " clang_index_store, ivfsoverlay\n"
+    "stat_cache_session = scs\n"
     "stats = false\n"
     "stats_log = sl\n"
     "temporary_dir = td\n"
@@ -433,6 +452,7 @@ TEST_CASE("Config::visit_items")
 
   std::vector<std::string> expected = {
     "(test.conf) absolute_paths_in_stderr = true",
+    "(test.conf) adaptive_compression = true",
 #ifndef _WIN32
     "(test.conf) base_dir = /bd",
 #else
@@ -441,9 +461,12 @@ TEST_CASE("Config::visit_items")
     "(test.conf) cache_dir = cd",
     "(test.conf) compiler = c",
     "(test.conf) compiler_check = cc",
+    "(test.conf) compiler_check_cache = true",
     "(test.conf) compiler_type = clang",
     "(test.conf) compression = true",
     "(test.conf) compression_level = 8",
+    "(test.conf) compression_threads = 2",
+    "(test.conf) compression_type = zstd",
     "(test.conf) cpp_extension = ce",
     "(test.conf) debug = false",
     "(test.conf) debug_dir = /dd",
@@ -457,6 +480,7 @@ TEST_CASE("Config::visit_items")
     "(test.conf) ignore_headers_in_manifest = ihim",
     "(test.conf) ignore_options = -a=* -b",
     "(test.conf) inode_cache = false",
+    "(test.conf) inode_cache_max_size = 12.3M",
     "(test.conf) keep_comments_cpp = true",
     "(test.conf) limit_multiple = 0.0",
     "(test.conf) log_file = lf",
@@ -476,6 +500,7 @@ TEST_CASE("Config::visit_items")
     "(test.conf) sloppiness = include_file_mtime, include_file_ctime,"
     " time_macros, pch_defines, file_stat_matches, file_stat_matches_ctime,"
     " system_headers, clang_index_store, ivfsoverlay",
+    "(test.conf) stat_cache_session = scs",
     "(test.conf) stats = false",
     "(test.conf) stats_log = sl",
     "(test.conf) temporary_dir = td",
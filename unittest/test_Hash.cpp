@@ -16,10 +16,48 @@
 // this program; if not, write to the Free Software Foundation, Inc., 51
 // Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 
+#include "../src/Fd.hpp"
 #include "../src/Hash.hpp"
+#include "../src/Util.hpp"
+#include "TestUtil.hpp"
 
 #include "third_party/doctest.h"
 
+#include <fcntl.h>
+
+#ifdef HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+
+#include <string>
+#include <thread>
+
+using TestUtil::TestContext;
+
+namespace {
+
+std::string
+make_data(size_t size)
+{
+  std::string data(size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = static_cast<char>(i * 7 + i / 1000);
+  }
+  return data;
+}
+
+void
+join_on_new_thread(void* /*context*/,
+                   blake3_subtree_task* left,
+                   blake3_subtree_task* right)
+{
+  std::thread thread([&] { blake3_subtree_task_run(right); });
+  blake3_subtree_task_run(left);
+  thread.join();
+}
+
+} // namespace
+
 TEST_SUITE_BEGIN("Hash");
 
 TEST_CASE("known strings")
@@ -83,4 +121,57 @@ TEST_CASE("Digest::bytes")
   CHECK(memcmp(d.bytes(), expected, Digest::size()) == 0);
 }
 
+TEST_CASE("blake3_hasher_update_parallel")
+{
+  const std::string data = make_data(1024 * 1024 + 17);
+
+  for (const size_t prefix_len : {0, 1, 1500}) {
+    for (const size_t len : {0, 1024, 200 * 1024, 1024 * 1024 + 17}) {
+      blake3_hasher expected;
+      blake3_hasher_init(&expected);
+      blake3_hasher_update(&expected, data.data(), prefix_len);
+      blake3_hasher_update(&expected, data.data(), len);
+
+      blake3_hasher actual;
+      blake3_hasher_init(&actual);
+      blake3_hasher_update(&actual, data.data(), prefix_len);
+      blake3_hasher_update_parallel(
+        &actual, data.data(), len, join_on_new_thread, nullptr);
+
+      uint8_t expected_out[BLAKE3_OUT_LEN];
+      uint8_t actual_out[BLAKE3_OUT_LEN];
+      blake3_hasher_finalize(&expected, expected_out, BLAKE3_OUT_LEN);
+      blake3_hasher_finalize(&actual, actual_out, BLAKE3_OUT_LEN);
+      CHECK(memcmp(actual_out, expected_out, BLAKE3_OUT_LEN) == 0);
+    }
+  }
+}
+
+TEST_CASE("Hash::hash_file with large file")
+{
+  TestContext test_context;
+
+  const std::string data = make_data(8 * 1024 * 1024 + 5000);
+  Util::write_file("large", data);
+
+  SUBCASE("whole file")
+  {
+    Hash hash;
+    hash.hash("prefix");
+    CHECK(hash.hash_file("large"));
+    CHECK(hash.digest() == Hash().hash("prefix").hash(data).digest());
+  }
+
+  SUBCASE("from file offset")
+  {
+    Fd fd(open("large", O_RDONLY | O_BINARY));
+    REQUIRE(fd);
+    REQUIRE(lseek(*fd, 1000, SEEK_SET) == 1000);
+    Hash hash;
+    CHECK(hash.hash_fd(*fd));
+    CHECK(hash.digest() == Hash().hash(data.substr(1000)).digest());
+    CHECK(lseek(*fd, 0, SEEK_CUR) == static_cast<off_t>(data.size()));
+  }
+}
+
 TEST_SUITE_END();
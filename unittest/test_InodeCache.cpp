@@ -21,10 +21,16 @@
 #include "../src/Hash.hpp"
 #include "../src/InodeCache.hpp"
 #include "../src/Util.hpp"
+#include "../src/fmtmacros.hpp"
 #include "TestUtil.hpp"
 
 #include "third_party/doctest.h"
 
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <vector>
+
 using TestUtil::TestContext;
 
 namespace {
@@ -194,4 +200,115 @@ TEST_CASE("Test content type")
   CHECK(return_value == 3);
 }
 
+TEST_CASE("Collisions and evictions")
+{
+  TestContext test_context;
+
+  Context ctx;
+  init(ctx);
+  ctx.config.set_inode_cache_max_size(1); // Room for a single bucket.
+  ctx.inode_cache.drop();
+
+  for (int i = 0; i < 5; ++i) {
+    const auto filename = FMT("{}", i);
+    Util::write_file(filename, filename);
+    CHECK(put(ctx, filename, filename, i));
+  }
+
+  CHECK(ctx.inode_cache.get_capacity() == 4);
+  CHECK(ctx.inode_cache.get_collisions() == 4);
+  CHECK(ctx.inode_cache.get_evictions() == 1);
+
+  Digest digest;
+  CHECK(!ctx.inode_cache.get("0", InodeCache::ContentType::code, digest));
+  CHECK(ctx.inode_cache.get("4", InodeCache::ContentType::code, digest));
+  CHECK(digest == Hash().hash("4").digest());
+}
+
+TEST_CASE("Grow when evictions exceed number of buckets")
+{
+  TestContext test_context;
+
+  Context ctx;
+  init(ctx);
+  ctx.inode_cache.drop();
+
+  const int64_t initial_capacity = ctx.inode_cache.get_capacity();
+  const int num_files = static_cast<int>(2 * initial_capacity);
+  for (int i = 0; i < num_files; ++i) {
+    const auto filename = FMT("{}", i);
+    Util::write_file(filename, filename);
+    CHECK(put(ctx, filename, filename, i));
+  }
+
+  CHECK(ctx.inode_cache.get_capacity() > initial_capacity);
+  CHECK(ctx.inode_cache.get_errors() == 0);
+
+  // The most recently inserted entries survive the migration.
+  Digest digest;
+  int return_value;
+  const auto last = FMT("{}", num_files - 1);
+  CHECK(ctx.inode_cache.get(
+    last, InodeCache::ContentType::code, digest, &return_value));
+  CHECK(digest == Hash().hash(last).digest());
+  CHECK(return_value == num_files - 1);
+}
+
+TEST_CASE("Concurrent access from several processes")
+{
+  TestContext test_context;
+
+  Context ctx;
+  init(ctx);
+  ctx.config.set_debug(false);
+  ctx.config.set_inode_cache_max_size(1); // All processes share one bucket.
+  ctx.inode_cache.drop();
+
+  const int num_files = 8;
+  for (int i = 0; i < num_files; ++i) {
+    const auto filename = FMT("{}", i);
+    Util::write_file(filename, filename);
+  }
+
+  const int num_processes = 4;
+  std::vector<pid_t> pids;
+  for (int p = 0; p < num_processes; ++p) {
+    const pid_t pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0) {
+      InodeCache inode_cache(ctx.config);
+      for (int i = 0; i < 2000; ++i) {
+        const auto filename = FMT("{}", (i + p) % num_files);
+        const auto expected = Hash().hash(filename).digest();
+        Digest digest;
+        int return_value;
+        if (inode_cache.get(
+              filename, InodeCache::ContentType::code, digest, &return_value)) {
+          if (digest != expected || return_value != (i + p) % num_files) {
+            _exit(1);
+          }
+        } else if (!inode_cache.put(filename,
+                                    InodeCache::ContentType::code,
+                                    expected,
+                                    (i + p) % num_files)) {
+          _exit(2);
+        }
+      }
+      _exit(0);
+    }
+    pids.push_back(pid);
+  }
+
+  for (const pid_t pid : pids) {
+    int status;
+    REQUIRE(waitpid(pid, &status, 0) == pid);
+    CHECK(WIFEXITED(status));
+    CHECK(WEXITSTATUS(status) == 0);
+  }
+
+  CHECK(ctx.inode_cache.get_hits() + ctx.inode_cache.get_misses()
+        == num_processes * 2000);
+  CHECK(ctx.inode_cache.get_errors() == 0);
+}
+
 TEST_SUITE_END();
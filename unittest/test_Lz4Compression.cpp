@@ -0,0 +1,170 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "../src/File.hpp"
+#include "TestUtil.hpp"
+
+#include <compression/Compressor.hpp>
+#include <compression/Decompressor.hpp>
+#include <compression/types.hpp>
+#include <core/FileReader.hpp>
+#include <core/FileWriter.hpp>
+#include <core/StringReader.hpp>
+#include <core/StringWriter.hpp>
+
+#include "third_party/doctest.h"
+
+#include <cstring>
+
+using compression::Compressor;
+using compression::Decompressor;
+using TestUtil::TestContext;
+
+TEST_SUITE_BEGIN("Lz4Compression");
+
+TEST_CASE("Small compression::Type::lz4 roundtrip")
+{
+  TestContext test_context;
+
+  File f("data.lz4", "wb");
+  core::FileWriter fw(f.get());
+  auto compressor = Compressor::create_from_type(compression::Type::lz4, fw, 1);
+  CHECK(compressor->actual_compression_level() == 1);
+  compressor->write("foobar", 6);
+  compressor->finalize();
+
+  f.open("data.lz4", "rb");
+  core::FileReader fr(f.get());
+  auto decompressor =
+    Decompressor::create_from_type(compression::Type::lz4, fr);
+
+  char buffer[4];
+  decompressor->read(buffer, 4);
+  CHECK(memcmp(buffer, "foob", 4) == 0);
+
+  // Not reached the end.
+  CHECK_THROWS_WITH(decompressor->finalize(),
+                    "Garbage data at end of LZ4 input stream");
+
+  decompressor->read(buffer, 2);
+  CHECK(memcmp(buffer, "ar", 2) == 0);
+
+  // Reached the end.
+  decompressor->finalize();
+
+  // Nothing left to read.
+  CHECK_THROWS_WITH(decompressor->read(buffer, 1),
+                    "Failed to read from file stream");
+}
+
+TEST_CASE("Large compressible compression::Type::lz4 roundtrip")
+{
+  TestContext test_context;
+
+  char data[] = "The quick brown fox jumps over the lazy dog";
+
+  for (const int8_t level : {-5, 1, 9, 127}) {
+    CAPTURE(level);
+
+    File f("data.lz4", "wb");
+    core::FileWriter fw(f.get());
+    auto compressor =
+      Compressor::create_from_type(compression::Type::lz4, fw, level);
+    CHECK(compressor->actual_compression_level() == (level > 12 ? 12 : level));
+    for (size_t i = 0; i < 1000; i++) {
+      compressor->write(data, sizeof(data));
+    }
+    compressor->finalize();
+    f.close();
+
+    f.open("data.lz4", "rb");
+    core::FileReader fr(f.get());
+    auto decompressor =
+      Decompressor::create_from_type(compression::Type::lz4, fr);
+
+    char buffer[sizeof(data)];
+    for (size_t i = 0; i < 1000; i++) {
+      decompressor->read(buffer, sizeof(buffer));
+      CHECK(memcmp(buffer, data, sizeof(data)) == 0);
+    }
+
+    // Reached the end.
+    decompressor->finalize();
+  }
+}
+
+TEST_CASE("Large uncompressible compression::Type::lz4 roundtrip")
+{
+  TestContext test_context;
+
+  char data[100000];
+  for (char& c : data) {
+    c = rand() % 256;
+  }
+
+  File f("data.lz4", "wb");
+  core::FileWriter fw(f.get());
+  auto compressor = Compressor::create_from_type(compression::Type::lz4, fw, 1);
+  compressor->write(data, sizeof(data));
+  compressor->finalize();
+
+  f.open("data.lz4", "rb");
+  core::FileReader fr(f.get());
+  auto decompressor =
+    Decompressor::create_from_type(compression::Type::lz4, fr);
+
+  char buffer[sizeof(data)];
+  decompressor->read(buffer, sizeof(buffer));
+  CHECK(memcmp(buffer, data, sizeof(data)) == 0);
+
+  decompressor->finalize();
+}
+
+TEST_CASE("compression::Type::lz4 roundtrip with several frames")
+{
+  std::string data;
+  core::StringWriter sw(data);
+  auto compressor =
+    Compressor::create_from_type(compression::Type::lz4, sw, 1);
+  compressor->write("foo", 3);
+  compressor->end_frame();
+  const size_t first_frame_size = data.size();
+  compressor->write("bar", 3);
+  compressor->finalize();
+
+  const nonstd::string_view frames(data);
+  char buffer[3];
+  {
+    core::StringReader sr(frames.substr(0, first_frame_size));
+    auto decompressor =
+      Decompressor::create_from_type(compression::Type::lz4, sr);
+    decompressor->read(buffer, 3);
+    CHECK(memcmp(buffer, "foo", 3) == 0);
+    decompressor->finalize();
+  }
+  {
+    core::StringReader sr(frames.substr(first_frame_size));
+    auto decompressor =
+      Decompressor::create_from_type(compression::Type::lz4, sr);
+    decompressor->read(buffer, 3);
+    CHECK(memcmp(buffer, "bar", 3) == 0);
+    decompressor->finalize();
+  }
+}
+
+TEST_SUITE_END();
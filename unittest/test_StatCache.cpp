@@ -0,0 +1,154 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "../src/Config.hpp"
+#include "../src/Context.hpp"
+#include "../src/StatCache.hpp"
+#include "../src/Util.hpp"
+#include "../src/fmtmacros.hpp"
+#include "TestUtil.hpp"
+
+#include "third_party/doctest.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <ctime>
+#include <thread>
+
+using TestUtil::TestContext;
+
+namespace {
+
+void
+init(Context& ctx, const std::string& session)
+{
+  ctx.config.set_cache_dir(Util::get_home_directory());
+  ctx.config.set_stat_cache_session(session);
+}
+
+// Wait until the current second has passed so that existing files are older
+// than a session started afterwards.
+void
+wait_for_next_second()
+{
+  const time_t now = time(nullptr);
+  while (time(nullptr) == now) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+} // namespace
+
+TEST_SUITE_BEGIN("StatCache");
+
+TEST_CASE("Disabled without session")
+{
+  TestContext test_context;
+
+  Context ctx;
+  init(ctx, "");
+  Util::write_file("a", "a");
+
+  CHECK(!ctx.stat_cache.enabled());
+  CHECK(ctx.stat_cache.stat("a").size() == 1);
+  CHECK(!ctx.stat_cache.stat("b"));
+  CHECK(!Stat::stat(ctx.stat_cache.get_file()));
+}
+
+TEST_CASE("Cache results for files older than the session")
+{
+  TestContext test_context;
+
+  Util::write_file("old", "old");
+  Util::create_dir("dir");
+  const auto old_real_path = Util::real_path("old");
+  wait_for_next_second();
+
+  Context ctx;
+  init(ctx, "1");
+  ctx.stat_cache.drop();
+  Util::write_file("new", "new");
+
+  CHECK(ctx.stat_cache.stat("old").size() == 3);
+  CHECK(ctx.stat_cache.stat("new").size() == 3);
+  CHECK(ctx.stat_cache.real_path("old") == old_real_path);
+  CHECK(!ctx.stat_cache.stat("missing"));
+  Util::write_file("missing", "");
+  unlink("old");
+  unlink("new");
+
+  // Only results for files older than the session are cached, and missing
+  // files are always checked again.
+  CHECK(ctx.stat_cache.stat("old").size() == 3);
+  CHECK(ctx.stat_cache.real_path("old") == old_real_path);
+  CHECK(!ctx.stat_cache.stat("new"));
+  CHECK(ctx.stat_cache.stat("missing"));
+
+  // Other processes in the same session share the results.
+  Context ctx2;
+  init(ctx2, "1");
+  CHECK(ctx2.stat_cache.stat("old").size() == 3);
+  CHECK(!ctx2.stat_cache.stat(FMT("{}/old", ctx.actual_cwd)));
+
+  // Relative paths are resolved from the current working directory.
+  REQUIRE(chdir("dir") == 0);
+  Context ctx3;
+  init(ctx3, "1");
+  CHECK(!ctx3.stat_cache.stat("old"));
+  REQUIRE(chdir("..") == 0);
+
+  // Other sessions don't.
+  Context ctx4;
+  init(ctx4, "2");
+  CHECK(ctx4.stat_cache.get_file() != ctx.stat_cache.get_file());
+  CHECK(!ctx4.stat_cache.stat("old"));
+}
+
+TEST_CASE("Files of ended sessions are removed")
+{
+  TestContext test_context;
+
+  Util::write_file("a", "a");
+
+  Context ctx;
+  init(ctx, "1");
+  CHECK(ctx.stat_cache.stat("a"));
+  Context ctx2;
+  init(ctx2, "2");
+  CHECK(ctx2.stat_cache.stat("a"));
+  REQUIRE(Stat::stat(ctx.stat_cache.get_file()));
+  REQUIRE(Stat::stat(ctx2.stat_cache.get_file()));
+
+  // Session 1 was last used two hours ago while session 2 is ongoing.
+  const time_t two_hours_ago = time(nullptr) - 2 * 60 * 60;
+  Util::set_timestamps(
+    ctx.stat_cache.get_file(), two_hours_ago, two_hours_ago);
+
+  Context ctx3;
+  init(ctx3, "3");
+  CHECK(ctx3.stat_cache.stat("a"));
+  CHECK(!Stat::stat(ctx.stat_cache.get_file()));
+  CHECK(Stat::stat(ctx2.stat_cache.get_file()));
+  CHECK(Stat::stat(ctx3.stat_cache.get_file()));
+
+  ctx2.stat_cache.drop();
+  ctx3.stat_cache.drop();
+}
+
+TEST_SUITE_END();
@@ -16,14 +16,20 @@
 // this program; if not, write to the Free Software Foundation, Inc., 51
 // Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 
+#include "../src/Config.hpp"
 #include "../src/File.hpp"
+#include "../src/Util.hpp"
+#include "../src/fmtmacros.hpp"
 #include "TestUtil.hpp"
 
 #include <compression/Compressor.hpp>
 #include <compression/Decompressor.hpp>
+#include <compression/dictionary.hpp>
 #include <compression/types.hpp>
 #include <core/FileReader.hpp>
 #include <core/FileWriter.hpp>
+#include <core/StringReader.hpp>
+#include <core/StringWriter.hpp>
 
 #include "third_party/doctest.h"
 
@@ -133,4 +139,101 @@ TEST_CASE("Large uncompressible compression::Type::zstd roundtrip")
   decompressor->finalize();
 }
 
+TEST_CASE("compression::Type::zstd roundtrip with dictionary")
+{
+  TestContext test_context;
+
+  std::string samples;
+  std::vector<size_t> sample_sizes;
+  for (size_t i = 0; i < 1000; ++i) {
+    const auto sample = FMT(
+      "test{}.o: test{}.c /usr/include/stdio.h /usr/include/stdlib.h\n", i, i);
+    samples += sample;
+    sample_sizes.push_back(sample.size());
+  }
+
+  Config config;
+  config.set_cache_dir(Util::get_actual_cwd());
+  compression::init_dictionaries(config);
+  const auto dictionary_id = compression::store_dictionary(
+    config, compression::train_dictionary(samples, sample_sizes));
+  CHECK(dictionary_id != 0);
+  CHECK(compression::dictionary_id_for_new_entry(1000) == dictionary_id);
+  CHECK(compression::dictionary_id_for_new_entry(
+          compression::k_max_dictionary_entry_size + 1)
+        == 0);
+
+  const std::string data =
+    "foo.o: foo.c /usr/include/stdio.h /usr/include/stdlib.h\n";
+
+  File f("data.zstd", "wb");
+  core::FileWriter fw(f.get());
+  auto compressor = Compressor::create_from_type(
+    compression::Type::zstd, fw, 1, dictionary_id);
+  compressor->write(data.data(), data.size());
+  compressor->finalize();
+
+  SUBCASE("With dictionary")
+  {
+    f.open("data.zstd", "rb");
+    core::FileReader fr(f.get());
+    auto decompressor = Decompressor::create_from_type(
+      compression::Type::zstd, fr, dictionary_id);
+
+    std::string buffer(data.size(), '\0');
+    decompressor->read(&buffer[0], buffer.size());
+    CHECK(buffer == data);
+    decompressor->finalize();
+  }
+
+  SUBCASE("Without dictionary")
+  {
+    f.open("data.zstd", "rb");
+    core::FileReader fr(f.get());
+    auto decompressor =
+      Decompressor::create_from_type(compression::Type::zstd, fr);
+
+    char buffer[1];
+    CHECK_THROWS_WITH(decompressor->read(buffer, 1),
+                      "Failed to read from zstd input stream");
+  }
+
+  // Don't let other tests use the dictionary.
+  Util::unlink_safe(FMT("{}/dictionaries/active", config.cache_dir()));
+  config.set_cache_dir(FMT("{}/nonexistent", config.cache_dir()));
+  compression::init_dictionaries(config);
+}
+
+TEST_CASE("compression::Type::zstd roundtrip with several frames")
+{
+  std::string data;
+  core::StringWriter sw(data);
+  auto compressor =
+    Compressor::create_from_type(compression::Type::zstd, sw, 1);
+  compressor->write("foo", 3);
+  compressor->end_frame();
+  const size_t first_frame_size = data.size();
+  compressor->write("bar", 3);
+  compressor->finalize();
+
+  const nonstd::string_view frames(data);
+  char buffer[3];
+  {
+    core::StringReader sr(frames.substr(0, first_frame_size));
+    auto decompressor =
+      Decompressor::create_from_type(compression::Type::zstd, sr);
+    decompressor->read(buffer, 3);
+    CHECK(memcmp(buffer, "foo", 3) == 0);
+    decompressor->finalize();
+  }
+  {
+    core::StringReader sr(frames.substr(first_frame_size));
+    auto decompressor =
+      Decompressor::create_from_type(compression::Type::zstd, sr);
+    decompressor->read(buffer, 3);
+    CHECK(memcmp(buffer, "bar", 3) == 0);
+    decompressor->finalize();
+  }
+}
+
 TEST_SUITE_END();
@@ -17,11 +17,15 @@
 // Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 
 #include "../src/Config.hpp"
+#include "../src/Util.hpp"
+#include "TestUtil.hpp"
 
 #include <compression/types.hpp>
 
 #include "third_party/doctest.h"
 
+using TestUtil::TestContext;
+
 TEST_SUITE_BEGIN("compression");
 
 TEST_CASE("compression::level_from_config")
@@ -30,6 +34,58 @@ TEST_CASE("compression::level_from_config")
   CHECK(compression::level_from_config(config) == 0);
 }
 
+TEST_CASE("compression::level_for_entry")
+{
+  TestContext test_context;
+
+  Config config;
+  CHECK(compression::level_for_entry(config, 1000) == 0);
+
+  Util::write_file("ccache.conf", "adaptive_compression = true");
+  REQUIRE(config.update_from_file("ccache.conf"));
+  CHECK(compression::level_for_entry(config, 1000) == 9);
+
+  Util::write_file("ccache.conf", "compression = false");
+  REQUIRE(config.update_from_file("ccache.conf"));
+  CHECK(compression::level_for_entry(config, 1000) == 0);
+}
+
+TEST_CASE("compression::adaptive_level")
+{
+  using compression::adaptive_level;
+  using compression::Type;
+
+  SUBCASE("small entry")
+  {
+    CHECK(adaptive_level(Type::zstd, 1, 1000, false, false) == 9);
+    CHECK(adaptive_level(Type::zstd, 1, 1000, true, false) == 9);
+    CHECK(adaptive_level(Type::zstd, 19, 1000, false, false) == 19);
+    CHECK(adaptive_level(Type::lz4, 1, 1000, false, false) == 9);
+  }
+
+  SUBCASE("large entry")
+  {
+    const uint64_t size = 10 * 1024 * 1024;
+    CHECK(adaptive_level(Type::zstd, 3, size, false, false) == 3);
+    CHECK(adaptive_level(Type::zstd, 3, size, true, false) == -1);
+    CHECK(adaptive_level(Type::zstd, -5, size, true, false) == -5);
+  }
+
+  SUBCASE("cold large entry")
+  {
+    const uint64_t size = 10 * 1024 * 1024;
+    CHECK(adaptive_level(Type::zstd, 3, size, false, true) == 12);
+    CHECK(adaptive_level(Type::zstd, 19, size, false, true) == 19);
+    CHECK(adaptive_level(Type::lz4, 1, size, false, true) == 12);
+    CHECK(adaptive_level(Type::zstd, 1, 1000, false, true) == 9);
+  }
+
+  SUBCASE("uncompressed")
+  {
+    CHECK(adaptive_level(Type::none, 0, 1000, false, false) == 0);
+  }
+}
+
 TEST_CASE("compression::type_from_config")
 {
   Config config;
@@ -40,13 +96,23 @@ TEST_CASE("compression::type_from_int")
 {
   CHECK(compression::type_from_int(0) == compression::Type::none);
   CHECK(compression::type_from_int(1) == compression::Type::zstd);
-  CHECK_THROWS_WITH(compression::type_from_int(2), "Unknown type: 2");
+  CHECK(compression::type_from_int(2) == compression::Type::lz4);
+  CHECK_THROWS_WITH(compression::type_from_int(3), "Unknown type: 3");
+}
+
+TEST_CASE("compression::type_from_string")
+{
+  CHECK(compression::type_from_string("zstd") == compression::Type::zstd);
+  CHECK(compression::type_from_string("lz4") == compression::Type::lz4);
+  CHECK_THROWS_WITH(compression::type_from_string("none"),
+                    "unknown compression type: none");
 }
 
 TEST_CASE("compression::type_to_string")
 {
   CHECK(compression::type_to_string(compression::Type::none) == "none");
   CHECK(compression::type_to_string(compression::Type::zstd) == "zstd");
+  CHECK(compression::type_to_string(compression::Type::lz4) == "lz4");
 }
 
 TEST_SUITE_END();
@@ -0,0 +1,223 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "../src/File.hpp"
+#include "../src/Util.hpp"
+#include "TestUtil.hpp"
+
+#include <core/CacheEntryHeader.hpp>
+#include <core/CacheEntryReader.hpp>
+#include <core/CacheEntryWriter.hpp>
+#include <core/FileReader.hpp>
+#include <core/FileWriter.hpp>
+#include <core/exceptions.hpp>
+
+#include "third_party/doctest.h"
+
+#include <cstring>
+
+using TestUtil::TestContext;
+
+namespace {
+
+void
+write_entry(const std::string& path,
+            const compression::Type compression_type,
+            const uint8_t entry_format_version = core::k_entry_format_version)
+{
+  core::CacheEntryHeader header(core::CacheEntryType::manifest,
+                                compression_type,
+                                1,
+                                0,
+                                "version",
+                                "namespace");
+  header.entry_format_version = entry_format_version;
+  header.set_entry_size_from_payload_size(9);
+
+  File f(path, "wb");
+  core::FileWriter file_writer(f.get());
+  core::CacheEntryWriter writer(file_writer, header);
+  writer.write("foo", 3);
+  writer.end_frame();
+  writer.write("bar", 3);
+  writer.write("baz", 3);
+  writer.end_frame();
+  writer.end_frame(); // no empty frame
+  writer.finalize();
+}
+
+} // namespace
+
+TEST_SUITE_BEGIN("core::CacheEntryReader");
+
+TEST_CASE("Read framed entry")
+{
+  TestContext test_context;
+
+  for (const auto type : {compression::Type::none, compression::Type::zstd}) {
+    CAPTURE(compression::type_to_string(type));
+    write_entry("entry", type);
+
+    File f("entry", "rb");
+    core::FileReader file_reader(f.get());
+    core::CacheEntryReader reader(file_reader);
+    CHECK(reader.header().entry_format_version == core::k_entry_format_version);
+    CHECK(reader.header().compression_type == type);
+    CHECK(reader.header().payload_size() == 9);
+
+    char buffer[9];
+    CHECK(reader.bytes_left_in_frame() == 3);
+    CHECK(reader.read(buffer, 2) == 2);
+    CHECK(reader.bytes_left_in_frame() == 1);
+    CHECK(reader.read(buffer + 2, 1) == 1);
+    CHECK(reader.bytes_left_in_frame() == 6);
+    CHECK(reader.read(buffer + 3, 6) == 6);
+    CHECK(memcmp(buffer, "foobarbaz", 9) == 0);
+    CHECK(reader.bytes_left_in_frame() == 0);
+    CHECK_THROWS_WITH(reader.read(buffer, 1), "Read past end of payload");
+    reader.finalize();
+  }
+}
+
+TEST_CASE("Skip in framed entry")
+{
+  TestContext test_context;
+
+  write_entry("entry", compression::Type::zstd);
+
+  File f("entry", "rb");
+  core::FileReader file_reader(f.get());
+  core::CacheEntryReader reader(file_reader);
+  char buffer[4];
+
+  SUBCASE("Whole frame")
+  {
+    reader.skip(3);
+    CHECK(reader.read(buffer, 4) == 4);
+    CHECK(memcmp(buffer, "barb", 4) == 0);
+    reader.skip(2);
+    reader.finalize();
+  }
+
+  SUBCASE("Across frames")
+  {
+    reader.skip(5);
+    CHECK(reader.read(buffer, 4) == 4);
+    CHECK(memcmp(buffer, "rbaz", 4) == 0);
+    reader.finalize();
+  }
+
+  SUBCASE("Past end")
+  {
+    CHECK_THROWS_WITH(reader.skip(10), "Skip past end of payload");
+  }
+}
+
+TEST_CASE("Frame checksum")
+{
+  TestContext test_context;
+
+  write_entry("entry", compression::Type::none);
+  auto data = Util::read_file("entry");
+  const auto pos = data.find("foo");
+  REQUIRE(pos != std::string::npos);
+  data[pos] = 'g';
+  Util::write_file("entry", data);
+
+  File f("entry", "rb");
+  core::FileReader file_reader(f.get());
+  core::CacheEntryReader reader(file_reader);
+  char buffer[6];
+
+  SUBCASE("Read corrupt frame")
+  {
+    CHECK_THROWS_AS(reader.read(buffer, 3), core::Error);
+  }
+
+  SUBCASE("Skip corrupt frame")
+  {
+    reader.skip(3);
+    CHECK(reader.read(buffer, 6) == 6);
+    CHECK(memcmp(buffer, "barbaz", 6) == 0);
+    CHECK_THROWS_AS(reader.finalize(), core::Error);
+  }
+
+  SUBCASE("Detach corrupt frame")
+  {
+    auto detached = reader.detach_payload(3);
+    REQUIRE(detached);
+    CHECK(reader.read(buffer, 6) == 6);
+    CHECK_THROWS_AS(reader.finalize(), core::Error);
+    CHECK_THROWS_AS(detached->read(buffer, 3), core::Error);
+  }
+}
+
+TEST_CASE("Detach payload")
+{
+  TestContext test_context;
+
+  write_entry("entry", compression::Type::zstd);
+
+  File f("entry", "rb");
+  core::FileReader file_reader(f.get());
+  core::CacheEntryReader reader(file_reader);
+  char buffer[6];
+
+  SUBCASE("Frame boundary")
+  {
+    auto detached = reader.detach_payload(3);
+    REQUIRE(detached);
+    CHECK(reader.read(buffer, 6) == 6);
+    CHECK(memcmp(buffer, "barbaz", 6) == 0);
+    reader.finalize();
+
+    CHECK(detached->read(buffer, 6) == 3);
+    CHECK(memcmp(buffer, "foo", 3) == 0);
+    CHECK_THROWS_AS(detached->read(buffer, 1), core::Error);
+  }
+
+  SUBCASE("Not a frame boundary")
+  {
+    CHECK_THROWS_WITH(reader.detach_payload(2),
+                      "Payload data doesn't end at a frame boundary");
+  }
+}
+
+TEST_CASE("Read unframed entry")
+{
+  TestContext test_context;
+
+  write_entry("entry", compression::Type::zstd, 1);
+
+  File f("entry", "rb");
+  core::FileReader file_reader(f.get());
+  core::CacheEntryReader reader(file_reader);
+  CHECK(reader.header().entry_format_version == 1);
+
+  char buffer[6];
+  CHECK(reader.bytes_left_in_frame() == 9);
+  reader.skip(3);
+  CHECK(reader.bytes_left_in_frame() == 6);
+  reader.read(buffer, 6);
+  CHECK(memcmp(buffer, "barbaz", 6) == 0);
+  CHECK(reader.bytes_left_in_frame() == 0);
+  CHECK(!reader.detach_payload(0));
+  reader.finalize();
+}
+
+TEST_SUITE_END();
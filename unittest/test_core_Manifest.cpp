@@ -0,0 +1,428 @@
+// Copyright (C) 2022 Joel Rosdahl and other contributors
+//
+// See doc/AUTHORS.adoc for a complete list of contributors.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the Free
+// Software Foundation; either version 3 of the License, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc., 51
+// Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include "../src/Context.hpp"
+#include "../src/Hash.hpp"
+#include "../src/Util.hpp"
+#include "../src/fmtmacros.hpp"
+#include "TestUtil.hpp"
+
+#include <core/Manifest.hpp>
+#include <core/StringReader.hpp>
+#include <core/StringWriter.hpp>
+#include <core/exceptions.hpp>
+
+#include "third_party/doctest.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+using TestUtil::TestContext;
+
+namespace {
+
+Digest
+digest_of(const std::string& data)
+{
+  Hash hash;
+  hash.hash(data);
+  return hash.digest();
+}
+
+core::Manifest
+roundtrip(const core::Manifest& manifest)
+{
+  std::string data;
+  core::StringWriter writer(data);
+  manifest.write(writer);
+  CHECK(data.size() == manifest.serialized_size());
+
+  core::Manifest result;
+  core::StringReader reader(data);
+  result.read(reader, data.size());
+  return result;
+}
+
+void
+add_numbered_result(core::Manifest& manifest, const int i)
+{
+  std::unordered_map<std::string, Digest> included_files{
+    {"a.h", digest_of(FMT("{:03}", i))}};
+  manifest.add_result(
+    digest_of(FMT("result {}", i)), included_files, 0, false);
+}
+
+} // namespace
+
+TEST_SUITE_BEGIN("core::Manifest");
+
+TEST_CASE("Empty manifest")
+{
+  TestContext test_context;
+
+  Context ctx;
+  const auto manifest = roundtrip(core::Manifest());
+  CHECK(!manifest.look_up_result_digest(ctx));
+}
+
+TEST_CASE("Look up result digest")
+{
+  TestContext test_context;
+
+  Util::write_file("a.h", "a");
+  Util::write_file("b.h", "b");
+  const auto result_1 = digest_of("result 1");
+  const auto result_2 = digest_of("result 2");
+
+  core::Manifest manifest;
+  std::unordered_map<std::string, Digest> included_files{
+    {"a.h", digest_of("a")}, {"b.h", digest_of("b")}};
+  CHECK(manifest.add_result(result_1, included_files, 0, false));
+  CHECK(!manifest.add_result(result_1, included_files, 0, false));
+
+  included_files["b.h"] = digest_of("c");
+  CHECK(manifest.add_result(result_2, included_files, 0, false));
+
+  Context ctx;
+
+  SUBCASE("First result matches")
+  {
+    const auto read_manifest = roundtrip(manifest);
+    CHECK(read_manifest.look_up_result_digest(ctx) == result_1);
+  }
+
+  SUBCASE("Second result matches")
+  {
+    Util::write_file("b.h", "c");
+    const auto read_manifest = roundtrip(manifest);
+    CHECK(read_manifest.look_up_result_digest(ctx) == result_2);
+  }
+
+  SUBCASE("No result matches")
+  {
+    Util::write_file("a.h", "x");
+    const auto read_manifest = roundtrip(manifest);
+    CHECK(!read_manifest.look_up_result_digest(ctx));
+  }
+
+  SUBCASE("Adding to read manifest")
+  {
+    auto read_manifest = roundtrip(manifest);
+    CHECK(!read_manifest.add_result(result_2, included_files, 0, false));
+    CHECK(read_manifest.serialized_size() == manifest.serialized_size());
+  }
+}
+
+TEST_CASE("Too long path")
+{
+  TestContext test_context;
+
+  core::Manifest manifest;
+  std::unordered_map<std::string, Digest> included_files{
+    {"a.h", digest_of("a")}, {std::string(65536, 'x'), digest_of("x")}};
+  CHECK_THROWS_AS(
+    manifest.add_result(digest_of("result"), included_files, 0, false),
+    core::Error);
+  CHECK(manifest.serialized_size() == core::Manifest().serialized_size());
+}
+
+TEST_CASE("Least recently used results are evicted")
+{
+  TestContext test_context;
+
+  Util::write_file("a.h", "000");
+  Context ctx;
+
+  core::Manifest manifest;
+  for (int i = 0; i < 100; ++i) {
+    add_numbered_result(manifest, i);
+  }
+  CHECK(manifest.look_up_result_digest(ctx) == digest_of("result 0"));
+
+  SUBCASE("Oldest result is evicted")
+  {
+    add_numbered_result(manifest, 100);
+    CHECK(!manifest.look_up_result_digest(ctx));
+    Util::write_file("a.h", "001");
+    CHECK(manifest.look_up_result_digest(ctx) == digest_of("result 1"));
+
+    // Unreferenced FileInfo and path entries are garbage collected.
+    core::Manifest expected;
+    for (int i = 1; i <= 100; ++i) {
+      add_numbered_result(expected, i);
+    }
+    CHECK(manifest.serialized_size() == expected.serialized_size());
+  }
+
+  SUBCASE("Promoted result is kept")
+  {
+    CHECK(!manifest.promote_result(digest_of("result 99")));
+    CHECK(!manifest.promote_result(digest_of("result 60")));
+    CHECK(manifest.promote_result(digest_of("result 0")));
+    CHECK(!manifest.promote_result(digest_of("result 0")));
+    add_numbered_result(manifest, 100);
+    CHECK(manifest.look_up_result_digest(ctx) == digest_of("result 0"));
+    Util::write_file("a.h", "001");
+    CHECK(!manifest.look_up_result_digest(ctx));
+  }
+
+  SUBCASE("Adding known result promotes it")
+  {
+    add_numbered_result(manifest, 0);
+    add_numbered_result(manifest, 100);
+    CHECK(manifest.look_up_result_digest(ctx) == digest_of("result 0"));
+  }
+}
+
+TEST_CASE("Look up result digest among results sharing include files")
+{
+  TestContext test_context;
+
+  Util::write_file("a.h", "a");
+  Util::write_file("c.h", "c");
+  core::Manifest manifest;
+  for (int i = 0; i < 3; ++i) {
+    Util::write_file("b.h", FMT("b{}", i));
+    std::unordered_map<std::string, Digest> included_files{
+      {"a.h", digest_of("a")},
+      {"b.h", digest_of(FMT("b{}", i))},
+      {"c.h", digest_of("c")}};
+    manifest.add_result(
+      digest_of(FMT("result {}", i)), included_files, 0, false);
+  }
+
+  Context ctx;
+
+  SUBCASE("Middle result matches")
+  {
+    Util::write_file("b.h", "b1");
+    CHECK(manifest.look_up_result_digest(ctx) == digest_of("result 1"));
+  }
+
+  SUBCASE("Oldest result matches")
+  {
+    Util::write_file("b.h", "b0");
+    CHECK(manifest.look_up_result_digest(ctx) == digest_of("result 0"));
+  }
+
+  SUBCASE("Shared file mismatch")
+  {
+    Util::write_file("b.h", "b1");
+    Util::write_file("c.h", "x");
+    CHECK(!manifest.look_up_result_digest(ctx));
+  }
+}
+
+TEST_CASE("Look up result digest with many include files")
+{
+  TestContext test_context;
+
+  // Enough files to make look_up_result_digest stat them concurrently.
+  std::unordered_map<std::string, Digest> included_files;
+  for (int i = 0; i < 500; ++i) {
+    const auto path = FMT("{}.h", i);
+    Util::write_file(path, path);
+    included_files.emplace(path, digest_of(path));
+  }
+  const auto result = digest_of("result");
+
+  core::Manifest manifest;
+  manifest.add_result(result, included_files, 0, false);
+
+  Context ctx;
+  CHECK(manifest.look_up_result_digest(ctx) == result);
+
+  SUBCASE("Modified file")
+  {
+    Util::write_file("123.h", "123.x");
+    CHECK(!manifest.look_up_result_digest(ctx));
+  }
+
+  SUBCASE("Removed file")
+  {
+    Util::unlink_tmp("456.h");
+    CHECK(!manifest.look_up_result_digest(ctx));
+  }
+}
+
+TEST_CASE("Merge delta records")
+{
+  TestContext test_context;
+
+  Util::write_file("a.h", "a");
+  Util::write_file("b.h", "b");
+  Util::write_file("c.h", "c");
+  const auto result_1 = digest_of("result 1");
+  const auto result_2 = digest_of("result 2");
+  const auto result_3 = digest_of("result 3");
+  std::unordered_map<std::string, Digest> included_files_1{
+    {"a.h", digest_of("a")}, {"b.h", digest_of("b")}};
+  std::unordered_map<std::string, Digest> included_files_2{
+    {"a.h", digest_of("a")}, {"b.h", digest_of("x")}};
+  std::unordered_map<std::string, Digest> included_files_3{
+    {"b.h", digest_of("b")}, {"c.h", digest_of("c")}};
+
+  core::Manifest base;
+  base.add_result(result_1, included_files_1, 0, false);
+
+  const auto delta_record = [](const core::Manifest& manifest,
+                               const Digest& result_key,
+                               std::unordered_map<std::string, Digest>& files) {
+    return manifest.delta_record(
+      result_key, files, 0, false, compression::Type::zstd, 1);
+  };
+  const auto record_2 = delta_record(base, result_2, included_files_2);
+  const auto record_3 = delta_record(base, result_3, included_files_3);
+
+  // Merging records and then adding a result gives the same manifest as adding
+  // the results directly.
+  core::Manifest expected = base;
+  expected.add_result(result_2, included_files_2, 0, false);
+  expected.add_result(result_3, included_files_3, 0, false);
+
+  const auto serialize = [](const core::Manifest& manifest) {
+    std::string data;
+    core::StringWriter writer(data);
+    manifest.write(writer);
+    return data;
+  };
+
+  Context ctx;
+
+  SUBCASE("Complete records")
+  {
+    auto manifest = base;
+    CHECK(manifest.merge_delta(record_2 + record_3) == 2);
+    CHECK(manifest.look_up_result_digest(ctx) == result_3);
+    CHECK(manifest.add_result(result_3, included_files_3, 0, false));
+    CHECK(serialize(manifest) == serialize(expected));
+    Util::write_file("b.h", "x");
+    CHECK(manifest.look_up_result_digest(ctx) == result_2);
+  }
+
+  SUBCASE("Records only hold what the manifest lacks")
+  {
+    std::unordered_map<std::string, Digest> included_files;
+    for (int i = 0; i < 100; ++i) {
+      const auto path = FMT("{}.h", i);
+      Util::write_file(path, path);
+      included_files.emplace(path, digest_of(path));
+    }
+    core::Manifest manifest;
+    manifest.add_result(result_1, included_files, 0, false);
+    included_files["100.h"] = digest_of("100.h");
+    Util::write_file("100.h", "100.h");
+
+    const auto record = delta_record(manifest, result_2, included_files);
+    CHECK(record.size() < manifest.serialized_size() / 10);
+    CHECK(manifest.merge_delta(record) == 1);
+    CHECK(manifest.look_up_result_digest(ctx) == result_2);
+  }
+
+  SUBCASE("Paths added by several records are merged once")
+  {
+    auto manifest = base;
+    CHECK(manifest.merge_delta(record_3 + record_3) == 2);
+    CHECK(manifest.add_result(result_3, included_files_3, 0, false));
+    core::Manifest expected_3 = base;
+    expected_3.add_result(result_3, included_files_3, 0, false);
+    CHECK(serialize(manifest) == serialize(expected_3));
+  }
+
+  SUBCASE("Known result is promoted")
+  {
+    auto manifest = expected;
+    CHECK(manifest.merge_delta(
+            delta_record(expected, result_1, included_files_1))
+          == 1);
+    CHECK(manifest.look_up_result_digest(ctx) == result_1);
+  }
+
+  SUBCASE("Record for another manifest version")
+  {
+    auto manifest = expected;
+    CHECK(manifest.merge_delta(record_2) == 0);
+  }
+
+  SUBCASE("Truncated record")
+  {
+    auto manifest = base;
+    auto delta = record_2 + record_3;
+    delta.pop_back();
+    CHECK(manifest.merge_delta(delta) == 1);
+    Util::write_file("b.h", "x");
+    CHECK(manifest.look_up_result_digest(ctx) == result_2);
+  }
+
+  SUBCASE("Corrupt record")
+  {
+    auto manifest = base;
+    auto delta = record_2;
+    delta.back() ^= 1;
+    delta += record_3;
+    CHECK(manifest.merge_delta(delta) == 1);
+    CHECK(manifest.look_up_result_digest(ctx) == result_3);
+    Util::write_file("b.h", "x");
+    CHECK(!manifest.look_up_result_digest(ctx));
+  }
+}
+
+TEST_CASE("Corrupt manifest")
+{
+  TestContext test_context;
+
+  Util::write_file("a.h", "a");
+  core::Manifest manifest;
+  std::unordered_map<std::string, Digest> included_files{
+    {"a.h", digest_of("a")}};
+  manifest.add_result(digest_of("result"), included_files, 0, false);
+
+  std::string data;
+  core::StringWriter writer(data);
+  manifest.write(writer);
+
+  SUBCASE("Truncated")
+  {
+    data.pop_back();
+    core::StringReader reader(data);
+    core::Manifest read_manifest;
+    CHECK_THROWS_AS(read_manifest.read(reader, data.size()), core::Error);
+  }
+
+  SUBCASE("Inflated counts")
+  {
+    // The counts follow the format version.
+    std::fill(data.begin() + 1, data.begin() + 1 + 5 * 4, '\xff');
+    core::StringReader reader(data);
+    core::Manifest read_manifest;
+    CHECK_THROWS_AS(read_manifest.read(reader, data.size()), core::Error);
+  }
+
+  SUBCASE("Bad path index")
+  {
+    // The path index of the only include entry follows the format version,
+    // the counts and the only path entry.
+    data[1 + 5 * 4 + 6 + 3] = 1;
+    core::StringReader reader(data);
+    core::Manifest read_manifest;
+    CHECK_THROWS_WITH(read_manifest.read(reader, data.size()),
+                      "Bad include entry 0 in manifest");
+  }
+}
+
+TEST_SUITE_END();
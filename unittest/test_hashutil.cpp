@@ -16,12 +16,17 @@
 // this program; if not, write to the Free Software Foundation, Inc., 51
 // Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 
+#include "../src/Context.hpp"
 #include "../src/Hash.hpp"
+#include "../src/Util.hpp"
 #include "../src/hashutil.hpp"
 #include "TestUtil.hpp"
 
 #include "third_party/doctest.h"
 
+#include <cstdlib>
+#include <cstring>
+
 using nonstd::string_view;
 using TestUtil::TestContext;
 
@@ -230,4 +235,141 @@ TEST_CASE("check_for_temporal_macros")
   }
 }
 
+TEST_CASE("hash_source_code_string")
+{
+  TestContext test_context;
+  Context ctx;
+
+  // Large enough to be processed in several chunks, with temporal macros
+  // straddling chunk boundaries.
+  std::string str(100000, ' ');
+  str.replace(16384 - 4, 8, "__TIME__");
+  str.replace(32768 - 3, 9, "__DATE__;");
+  str.replace(49152 - 1, 8, "__TIME_x");
+
+  Hash hash;
+  CHECK(hash_source_code_string(ctx, hash, str, "path")
+        == (HASH_SOURCE_CODE_FOUND_DATE | HASH_SOURCE_CODE_FOUND_TIME));
+
+  Hash hash2;
+  CHECK(hash_source_code_string(ctx, hash2, str.substr(16384), "path")
+        == HASH_SOURCE_CODE_FOUND_DATE);
+
+  Hash hash3;
+  CHECK(hash_source_code_string(ctx, hash3, str.substr(32768), "path")
+        == HASH_SOURCE_CODE_OK);
+  CHECK(hash3.digest() == Hash().hash(str.substr(32768)).digest());
+}
+
+TEST_CASE("hash_source_code_file")
+{
+  TestContext test_context;
+  Context ctx;
+
+  // The large file is processed in several chunks.
+  for (const size_t size : {100, 1000000}) {
+    std::string content(size, ' ');
+    content.replace(size - 8, 8, "__TIME__");
+    Util::write_file("test.c", content);
+
+    Hash hash;
+    CHECK(hash_source_code_file(ctx, hash, "test.c")
+          == HASH_SOURCE_CODE_FOUND_TIME);
+    CHECK(hash.digest() == Hash().hash(content).digest());
+  }
+
+  Hash hash;
+  CHECK(hash_source_code_file(ctx, hash, "missing.c")
+        == HASH_SOURCE_CODE_ERROR);
+}
+
+namespace {
+
+// Straightforward version of find_preprocessed_directive to compare with.
+size_t
+find_preprocessed_directive_reference(string_view str, size_t pos)
+{
+  for (; pos < str.length(); ++pos) {
+    if ((str[pos] == '#' && (pos == 0 || str[pos - 1] == '\n'))
+        || str.substr(pos, 3) == ".in" || str.substr(pos, 3) == "___") {
+      break;
+    }
+  }
+  return pos;
+}
+
+} // namespace
+
+TEST_CASE("find_preprocessed_directive")
+{
+  // The scalar variant and, on x86, at least the SSE2 one.
+  const auto variants = find_preprocessed_directive_variants();
+  REQUIRE(!variants.empty());
+
+  SUBCASE("Examples")
+  {
+    const string_view str =
+      "# 1 \"test.c\"\n"
+      "int a; # 2\n"
+      "#pragma GCC pch_preprocess \"x.h\"\n"
+      "asm(\".incbin \\\"x\\\"\");\n"
+      "__________Using distcc-pump\n";
+    CHECK(find_preprocessed_directive(str, 0) == 0);
+    CHECK(find_preprocessed_directive(str, 1) == str.find("#pragma"));
+    CHECK(find_preprocessed_directive(str, str.find("#pragma") + 1)
+          == str.find(".incbin"));
+    CHECK(find_preprocessed_directive(str, str.find(".incbin") + 1)
+          == str.find("___"));
+    CHECK(find_preprocessed_directive(str, str.length() - 2)
+          == str.length());
+    CHECK(find_preprocessed_directive(str, str.length()) == str.length());
+    CHECK(find_preprocessed_directive("", 0) == 0);
+    CHECK(find_preprocessed_directive("__", 0) == 2);
+    CHECK(find_preprocessed_directive("___", 0) == 0);
+    CHECK(find_preprocessed_directive("#", 0) == 0);
+  }
+
+  SUBCASE("Same as reference for random data")
+  {
+    // Few different characters so that all kinds of directives, and all kinds
+    // of near misses, occur at vector block boundaries.
+    const char alphabet[] = {'#', '\n', '.', 'i', 'n', '_', 'x'};
+    srand(17);
+    for (size_t length = 0; length < 200; ++length) {
+      std::string str(length, ' ');
+      for (auto& c : str) {
+        c = alphabet[rand() % sizeof(alphabet)];
+      }
+      for (size_t pos = 0; pos <= length; ++pos) {
+        const auto expected = find_preprocessed_directive_reference(str, pos);
+        REQUIRE(find_preprocessed_directive(str, pos) == expected);
+        for (const auto variant : variants) {
+          REQUIRE(variant(str, pos) == expected);
+        }
+      }
+    }
+  }
+
+  SUBCASE("Same as reference for sparse directives")
+  {
+    // Long stretches without any directive exercise the vector loops.
+    const char* const snippets[] = {"\n#", ".in", "___", ".i", "__"};
+    srand(4711);
+    for (size_t i = 0; i < 100; ++i) {
+      std::string str(1000, 'x');
+      for (size_t j = 0; j < 3; ++j) {
+        const char* snippet = snippets[rand() % 5];
+        str.replace(rand() % (str.length() - 3), strlen(snippet), snippet);
+      }
+      for (size_t pos = 0; pos <= str.length(); pos += 7) {
+        const auto expected = find_preprocessed_directive_reference(str, pos);
+        REQUIRE(find_preprocessed_directive(str, pos) == expected);
+        for (const auto variant : variants) {
+          REQUIRE(variant(str, pos) == expected);
+        }
+      }
+    }
+  }
+}
+
 TEST_SUITE_END();